@@ -16,26 +16,85 @@
  */
 
 #define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64 // 32 位元平台也使用 64 位元的 off_t
+#define _DEFAULT_SOURCE  // pwritev 與 IOV_MAX（glibc）
+#define _GNU_SOURCE      // O_DIRECT（glibc）
+#define _DARWIN_C_SOURCE // pwritev（macOS）
 
 #include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <math.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
+// 硬體 CRC32C：x86-64 的 SSE4.2 於執行時偵測，ARMv8 需在編譯時啟用 CRC 擴充
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_HAVE_ARMV8 1
+#endif
+
+// 節點內的向量化鍵比較：x86-64 一定支援 SSE2，AVX2 於執行時偵測；AArch64 一定支援 NEON
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define NODE_SEARCH_HAVE_SSE2 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define NODE_SEARCH_HAVE_NEON 1
+#endif
+
 /* ============================================================================
  * 常數定義
  * ============================================================================
  */
 
-#define TABLE_MAX_PAGES 100
 #define INVALID_PAGE_NUM UINT32_MAX
+#define PAGER_MAX_PAGES (UINT32_MAX - 1) // 頁面編號為 32 位元，UINT32_MAX 保留給 INVALID_PAGE_NUM
+#define INVALID_FRAME_INDEX UINT32_MAX
+#define INVALID_SHADOW_INDEX UINT32_MAX
+#define PAGER_DEFAULT_CACHE_PAGES 256 // 緩衝池預設頁框預算
+#define PAGER_MIN_CACHE_PAGES 8       // 緩衝池最小頁框預算
+#define PAGER_DEFAULT_READAHEAD 8     // 掃描時預設預讀的葉節點數量
+#define PAGER_MAX_READAHEAD 64        // 預讀葉節點數量的上限
+#define PAGE_ARENA_ALIGNMENT 4096      // 頁面緩衝區的對齊（滿足 O_DIRECT 的要求）
+#define PAGE_ARENA_GROW_PAGES 64       // 記憶體池不足時每次新增的頁面數量
+#define CRC32C_POLYNOMIAL 0x82F63B78u  // CRC32C（Castagnoli）多項式的位元反轉表示
+#define WAL_AUTOCHECKPOINT_FRAMES 1000 // 日誌累積到此訊框數量時，提交後自動執行檢查點
+#define WAL_DEFAULT_GROUP_COMMITS 1     // 群組提交預設每組的交易數量（1 表示每次提交都 fsync）
+#define WAL_DEFAULT_GROUP_DELAY_MS 10   // 群組提交預設的最長等待時間（毫秒）
+#define WAL_MAX_GROUP_COMMITS 4096      // 群組提交每組交易數量的上限
+#define WAL_MAX_GROUP_DELAY_MS 10000    // 群組提交最長等待時間的上限（毫秒）
+#define SAVEPOINT_NAME_SIZE 64          // 保存點名稱的最大長度（含結尾的 '\0'）
+#define TXN_DEFAULT_SHADOW_PAGES 1024   // 交易預設留在記憶體中的影子頁面上限
+#define TXN_MIN_SHADOW_PAGES 8          // 交易影子頁面上限的最小值
+#define SHADOW_HANDLE_FLAG 0x80000000u  // PageHandle.frame_index 的旗標：低位元為影子頁面索引
+#define CHECKPOINTER_BATCH_PAGES 32     // 背景檢查點每次持有資料庫鎖時最多寫回的頁面數量
+#define CHECKPOINTER_BATCH_DELAY_MS 10  // 背景檢查點兩批之間釋放資料庫鎖的時間（毫秒）
+#define CHECKPOINTER_POLL_MS 50         // 背景檢查點沒有工作時檢查修改的間隔（毫秒）
+#define CHECKPOINTER_MAX_INTERVAL_MS 3600000 // 背景檢查點時間門檻的上限（毫秒）
+#define NODE_SEARCH_WINDOW 32           // 節點內二分搜尋縮小到此數量的鍵以內，再以向量比較計數
+#define INPUT_READ_BUFFER_SIZE 4096     // 從標準輸入一次讀取的位元組數
+
+// 單次 pwritev 最多合併的相鄰頁面數量
+#if defined(IOV_MAX) && IOV_MAX < 256
+#define PAGER_MAX_WRITE_RUN IOV_MAX
+#else
+#define PAGER_MAX_WRITE_RUN 256
+#endif
 #define COLUMN_USERNAME_SIZE 32
 #define COLUMN_EMAIL_SIZE 255
 
@@ -55,7 +114,9 @@ typedef enum {
   EXECUTE_SUCCESS,
   EXECUTE_DUPLICATE_KEY,
   EXECUTE_TABLE_FULL,
-  EXECUTE_KEY_NOT_FOUND
+  EXECUTE_KEY_NOT_FOUND,
+  EXECUTE_DATABASE_LOCKED, // 其他行程持有寫入鎖（寫入時複製資料庫）
+  EXECUTE_SNAPSHOT_STALE   // 交易釘選的版本之後，其他行程已提交新的版本
 } ExecuteResult;
 
 // 查詢計畫類型
@@ -190,6 +251,9 @@ typedef struct {
   char *buffer;
   size_t buffer_length;
   ssize_t input_length;
+  char *read_buffer;  // 從標準輸入讀入、尚未取出的資料（不經過 stdio）
+  size_t read_start;  // read_buffer 中下一個未取出的位元組
+  size_t read_end;    // read_buffer 中有效資料的結尾
 } InputBuffer;
 
 // 資料列結構
@@ -210,12 +274,166 @@ typedef struct {
   WhereCondition where; // WHERE 子句條件
 } Statement;
 
-// 頁面管理器
+// 緩衝池頁框
+typedef struct {
+  void *data;         // 頁面內容（NULL 表示頁框閒置）
+  uint32_t page_num;  // 目前載入的頁面編號
+  uint32_t hash_next; // 同一雜湊桶（或閒置串列）中的下一個頁框索引
+  uint32_t pin_count; // 釘選次數，大於 0 時不會被置換
+  bool referenced;    // CLOCK 置換演算法的參考位元
+  bool dirty;         // 載入後是否被修改過（乾淨的頁面不需寫回）
+  bool row_logged;    // 日誌中只有這個頁面的列變更記錄，檢查點記錄整頁之前不可寫回
+} Frame;
+
+// 釘選的頁面：釘選期間頁面不會被置換，data 保持有效，用完以 pager_unpin 釋放
+typedef struct {
+  void *data;           // 頁面內容（釋放後為 NULL）
+  uint32_t page_num;    // 頁面編號
+  uint32_t frame_index; // 釘選的頁框（映射頁面與影子頁面為 INVALID_FRAME_INDEX）
+} PageHandle;
+
+// 持久性等級：決定提交、檢查點與交易外的寫入何時 fsync
+typedef enum {
+  SYNC_OFF,    // 從不 fsync，交給作業系統決定何時落盤
+  SYNC_NORMAL, // 只在檢查點（以及寫回已提交的頁面之前）fsync
+  SYNC_FULL    // 每次提交都 fsync，交易外的修改也以隱含交易經過日誌
+} SyncLevel;
+
+// 交易記錄修改的方式
+typedef enum {
+  TXN_LOG_PAGE, // 修改過的頁面整頁複製為影子頁面，提交時寫入整頁
+  TXN_LOG_ROW   // 列的插入、更新與刪除記錄前後影像並直接修改頁面，分裂與合併才複製整頁
+} TransactionLogMode;
+
+// 開啟選項（由命令列參數設定）
+typedef struct {
+  uint32_t cache_pages; // 緩衝池頁框預算
+  uint32_t page_size;   // 建立新資料庫時使用的頁面大小（0 表示預設值）
+  bool use_mmap;        // 以 mmap 讀取既有的頁面
+  bool use_direct;      // 以直接 I/O 略過作業系統的頁面快取
+  uint32_t readahead;   // 掃描時預讀的葉節點數量（0 表示停用）
+  uint32_t group_commits;  // 群組提交每組最多的交易數量
+  uint32_t group_delay_ms; // 群組提交最長等待時間（毫秒）
+  SyncLevel sync_level;    // 持久性等級
+  bool sync_level_given;   // 是否以 --sync 指定（未指定時寫入時複製資料庫使用 SYNC_FULL）
+  bool use_cow;            // 建立新資料庫時使用寫入時複製模式
+  TransactionLogMode txn_log; // 交易記錄修改的方式
+  uint32_t txn_shadow_pages;  // 交易留在記憶體中的影子頁面上限，超過時溢出到暫存檔
+  uint32_t checkpoint_interval_ms; // 交易外的修改留在記憶體中的最長時間（0 表示不依時間觸發）
+  uint32_t checkpoint_pages;       // 髒頁達到此數量時由背景執行緒寫回（0 表示不依數量觸發）
+} OpenOptions;
+
+// 頁面記憶體池：從頁面對齊的大區塊（slab）切出頁框與影子頁面的緩衝區
+typedef struct {
+  void **slabs;             // 已配置的區塊
+  uint32_t num_slabs;       // 區塊數量
+  uint32_t slab_capacity;   // 區塊陣列容量
+  void *free_list;          // 閒置緩衝區串列（前 sizeof(void *) bytes 指向下一個）
+  uint32_t page_size;       // 緩衝區大小
+  uint32_t num_pages;       // 已切出的緩衝區總數
+  uint32_t num_in_use;      // 使用中的緩衝區數量
+} PageArena;
+
+// 頁面編號串列（容量不足時自動擴充）
+typedef struct {
+  uint32_t *pages;
+  uint32_t count;
+  uint32_t capacity;
+} PageList;
+
+// 預寫日誌（Write-Ahead Log）：交易提交時依序附加修改過的頁面，檢查點時再寫回資料庫檔案
+typedef struct {
+  int file_descriptor;      // 日誌檔案描述符（-1 表示尚未建立，第一次提交時才建立）
+  char *path;               // 日誌檔案路徑（資料庫路徑加上 "-wal"）
+  uint32_t salt;            // 日誌的輪次，每次檢查點重設日誌時遞增
+  uint32_t num_frames;      // 日誌中的訊框數量
+  off_t size;               // 日誌的長度（下一個訊框的位移）
+  PageList row_pages;       // 日誌中只有列變更記錄的頁面（映射頁面可能重複出現）
+  uint32_t pending_commits; // 已寫入日誌但尚未 fsync 的交易數量（目前的群組）
+  struct timespec group_start; // 目前群組第一個交易的提交時間
+  uint32_t group_commits;   // 群組提交每組最多的交易數量（1 表示每次提交都 fsync）
+  uint32_t group_delay_ms;  // 群組第一個交易最多等待 fsync 的時間（毫秒）
+  char *confirmations;      // 群組同步完成前暫緩輸出的提交確認訊息
+  size_t confirmations_length;
+  size_t confirmations_capacity;
+  uint64_t commits;         // 寫入日誌的交易數量
+  uint64_t frames_written;  // 寫入日誌的訊框數量
+  uint64_t row_records_written; // 寫入日誌的列變更記錄數量
+  uint64_t bytes_written;   // 寫入日誌的位元組數
+  uint64_t syncs;           // 日誌的 fsync 次數
+  uint64_t checkpoints;     // 檢查點次數
+} Wal;
+
+// 寫入時複製模式的頁面對應表
+//
+// 已提交的版本只由 meta 頁引用，被取代的實體頁面要再經過一次提交、而且其他行程
+// 都不再釘選引用它的版本時才會重用，因此兩個 meta 頁引用的版本與讀取者釘選的
+// 版本都保持完整，較新的 meta 頁損毀時仍可退回前一版。
+typedef struct {
+  bool enabled;              // 是否為寫入時複製資料庫
+  uint32_t *slots;           // 邏輯頁面編號 → 實體頁面編號（0 表示尚未寫出）
+  uint32_t capacity;         // slots 的容量（對應表頁項目數量的整數倍）
+  uint32_t *map_slots;       // 各對應表頁最後提交的實體頁面編號
+  bool *map_dirty;           // 對應表頁自上次提交後是否有變更
+  uint32_t committed_pages;  // 最後提交的邏輯頁面總數
+  uint64_t *used;            // 使用中的實體頁面（位元圖）
+  uint64_t *fresh;           // 上次提交後才寫出的實體頁面（位元圖），不屬於任何已提交的版本
+  uint32_t bitmap_capacity;  // 位元圖涵蓋的實體頁面數量
+  uint32_t num_physical;     // 檔案中的實體頁面數量
+  uint32_t alloc_hint;       // 從此處開始尋找空閒的實體頁面
+  PageList allocated;        // 上次提交後配置的實體頁面
+  PageList released;         // 上次提交後被取代的實體頁面（仍屬於最後提交的版本）
+  PageList retired;          // 已被取代、等待舊版本的讀取者結束的實體頁面
+  PageList retired_generations; // retired 中各頁面被取代時的版本號（遞增）
+  uint32_t generation;       // 最後提交（或目前釘選）的版本號
+  uint32_t meta_slot;        // 最後提交寫入的 meta 頁（0 或 1）
+  char *path;                // 資料庫檔案路徑（用於錯誤訊息）
+  int readers_fd;            // 讀取者表的檔案描述符
+  uint32_t reader_slot;      // 本行程佔用的讀取者表項目
+  bool writer_locked;        // 是否持有寫入鎖
+  bool free_space_valid;     // used 位元圖與 retired 是否對應目前的版本（寫入者才需要）
+  uint64_t commits;          // 提交次數
+  uint64_t map_pages_written; // 寫出的對應表頁數量
+  uint64_t snapshots_loaded; // 切換到其他行程提交的新版本的次數
+} PageMap;
+
+// 頁面管理器（緩衝池）
 typedef struct {
   int file_descriptor;
-  uint32_t file_length;
+  off_t file_length;
   uint32_t num_pages;
-  void *pages[TABLE_MAX_PAGES];
+  Frame *frames;            // 頁框陣列
+  uint32_t frame_capacity;  // 頁框陣列容量
+  uint32_t num_resident;    // 目前載入的頁面數量
+  uint32_t num_dirty;       // 目前的髒頁數量
+  uint32_t num_pinned;      // 目前被釘選的頁框數量
+  uint32_t max_frames;      // 頁框預算，載入新頁面時依 CLOCK 置換未釘選的頁框
+  uint32_t free_frame_head; // 閒置頁框串列
+  uint32_t *page_table;     // 頁面編號 → 頁框索引的雜湊桶
+  uint32_t page_table_mask; // 雜湊桶數量 - 1（數量為 2 的冪次）
+  uint32_t clock_hand;      // CLOCK 指針
+  uint64_t cache_hits;      // 快取命中次數
+  uint64_t cache_misses;    // 快取未命中次數
+  uint64_t evictions;       // 置換次數
+  uint64_t page_writes;     // 寫回檔案的頁面數量
+  uint64_t write_calls;     // 寫入系統呼叫次數（pwrite / pwritev）
+  void *mmap_base;          // mmap 模式下的檔案映射（NULL 表示未使用）
+  uint32_t mmap_pages;      // 映射涵蓋的頁面數量
+  bool *mmap_dirty;         // 映射頁面的髒頁標記
+  bool *mmap_verified;      // 映射頁面是否已驗證過校驗碼
+  bool verify_checksums;    // 是否在載入頁面時驗證校驗碼（舊版格式升級前為 false）
+  uint32_t recorded_pages;  // 開啟時標頭頁記錄的頁面總數，之後全為 0 的頁面才視為尚未寫入
+  bool interleaved_leaves;  // 葉節點是否仍為 key 與 value 交錯的舊版佈局（升級前為 true）
+  PageArena arena;          // 頁框與影子頁面的記憶體池
+  bool direct_io;           // 是否使用直接 I/O（O_DIRECT / F_NOCACHE）
+  uint32_t readahead;       // 掃描時預讀的葉節點數量（0 表示停用）
+  uint32_t readahead_parent; // 目前預讀視窗所在的父節點
+  uint32_t readahead_end;   // 父節點中已預讀到的子節點索引
+  uint64_t readahead_pages; // 已送出預讀提示的頁面數量
+  bool needs_sync;          // 資料庫檔案是否有尚未 fsync 的寫入
+  SyncLevel sync_level;     // 持久性等級
+  Wal wal;                  // 預寫日誌
+  PageMap page_map;         // 寫入時複製模式的頁面對應表
 } Pager;
 
 // 交易狀態
@@ -226,20 +444,113 @@ typedef enum {
   TXN_STATE_ABORTED     // 已中止
 } TransactionState;
 
-// 交易結構（使用 Shadow Paging）
+// 交易中修改的頁面：整頁的影子頁面，或以列變更記錄直接修改的緩衝池頁面
+typedef struct {
+  uint32_t page_num;
+  void *data;         // 影子頁面（NULL 表示頁面只以列變更記錄修改）
+  PageHandle pinned;  // 以列變更記錄修改的頁面，交易結束前保持釘選（否則 data 為 NULL）
+  uint32_t hash_next; // 同一雜湊桶中的下一個影子頁面索引
+  uint32_t savepoint_id; // 已為這個編號的保存點保存過修改前的內容（0 表示沒有）
+  uint32_t pin_count;    // 影子頁面被釘選的次數（釘選中的影子頁面不會溢出）
+  bool referenced;       // CLOCK 參考位元
+  bool spilled;          // 影子頁面已溢出到暫存檔（data 為 NULL）
+  bool spill_current;    // 暫存檔中的內容與影子頁面相同，再次溢出時不必寫入
+} ShadowPage;
+
+// 保存點建立後第一次修改的既有頁面在修改前的內容
+typedef struct {
+  uint32_t shadow_index; // 頁面在 shadows 中的索引
+  void *data;            // 影子頁面的副本（NULL 表示當時頁面只以列變更記錄修改）
+} SavepointImage;
+
+// 保存點：只記錄建立時各串列的長度，之後修改的頁面與列變更記錄才需要保存
+typedef struct {
+  char name[SAVEPOINT_NAME_SIZE];
+  uint32_t id;              // 編號（ROLLBACK TO 之後換新的編號）
+  uint32_t num_modified;    // 建立時交易修改的頁面數量
+  uint32_t num_row_changes; // 建立時的列變更記錄數量
+  uint32_t row_images_size; // 建立時 row_images 已使用的位元組數
+  uint32_t num_images;      // 建立時 savepoint_images 的數量
+  uint32_t num_pages;       // 建立時的頁面總數（回滾時回收之後新增的頁面）
+} Savepoint;
+
+// 列變更的種類
+typedef enum {
+  ROW_CHANGE_INSERT, // 插入 cell（只有後影像）
+  ROW_CHANGE_UPDATE, // 更新 cell 的值（前後影像）
+  ROW_CHANGE_DELETE  // 刪除 cell（只有前影像）
+} RowChangeType;
+
+// 列變更記錄：回滾時以前影像復原，提交時以後影像寫入日誌
+typedef struct {
+  RowChangeType type;
+  uint32_t page_num;
+  uint32_t cell_num;
+  uint32_t key;
+  uint32_t image_offset; // 影像在 row_images 中的位移（前影像在前，後影像在後）
+} RowChange;
+
+// 交易結構（使用 Shadow Paging，或列變更記錄）
+// 只記錄交易實際修改的頁面，開始、提交與回滾的成本與修改的頁面數成正比
 typedef struct {
   TransactionState state;
-  void *shadow_pages[TABLE_MAX_PAGES];  // 影子頁面（交易中修改的頁面副本）
-  bool modified_pages[TABLE_MAX_PAGES]; // 標記哪些頁面被修改過
-  uint32_t num_modified;                // 被修改的頁面數量
+  TransactionLogMode log_mode; // 交易記錄修改的方式
+  ShadowPage *shadows;        // 被修改的頁面，依修改順序排列
+  uint32_t num_modified;      // 被修改的頁面數量
+  uint32_t shadow_capacity;   // shadows 陣列的容量
+  uint32_t *shadow_table;     // 頁面編號 → shadows 索引的雜湊桶
+  uint32_t shadow_table_mask; // 雜湊桶數量 - 1（數量為 2 的冪次）
+  uint32_t start_num_pages;   // 交易開始時的頁面總數（回滾時回收之後新增的頁面）
+  RowChange *row_changes;     // 列變更記錄，依修改順序排列
+  uint32_t num_row_changes;   // 列變更記錄數量
+  uint32_t row_change_capacity; // row_changes 陣列的容量
+  uint8_t *row_images;        // 列變更記錄的前後影像
+  uint32_t row_images_size;   // row_images 已使用的位元組數
+  uint32_t row_images_capacity; // row_images 的容量
+  Savepoint *savepoints;      // 保存點堆疊（最內層在最後）
+  uint32_t num_savepoints;    // 保存點數量
+  uint32_t savepoint_capacity; // savepoints 陣列的容量
+  SavepointImage *savepoint_images; // 保存點之後修改的頁面在修改前的內容，依保存順序排列
+  uint32_t num_savepoint_images;    // savepoint_images 的數量
+  uint32_t savepoint_image_capacity; // savepoint_images 陣列的容量
+  uint32_t next_savepoint_id; // 下一個保存點的編號
+  uint32_t max_shadow_pages;  // 留在記憶體中的影子頁面上限
+  uint32_t num_resident_shadows; // 記憶體中的影子頁面數量
+  uint32_t num_spilled;       // 溢出到暫存檔的影子頁面數量
+  uint32_t num_row_pages;     // 以列變更記錄修改、釘選在緩衝池中的頁面數量
+  uint32_t spill_clock_hand;  // 選擇溢出頁面的 CLOCK 指針
+  int spill_fd;               // 溢出暫存檔（-1 表示尚未建立）
+  char *spill_path;           // 溢出暫存檔的路徑樣板（資料庫檔案旁）
+  uint64_t spill_writes;      // 寫入暫存檔的頁面數量
+  uint64_t spill_reads;       // 從暫存檔讀回的頁面數量
 } Transaction;
 
+// 背景檢查點執行緒：交易外的修改達到時間或髒頁數量門檻時，分批寫回並執行檢查點
+//
+// 前景（REPL）執行命令時持有資料庫鎖，只在等待輸入時釋放；背景執行緒每批寫回
+// 少量頁面後就釋放資料庫鎖，前景的命令最多等待一批寫入。
+typedef struct {
+  pthread_t thread;
+  pthread_mutex_t lock;       // 資料庫鎖
+  pthread_cond_t wake;        // 要求背景執行緒結束時喚醒
+  bool stopping;              // 背景執行緒是否應該結束
+  uint32_t interval_ms;       // 修改留在記憶體中的最長時間（0 表示不依時間觸發）
+  uint32_t dirty_pages;       // 髒頁達到此數量時開始寫回（0 表示不依數量觸發）
+  bool active;                // 是否正在分批寫回
+  uint32_t batches_left;      // 這次檢查點最多再寫回幾批（寫回期間新增的髒頁留給檢查點）
+  bool has_changes;           // 上次檢查時是否有尚未寫回的修改
+  struct timespec changes_since; // 第一次發現尚未寫回的修改的時間
+  uint64_t checkpoints;       // 背景完成的檢查點次數
+  uint64_t pages_written;     // 背景寫回的頁面數量
+} Checkpointer;
+
 // 資料表結構
 typedef struct {
   Pager *pager;
   uint32_t root_page_num;
   Transaction *transaction;  // 當前交易
   TableStatistics *statistics; // 統計資訊
+  Checkpointer *checkpointer; // 背景檢查點執行緒（NULL 表示停用）
 } Table;
 
 // Cursor：用於遍歷與定位資料
@@ -248,6 +559,7 @@ typedef struct {
   uint32_t page_num;
   uint32_t cell_num;
   bool end_of_table;
+  PageHandle leaf; // 目前所在葉節點的釘選
 } Cursor;
 
 /* ============================================================================
@@ -265,7 +577,21 @@ const uint32_t USERNAME_OFFSET = ID_OFFSET + ID_SIZE;
 const uint32_t EMAIL_OFFSET = USERNAME_OFFSET + USERNAME_SIZE;
 const uint32_t ROW_SIZE = ID_SIZE + USERNAME_SIZE + EMAIL_SIZE;
 
-const uint32_t PAGE_SIZE = 4096;
+/*
+ * 頁面大小在建立資料庫時決定（--page-size，4 KB 到 64 KB 的 2 的冪次），
+ * 記錄於標頭頁；開啟既有的資料庫時由 pager_open 依標頭頁設定。
+ */
+const uint32_t DEFAULT_PAGE_SIZE = 4096;
+const uint32_t MIN_PAGE_SIZE = 4096;
+const uint32_t MAX_PAGE_SIZE = 65536;
+uint32_t PAGE_SIZE;
+
+/*
+ * 每個頁面的最後 4 bytes 保留給 CRC32C 校驗碼（涵蓋頁面編號與其餘內容），
+ * 寫回檔案時計算，從檔案載入時驗證。節點、標頭頁與空閒頁都不使用這個區域。
+ */
+const uint32_t PAGE_CHECKSUM_SIZE = sizeof(uint32_t);
+uint32_t PAGE_CHECKSUM_OFFSET; // PAGE_SIZE - PAGE_CHECKSUM_SIZE，由 configure_page_layout 計算
 
 /* ============================================================================
  * B-Tree 節點佈局常數
@@ -302,24 +628,24 @@ const uint32_t LEAF_NODE_HEADER_SIZE = COMMON_NODE_HEADER_SIZE +
                                        LEAF_NODE_NEXT_LEAF_SIZE;
 
 /*
- * 葉節點 Cell 佈局：
- * - key: 主鍵
- * - value: 完整的 Row 資料
+ * 葉節點 Cell 佈局：key 與 value 分開存放
+ * - keys: 標頭之後（對齊到 16 bytes）連續的主鍵陣列，容納 LEAF_NODE_MAX_CELLS 個
+ * - values: key 陣列之後連續的 Row 資料陣列
+ * 搜尋只讀取 key 陣列，不會碰到列資料。
  */
 const uint32_t LEAF_NODE_KEY_SIZE = sizeof(uint32_t);
-const uint32_t LEAF_NODE_KEY_OFFSET = 0;
+const uint32_t LEAF_NODE_KEYS_OFFSET = (LEAF_NODE_HEADER_SIZE + 15) / 16 * 16;
 const uint32_t LEAF_NODE_VALUE_SIZE = ROW_SIZE;
-const uint32_t LEAF_NODE_VALUE_OFFSET =
-    LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE;
 const uint32_t LEAF_NODE_CELL_SIZE = LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE;
-const uint32_t LEAF_NODE_SPACE_FOR_CELLS = PAGE_SIZE - LEAF_NODE_HEADER_SIZE;
-const uint32_t LEAF_NODE_MAX_CELLS =
-    LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE;
+
+// 以下數值取決於頁面大小，由 configure_page_layout 計算
+uint32_t LEAF_NODE_SPACE_FOR_CELLS;
+uint32_t LEAF_NODE_MAX_CELLS;
+uint32_t LEAF_NODE_VALUES_OFFSET;
 
 // 葉節點分裂時的分配數量
-const uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
-const uint32_t LEAF_NODE_LEFT_SPLIT_COUNT =
-    (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
+uint32_t LEAF_NODE_RIGHT_SPLIT_COUNT;
+uint32_t LEAF_NODE_LEFT_SPLIT_COUNT;
 
 /*
  * 內部節點標頭（Internal Node Header）：
@@ -345,8 +671,154 @@ const uint32_t INTERNAL_NODE_CHILD_SIZE = sizeof(uint32_t);
 const uint32_t INTERNAL_NODE_CELL_SIZE =
     INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE;
 
-// 為了測試方便，暫時設定較小的值
-const uint32_t INTERNAL_NODE_MAX_CELLS = 3;
+// 內部節點可容納的 Cell 數量上限（填滿整個頁面），由 configure_page_layout 計算
+uint32_t INTERNAL_NODE_SPACE_FOR_CELLS;
+uint32_t INTERNAL_NODE_MAX_CELLS;
+
+/* ============================================================================
+ * 資料庫標頭頁佈局常數
+ * ============================================================================
+ */
+
+/*
+ * 第 0 頁為資料庫標頭頁（Header Page）：
+ * - magic: 檔案識別碼
+ * - format_version: 檔案格式版本，格式變更時遞增（第 2 版起每個頁面都有校驗碼）
+ * - page_size: 建立資料庫時使用的頁面大小
+ * - root_page: 根節點的頁面編號
+ * - freelist_head: 第一個空閒頁的編號（0 表示沒有空閒頁）
+ * - free_page_count: 空閒頁的數量
+ * - page_count: 上次正常關閉時的頁面總數
+ * - stats_page: 統計資訊頁的編號（0 表示尚未保存統計資訊）
+ *
+ * 空閒頁（Free Page）的前 4 bytes 儲存下一個空閒頁的編號，0 表示串列結尾。
+ * 第 0 頁永遠是標頭頁，因此 0 可以安全地作為「沒有頁面」的標記。
+ */
+const char HEADER_MAGIC[] = "CSQLDB\0";
+const uint32_t DB_FORMAT_VERSION = 3;
+const uint32_t DB_FORMAT_VERSION_INTERLEAVED_LEAVES = 2; // 葉節點 key 與 value 交錯的舊版格式，開啟時升級
+const uint32_t DB_FORMAT_VERSION_NO_CHECKSUMS = 1; // 頁面沒有校驗碼的舊版格式，開啟時升級
+const uint32_t HEADER_PAGE_NUM = 0;
+const uint32_t HEADER_MAGIC_SIZE = sizeof(HEADER_MAGIC);
+const uint32_t HEADER_MAGIC_OFFSET = 0;
+const uint32_t HEADER_FORMAT_VERSION_SIZE = sizeof(uint32_t);
+const uint32_t HEADER_FORMAT_VERSION_OFFSET = HEADER_MAGIC_OFFSET + HEADER_MAGIC_SIZE;
+const uint32_t HEADER_PAGE_SIZE_SIZE = sizeof(uint32_t);
+const uint32_t HEADER_PAGE_SIZE_OFFSET =
+    HEADER_FORMAT_VERSION_OFFSET + HEADER_FORMAT_VERSION_SIZE;
+const uint32_t HEADER_ROOT_PAGE_SIZE = sizeof(uint32_t);
+const uint32_t HEADER_ROOT_PAGE_OFFSET = HEADER_PAGE_SIZE_OFFSET + HEADER_PAGE_SIZE_SIZE;
+const uint32_t HEADER_FREELIST_HEAD_SIZE = sizeof(uint32_t);
+const uint32_t HEADER_FREELIST_HEAD_OFFSET =
+    HEADER_ROOT_PAGE_OFFSET + HEADER_ROOT_PAGE_SIZE;
+const uint32_t HEADER_FREE_PAGE_COUNT_SIZE = sizeof(uint32_t);
+const uint32_t HEADER_FREE_PAGE_COUNT_OFFSET =
+    HEADER_FREELIST_HEAD_OFFSET + HEADER_FREELIST_HEAD_SIZE;
+const uint32_t HEADER_PAGE_COUNT_SIZE = sizeof(uint32_t);
+const uint32_t HEADER_PAGE_COUNT_OFFSET =
+    HEADER_FREE_PAGE_COUNT_OFFSET + HEADER_FREE_PAGE_COUNT_SIZE;
+const uint32_t HEADER_STATS_PAGE_SIZE = sizeof(uint32_t);
+const uint32_t HEADER_STATS_PAGE_OFFSET =
+    HEADER_PAGE_COUNT_OFFSET + HEADER_PAGE_COUNT_SIZE;
+
+/*
+ * 統計資訊頁：依序儲存 is_valid 與 TableStatistics 的各個欄位（皆為 uint32_t）
+ */
+const uint32_t STATS_PAGE_IS_VALID_OFFSET = 0;
+const uint32_t STATS_PAGE_FIELDS_OFFSET = sizeof(uint32_t);
+
+const uint32_t FREE_PAGE_NEXT_OFFSET = 0;
+
+/* ============================================================================
+ * 預寫日誌（WAL）佈局常數
+ * ============================================================================
+ */
+
+/*
+ * 預寫日誌檔案（資料庫路徑加上 "-wal"）由日誌標頭與連續的訊框組成：
+ * - 日誌標頭：magic、format_version、page_size、salt、checksum（前四個欄位的 CRC32C）
+ * - 訊框：訊框標頭加上內容
+ *   - page_num: 頁面編號，內容為完整的頁面；WAL_ROW_FRAME 表示列變更訊框
+ *   - db_size: 交易的最後一個訊框（提交訊框）記錄提交後的頁面總數，其他訊框為 0
+ *   - salt: 必須與日誌標頭相同，前一輪日誌留下的訊框因此失效
+ *   - checksum: 訊框標頭前三個欄位與內容的 CRC32C
+ * - 列變更訊框的內容：記錄的總長度（不超過一頁），接著是連續的列變更記錄
+ *   - type、page_num、cell_num、key，插入與更新再加上 cell 的值（ROW_SIZE bytes）
+ *
+ * 復原時只重做到最後一個提交訊框為止的訊框，之後未完成的交易會被捨棄。
+ * 列變更記錄不能重複套用，因此頁面只有列變更記錄時不會寫回資料庫檔案，
+ * 直到檢查點將整頁附加到日誌為止；復原時同一頁面較晚的整頁訊框之前的列變更記錄
+ * 都會被略過。版本 1 的日誌沒有列變更訊框，仍然可以重做。
+ */
+const char WAL_MAGIC[] = "CSQLWAL";
+const uint32_t WAL_FORMAT_VERSION = 2;
+const uint32_t WAL_FORMAT_VERSION_PAGES_ONLY = 1; // 只有整頁訊框的舊版日誌
+const uint32_t WAL_MAGIC_SIZE = sizeof(WAL_MAGIC);
+const uint32_t WAL_MAGIC_OFFSET = 0;
+const uint32_t WAL_FORMAT_VERSION_OFFSET = WAL_MAGIC_OFFSET + WAL_MAGIC_SIZE;
+const uint32_t WAL_PAGE_SIZE_OFFSET = WAL_FORMAT_VERSION_OFFSET + sizeof(uint32_t);
+const uint32_t WAL_SALT_OFFSET = WAL_PAGE_SIZE_OFFSET + sizeof(uint32_t);
+const uint32_t WAL_HEADER_CHECKSUM_OFFSET = WAL_SALT_OFFSET + sizeof(uint32_t);
+const uint32_t WAL_HEADER_SIZE = WAL_HEADER_CHECKSUM_OFFSET + sizeof(uint32_t);
+
+const uint32_t WAL_FRAME_PAGE_NUM_OFFSET = 0;
+const uint32_t WAL_FRAME_DB_SIZE_OFFSET = WAL_FRAME_PAGE_NUM_OFFSET + sizeof(uint32_t);
+const uint32_t WAL_FRAME_SALT_OFFSET = WAL_FRAME_DB_SIZE_OFFSET + sizeof(uint32_t);
+const uint32_t WAL_FRAME_CHECKSUM_OFFSET = WAL_FRAME_SALT_OFFSET + sizeof(uint32_t);
+const uint32_t WAL_FRAME_HEADER_SIZE = WAL_FRAME_CHECKSUM_OFFSET + sizeof(uint32_t);
+
+const uint32_t WAL_ROW_FRAME = INVALID_PAGE_NUM; // 列變更訊框的 page_num
+const uint32_t WAL_ROW_FRAME_LENGTH_SIZE = sizeof(uint32_t);
+const uint32_t WAL_ROW_TYPE_OFFSET = 0;
+const uint32_t WAL_ROW_PAGE_NUM_OFFSET = WAL_ROW_TYPE_OFFSET + sizeof(uint32_t);
+const uint32_t WAL_ROW_CELL_NUM_OFFSET = WAL_ROW_PAGE_NUM_OFFSET + sizeof(uint32_t);
+const uint32_t WAL_ROW_KEY_OFFSET = WAL_ROW_CELL_NUM_OFFSET + sizeof(uint32_t);
+const uint32_t WAL_ROW_HEADER_SIZE = WAL_ROW_KEY_OFFSET + sizeof(uint32_t);
+
+/* ============================================================================
+ * 寫入時複製（Copy-on-Write）佈局常數
+ * ============================================================================
+ */
+
+/*
+ * 寫入時複製資料庫（以 --cow 建立）從不在原處覆寫已提交的頁面：邏輯頁面
+ * （包括標頭頁）經由頁面對應表找到實體位置，修改過的頁面一律寫到新的位置，
+ * 提交則是寫出一個指向新對應表的 meta 頁。
+ *
+ * 第 0、1 頁為輪流寫入的 meta 頁：
+ * - magic、format_version、page_size: 與標頭頁位於相同位置（用於偵測頁面大小）
+ * - generation: 提交的版本號，開啟時使用校驗碼正確且版本較新的 meta 頁
+ * - page_count: 邏輯頁面總數
+ * - map_page_count: 對應表頁的數量
+ * - map_pages: 各對應表頁的實體頁面編號
+ *
+ * 對應表頁依序存放各邏輯頁面的實體頁面編號（0 表示尚未寫出，讀取時為全 0 的頁面）。
+ * meta 頁與對應表頁的校驗碼以實體頁面編號計算，資料頁則以邏輯頁面編號計算。
+ */
+const char COW_META_MAGIC[] = "CSQLCOW"; // 與 HEADER_MAGIC 等長
+const uint32_t COW_META_SLOTS = 2;
+const uint32_t COW_META_GENERATION_OFFSET = HEADER_PAGE_SIZE_OFFSET + HEADER_PAGE_SIZE_SIZE;
+const uint32_t COW_META_PAGE_COUNT_OFFSET = COW_META_GENERATION_OFFSET + sizeof(uint32_t);
+const uint32_t COW_META_MAP_PAGE_COUNT_OFFSET = COW_META_PAGE_COUNT_OFFSET + sizeof(uint32_t);
+const uint32_t COW_META_MAP_PAGES_OFFSET = COW_META_MAP_PAGE_COUNT_OFFSET + sizeof(uint32_t);
+
+// 以下數值取決於頁面大小，由 configure_page_layout 計算
+uint32_t COW_MAP_ENTRIES_PER_PAGE; // 每個對應表頁的項目數量
+uint32_t COW_META_MAX_MAP_PAGES;   // meta 頁最多可記錄的對應表頁數量
+
+/*
+ * 讀取者表（資料庫路徑加上 "-readers"）讓多個行程同時開啟寫入時複製資料庫：
+ * - 第 0 byte：寫入鎖，同一時間只有一個行程能修改資料庫
+ * - 之後每個項目 8 bytes（generation、active），由開啟資料庫的行程以 fcntl 鎖定並佔用
+ *
+ * 讀取者在每個語句（或整個交易）開始時釘選最新提交的版本並寫入自己的項目，
+ * 寫入者只重用所有讀取者都已看不到的實體頁面。行程結束時 fcntl 鎖自動釋放，
+ * 異常結束的行程留下的項目因此不會永遠釘選舊版本。
+ */
+const off_t COW_READERS_WRITER_LOCK_OFFSET = 0;
+const off_t COW_READERS_SLOTS_OFFSET = 8;
+const uint32_t COW_READERS_SLOT_SIZE = 2 * sizeof(uint32_t);
+#define COW_READERS_MAX_SLOTS 126 // 同時開啟同一資料庫的行程數量上限
 
 /* ============================================================================
  * 函式前置宣告
@@ -359,25 +831,31 @@ bool is_node_root(void *node);
 void set_node_root(void *node, bool is_root);
 uint32_t *node_parent(void *node);
 void *get_page(Pager *pager, uint32_t page_num);
-uint32_t get_unused_page_num(Pager *pager);
-uint32_t get_node_max_key(Pager *pager, void *node);
+uint32_t get_unused_page_num(Table *table);
+void table_free_page(Table *table, uint32_t page_num);
+uint32_t get_node_max_key(Table *table, uint32_t page_num);
 
 // 葉節點操作
 uint32_t *leaf_node_num_cells(void *node);
 uint32_t *leaf_node_next_leaf(void *node);
-void *leaf_node_cell(void *node, uint32_t cell_num);
 uint32_t *leaf_node_key(void *node, uint32_t cell_num);
 void *leaf_node_value(void *node, uint32_t cell_num);
+void leaf_node_move_cells(void *destination, uint32_t destination_cell, void *source,
+                          uint32_t source_cell, uint32_t count);
 void initialize_leaf_node(void *node);
 void leaf_node_insert(Cursor *cursor, uint32_t key, Row *value);
 void leaf_node_split_and_insert(Cursor *cursor, uint32_t key, Row *value);
 void leaf_node_delete(Cursor *cursor);
+bool leaf_node_apply_row_change(void *node, RowChangeType type, uint32_t cell_num,
+                                uint32_t key, const void *value);
+uint32_t leaf_node_predecessor(Table *table, uint32_t page_num);
 void leaf_node_merge(Table *table, uint32_t left_page_num,
                      uint32_t right_page_num);
 void internal_node_merge(Table *table, uint32_t parent_page_num,
                          uint32_t left_page_num, uint32_t right_page_num);
 bool should_merge_leaf_nodes(Table *table, uint32_t page_num);
 bool should_merge_internal_nodes(Table *table, uint32_t page_num);
+uint32_t leaf_node_find_cell(void *node, uint32_t key);
 Cursor *leaf_node_find(Table *table, uint32_t page_num, uint32_t key);
 
 // 內部節點操作
@@ -393,8 +871,35 @@ void internal_node_insert(Table *table, uint32_t parent_page_num,
 void internal_node_split_and_insert(Table *table, uint32_t parent_page_num,
                                     uint32_t child_page_num);
 void update_internal_node_key(void *node, uint32_t old_key, uint32_t new_key);
+void internal_node_remove_child(Table *table, uint32_t parent_page_num,
+                                uint32_t child_page_num);
+void internal_node_remove_cell(void *node, uint32_t cell_num);
+uint32_t internal_node_child_index(void *node, uint32_t child_page_num);
 Cursor *internal_node_find(Table *table, uint32_t page_num, uint32_t key);
 
+// 持久性等級
+bool parse_sync_level(const char *name, SyncLevel *level);
+const char *sync_level_name(SyncLevel level);
+bool parse_txn_log_mode(const char *name, TransactionLogMode *mode);
+const char *txn_log_mode_name(TransactionLogMode mode);
+
+// 頁面佈局
+bool page_size_is_valid(uint32_t page_size);
+void configure_page_layout(uint32_t page_size);
+
+// 標頭頁與空閒頁操作
+uint32_t *header_format_version(void *header);
+uint32_t *header_page_size(void *header);
+uint32_t *header_root_page(void *header);
+uint32_t *header_freelist_head(void *header);
+uint32_t *header_free_page_count(void *header);
+uint32_t *header_page_count(void *header);
+uint32_t *header_stats_page(void *header);
+uint32_t *free_page_next(void *page);
+uint32_t *page_checksum_field(void *page);
+void initialize_header_page(void *header, uint32_t root_page_num);
+bool header_is_valid(void *header);
+
 // B-tree 操作
 Cursor *table_find(Table *table, uint32_t key);
 Cursor *table_start(Table *table);
@@ -403,6 +908,7 @@ void create_new_root(Table *table, uint32_t right_child_page_num);
 // Cursor 操作
 void *cursor_value(Cursor *cursor);
 void cursor_advance(Cursor *cursor);
+void cursor_close(Cursor *cursor);
 
 // 序列化
 void serialize_row(Row *source, void *destination);
@@ -410,24 +916,91 @@ void deserialize_row(void *source, Row *destination);
 
 // 輸入與輸出
 void print_prompt(void);
-void read_input(InputBuffer *input_buffer);
+bool read_input(InputBuffer *input_buffer);
+bool input_available(InputBuffer *input_buffer, uint32_t timeout_ms);
 void print_row(Row *row);
 void print_constants(void);
-void print_tree(Pager *pager, uint32_t page_num, uint32_t indentation_level);
+void print_tree(Table *table, uint32_t page_num, uint32_t indentation_level);
 
 // Pager 與資料庫管理
-Pager *pager_open(const char *filename);
+Pager *pager_open(const char *filename, const OpenOptions *options);
 void pager_flush(Pager *pager, uint32_t page_num);
-Table *db_open(const char *filename);
+void pager_mark_dirty(Pager *pager, uint32_t page_num);
+void pager_flush_pages(Pager *pager, uint32_t *page_nums, uint32_t count);
+void pager_flush_all(Pager *pager);
+PageHandle pager_pin(Pager *pager, uint32_t page_num);
+void pager_unpin(Pager *pager, PageHandle *handle);
+void pager_evict_to_budget(Pager *pager);
+void pager_discard_frames(Pager *pager);
+void pager_prefetch(Pager *pager, uint32_t *page_nums, uint32_t count);
+void *pager_resident_page(Pager *pager, uint32_t page_num);
+void pager_set_cache_size(Pager *pager, uint32_t max_frames);
+void pager_checkpoint(Pager *pager);
+Table *db_open(const char *filename, const OpenOptions *options);
 void db_close(Table *table);
+void checkpointer_start(Table *table, uint32_t interval_ms, uint32_t dirty_pages);
+void checkpointer_stop(Table *table);
+void table_lock(Table *table);
+void table_unlock(Table *table);
+
+// 預寫日誌
+uint32_t *wal_header_format_version(void *header);
+uint32_t *wal_header_page_size(void *header);
+uint32_t *wal_header_salt(void *header);
+uint32_t *wal_header_checksum(void *header);
+uint32_t *wal_frame_page_num(void *frame_header);
+uint32_t *wal_frame_db_size(void *frame_header);
+uint32_t *wal_frame_salt(void *frame_header);
+uint32_t *wal_frame_checksum(void *frame_header);
+void wal_open(Pager *pager, const char *filename);
+void wal_append_commit(Pager *pager, uint32_t *page_nums, void **pages, uint32_t count,
+                       const uint8_t *row_records, uint32_t row_records_size);
+void wal_append_frames(Pager *pager, uint32_t *page_nums, void **pages, uint32_t count,
+                       const uint8_t *row_records, uint32_t row_records_size, bool commit);
+void wal_log_row_pages(Pager *pager);
+void wal_sync(Wal *wal);
+void wal_confirm_commit(Pager *pager, const char *message);
+uint32_t wal_group_time_left_ms(Wal *wal);
+void wal_close(Pager *pager);
+
+// 寫入時複製
+uint32_t *cow_meta_generation(void *meta);
+uint32_t *cow_meta_page_count(void *meta);
+uint32_t *cow_meta_map_page_count(void *meta);
+uint32_t *cow_meta_map_pages(void *meta);
+void page_map_open(Pager *pager, const char *filename);
+uint32_t page_map_lookup(PageMap *map, uint32_t page_num);
+uint32_t page_map_assign(Pager *pager, uint32_t page_num);
+void page_map_commit(Pager *pager);
+bool page_map_refresh(Pager *pager);
+void page_map_release_snapshot(Pager *pager);
+bool page_map_has_changes(Pager *pager);
+bool page_map_lock_writer(Pager *pager);
+void page_map_unlock_writer(Pager *pager);
+bool page_map_is_stale(Pager *pager);
+void page_map_prepare_write(Pager *pager);
+void page_map_close(Pager *pager);
 
 // 交易管理
 Transaction *transaction_begin(Table *table);
 ExecuteResult transaction_commit(Table *table);
 ExecuteResult transaction_rollback(Table *table);
-void *get_page_for_read(Table *table, uint32_t page_num);
-void *get_page_for_write(Table *table, uint32_t page_num);
+const char *savepoint_name(const char *text);
+ExecuteResult transaction_savepoint(Table *table, const char *name);
+ExecuteResult transaction_rollback_to(Table *table, const char *name);
+ExecuteResult transaction_release(Table *table, const char *name);
+PageHandle table_pin_page(Table *table, uint32_t page_num);
+PageHandle table_pin_page_for_write(Table *table, uint32_t page_num);
+void table_unpin_page(Table *table, PageHandle *handle);
+void transaction_clear(Transaction *txn, Pager *pager);
+void table_row_insert(Table *table, uint32_t page_num, uint32_t cell_num, uint32_t key,
+                      Row *value);
+void table_row_update(Table *table, uint32_t page_num, uint32_t cell_num, Row *value);
+void table_row_delete(Table *table, uint32_t page_num, uint32_t cell_num);
 bool is_in_transaction(Table *table);
+void table_begin_read(Table *table);
+ExecuteResult table_begin_write(Table *table);
+void table_end_statement(Table *table);
 
 // 命令處理
 InputBuffer *new_input_buffer(void);
@@ -478,10 +1051,71 @@ void indent(uint32_t level) {
   }
 }
 
+/**
+ * 解析持久性等級名稱（off / normal / full）
+ *
+ * @param name 等級名稱
+ * @param level 輸出：持久性等級
+ * @return 是否為有效的名稱
+ */
+bool parse_sync_level(const char *name, SyncLevel *level) {
+  if (strcmp(name, "off") == 0) {
+    *level = SYNC_OFF;
+  } else if (strcmp(name, "normal") == 0) {
+    *level = SYNC_NORMAL;
+  } else if (strcmp(name, "full") == 0) {
+    *level = SYNC_FULL;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * 持久性等級的名稱
+ */
+const char *sync_level_name(SyncLevel level) {
+  switch (level) {
+  case SYNC_OFF:
+    return "off";
+  case SYNC_NORMAL:
+    return "normal";
+  case SYNC_FULL:
+    return "full";
+  }
+  return "unknown";
+}
+
+/**
+ * 解析交易記錄方式名稱（page / row）
+ *
+ * @param name 方式名稱
+ * @param mode 輸出：交易記錄方式
+ * @return 是否為有效的名稱
+ */
+bool parse_txn_log_mode(const char *name, TransactionLogMode *mode) {
+  if (strcmp(name, "page") == 0) {
+    *mode = TXN_LOG_PAGE;
+  } else if (strcmp(name, "row") == 0) {
+    *mode = TXN_LOG_ROW;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * 交易記錄方式的名稱
+ */
+const char *txn_log_mode_name(TransactionLogMode mode) {
+  return mode == TXN_LOG_ROW ? "row" : "page";
+}
+
 /**
  * 印出系統常數，用於除錯
  */
 void print_constants(void) {
+  printf("PAGE_SIZE: %u\n", PAGE_SIZE);
   printf("ROW_SIZE: %u\n", ROW_SIZE);
   printf("COMMON_NODE_HEADER_SIZE: %u\n", COMMON_NODE_HEADER_SIZE);
   printf("LEAF_NODE_HEADER_SIZE: %u\n", LEAF_NODE_HEADER_SIZE);
@@ -493,40 +1127,74 @@ void print_constants(void) {
   printf("INTERNAL_NODE_MAX_CELLS: %u\n", INTERNAL_NODE_MAX_CELLS);
 }
 
+/**
+ * 檢查頁面大小是否受支援（MIN_PAGE_SIZE 到 MAX_PAGE_SIZE 之間的 2 的冪次）
+ */
+bool page_size_is_valid(uint32_t page_size) {
+  return page_size >= MIN_PAGE_SIZE && page_size <= MAX_PAGE_SIZE &&
+         (page_size & (page_size - 1)) == 0;
+}
+
+/**
+ * 設定頁面大小，並計算所有取決於頁面大小的節點佈局數值
+ *
+ * 必須在載入任何頁面之前呼叫。
+ *
+ * @param page_size 頁面大小（必須通過 page_size_is_valid）
+ */
+void configure_page_layout(uint32_t page_size) {
+  PAGE_SIZE = page_size;
+  PAGE_CHECKSUM_OFFSET = PAGE_SIZE - PAGE_CHECKSUM_SIZE;
+
+  LEAF_NODE_SPACE_FOR_CELLS = PAGE_CHECKSUM_OFFSET - LEAF_NODE_KEYS_OFFSET;
+  LEAF_NODE_MAX_CELLS = LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE;
+  LEAF_NODE_VALUES_OFFSET = LEAF_NODE_KEYS_OFFSET + LEAF_NODE_MAX_CELLS * LEAF_NODE_KEY_SIZE;
+  LEAF_NODE_RIGHT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) / 2;
+  LEAF_NODE_LEFT_SPLIT_COUNT = (LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT;
+
+  INTERNAL_NODE_SPACE_FOR_CELLS = PAGE_CHECKSUM_OFFSET - INTERNAL_NODE_HEADER_SIZE;
+  INTERNAL_NODE_MAX_CELLS = INTERNAL_NODE_SPACE_FOR_CELLS / INTERNAL_NODE_CELL_SIZE;
+
+  COW_MAP_ENTRIES_PER_PAGE = PAGE_CHECKSUM_OFFSET / sizeof(uint32_t);
+  COW_META_MAX_MAP_PAGES = (PAGE_CHECKSUM_OFFSET - COW_META_MAP_PAGES_OFFSET) / sizeof(uint32_t);
+}
+
 /**
  * 遞迴印出 B-tree 的結構，用於除錯與視覺化
  */
-void print_tree(Pager *pager, uint32_t page_num, uint32_t indentation_level) {
-  void *node = get_page(pager, page_num);
+void print_tree(Table *table, uint32_t page_num, uint32_t indentation_level) {
+  // 遞迴印出子節點時仍需讀取此節點，因此全程釘選
+  PageHandle node = table_pin_page(table, page_num);
   uint32_t num_keys, child;
 
-  switch (get_node_type(node)) {
+  switch (get_node_type(node.data)) {
   case NODE_LEAF:
-    num_keys = *leaf_node_num_cells(node);
+    num_keys = *leaf_node_num_cells(node.data);
     indent(indentation_level);
     printf("- leaf (size %u)\n", num_keys);
     for (uint32_t i = 0; i < num_keys; i++) {
       indent(indentation_level + 1);
-      printf("- %u\n", *leaf_node_key(node, i));
+      printf("- %u\n", *leaf_node_key(node.data, i));
     }
     break;
 
   case NODE_INTERNAL:
-    num_keys = *internal_node_num_keys(node);
+    num_keys = *internal_node_num_keys(node.data);
     indent(indentation_level);
     printf("- internal (size %u)\n", num_keys);
     if (num_keys > 0) {
       for (uint32_t i = 0; i < num_keys; i++) {
-        child = *internal_node_child(node, i);
-        print_tree(pager, child, indentation_level + 1);
+        child = *internal_node_child(node.data, i);
+        print_tree(table, child, indentation_level + 1);
         indent(indentation_level + 1);
-        printf("- key %u\n", *internal_node_key(node, i));
+        printf("- key %u\n", *internal_node_key(node.data, i));
       }
-      child = *internal_node_right_child(node);
-      print_tree(pager, child, indentation_level + 1);
+      child = *internal_node_right_child(node.data);
+      print_tree(table, child, indentation_level + 1);
     }
     break;
   }
+  table_unpin_page(table, &node);
 }
 
 /**
@@ -538,442 +1206,5049 @@ void print_row(Row *row) {
 
 /**
  * 取得下一個未使用的頁面編號
+ *
+ * 優先從空閒頁串列取出頁面（內容會被清空並標記為髒頁）；
+ * 串列為空時返回檔案末端的新頁面編號。
+ * 標頭頁與取出的頁面經由 table_pin_page_for_write 修改，交易中由影子頁面涵蓋。
+ */
+uint32_t get_unused_page_num(Table *table) {
+  Pager *pager = table->pager;
+  PageHandle header = table_pin_page(table, HEADER_PAGE_NUM);
+  uint32_t page_num = *header_freelist_head(header.data);
+  table_unpin_page(table, &header);
+  if (page_num == 0) {
+    if (pager->num_pages >= PAGER_MAX_PAGES) {
+      printf("Error: Database is full (%u pages).\n", pager->num_pages);
+      exit(EXIT_FAILURE);
+    }
+    return pager->num_pages;
+  }
+
+  PageHandle page = table_pin_page_for_write(table, page_num);
+  header = table_pin_page_for_write(table, HEADER_PAGE_NUM);
+  *header_freelist_head(header.data) = *free_page_next(page.data);
+  *header_free_page_count(header.data) -= 1;
+  memset(page.data, 0, PAGE_SIZE);
+  table_unpin_page(table, &header);
+  table_unpin_page(table, &page);
+  return page_num;
+}
+
+/**
+ * 將不再被引用的頁面放回空閒頁串列，之後由 get_unused_page_num 重新使用
+ *
+ * @param table Table 指標
+ * @param page_num 頁面編號
  */
-uint32_t get_unused_page_num(Pager *pager) { return pager->num_pages; }
+void table_free_page(Table *table, uint32_t page_num) {
+  PageHandle page = table_pin_page_for_write(table, page_num);
+  PageHandle header = table_pin_page_for_write(table, HEADER_PAGE_NUM);
+
+  memset(page.data, 0, PAGE_SIZE);
+  *free_page_next(page.data) = *header_freelist_head(header.data);
+  *header_freelist_head(header.data) = page_num;
+  *header_free_page_count(header.data) += 1;
+  table_unpin_page(table, &header);
+  table_unpin_page(table, &page);
+}
 
 /* ============================================================================
- * Pager 管理（檔案 I/O 與頁面快取）
+ * 頁面記憶體池（Page Arena）
  * ============================================================================
  */
 
 /**
- * 開啟資料庫檔案，初始化 Pager
+ * 配置一個新的區塊，切成頁面緩衝區後加入閒置串列
  *
- * @param filename 資料庫檔案路徑
- * @return 初始化完成的 Pager 指標
+ * @param arena PageArena 指標
+ * @param num_pages 區塊的頁面數量
  */
-Pager *pager_open(const char *filename) {
-  int fd = open(filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
-
-  if (fd == -1) {
-    printf("Error: Unable to open database file '%s': %s\n", filename, strerror(errno));
-    exit(EXIT_FAILURE);
+static void page_arena_grow(PageArena *arena, uint32_t num_pages) {
+  if (arena->num_slabs == arena->slab_capacity) {
+    uint32_t new_capacity = arena->slab_capacity ? arena->slab_capacity * 2 : 8;
+    void **slabs = realloc(arena->slabs, new_capacity * sizeof(void *));
+    if (slabs == NULL) {
+      printf("Error: Memory allocation failed for page arena\n");
+      exit(EXIT_FAILURE);
+    }
+    arena->slabs = slabs;
+    arena->slab_capacity = new_capacity;
   }
 
-  off_t file_length = lseek(fd, 0, SEEK_END);
-
-  if (file_length == -1) {
-    printf("Error: Unable to determine file size for '%s': %s\n", filename, strerror(errno));
-    close(fd);
+  void *slab = NULL;
+  if (posix_memalign(&slab, PAGE_ARENA_ALIGNMENT, (size_t)num_pages * arena->page_size) != 0) {
+    printf("Error: Memory allocation failed for %u arena pages\n", num_pages);
     exit(EXIT_FAILURE);
   }
+  arena->slabs[arena->num_slabs++] = slab;
 
-  Pager *pager = malloc(sizeof(Pager));
-  if (pager == NULL) {
-    printf("Error: Memory allocation failed for pager\n");
-    close(fd);
-    exit(EXIT_FAILURE);
+  // 由後往前加入閒置串列，讓位址較低的緩衝區先被使用
+  for (uint32_t i = num_pages; i > 0; i--) {
+    void *page = (char *)slab + (size_t)(i - 1) * arena->page_size;
+    *(void **)page = arena->free_list;
+    arena->free_list = page;
   }
+  arena->num_pages += num_pages;
+}
 
-  pager->file_descriptor = fd;
-  pager->file_length = file_length;
-  pager->num_pages = (file_length / PAGE_SIZE);
+/**
+ * 初始化記憶體池，並預先配置 initial_pages 個緩衝區
+ *
+ * @param arena PageArena 指標
+ * @param page_size 緩衝區大小
+ * @param initial_pages 預先配置的緩衝區數量
+ */
+void page_arena_init(PageArena *arena, uint32_t page_size, uint32_t initial_pages) {
+  arena->slabs = NULL;
+  arena->num_slabs = 0;
+  arena->slab_capacity = 0;
+  arena->free_list = NULL;
+  arena->page_size = page_size;
+  arena->num_pages = 0;
+  arena->num_in_use = 0;
+  page_arena_grow(arena, initial_pages);
+}
 
-  if (file_length % PAGE_SIZE != 0) {
-    printf("Error: Database file '%s' is corrupted (size %lld is not a multiple of page size %u)\n", 
-           filename, (long long)file_length, PAGE_SIZE);
-    free(pager);
-    close(fd);
-    exit(EXIT_FAILURE);
-  }
+/**
+ * 取得一個頁面緩衝區（內容未初始化）
+ *
+ * @param arena PageArena 指標
+ * @return 以 PAGE_ARENA_ALIGNMENT 對齊的緩衝區
+ */
+void *page_arena_alloc(PageArena *arena) {
+  if (arena->free_list == NULL) {
+    page_arena_grow(arena, PAGE_ARENA_GROW_PAGES);
+  }
+  void *page = arena->free_list;
+  arena->free_list = *(void **)page;
+  arena->num_in_use++;
+  return page;
+}
 
-  for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    pager->pages[i] = NULL;
-  }
+/**
+ * 將頁面緩衝區放回閒置串列
+ *
+ * @param arena PageArena 指標
+ * @param page 由 page_arena_alloc 取得的緩衝區
+ */
+void page_arena_free(PageArena *arena, void *page) {
+  *(void **)page = arena->free_list;
+  arena->free_list = page;
+  arena->num_in_use--;
+}
 
-  return pager;
+/**
+ * 釋放記憶體池的所有區塊
+ *
+ * @param arena PageArena 指標
+ */
+void page_arena_destroy(PageArena *arena) {
+  for (uint32_t i = 0; i < arena->num_slabs; i++) {
+    free(arena->slabs[i]);
+  }
+  free(arena->slabs);
+  arena->slabs = NULL;
+  arena->num_slabs = 0;
+  arena->free_list = NULL;
 }
 
+/* ============================================================================
+ * 頁面校驗碼（CRC32C）
+ * ============================================================================
+ */
+
+static uint32_t crc32c_table[256];
+
 /**
- * 取得指定頁面的記憶體位址，若未載入則從檔案讀取
+ * 可攜版 CRC32C：逐位元組查表
  *
- * @param pager Pager 指標
- * @param page_num 頁面編號
- * @return 頁面的記憶體位址
+ * @param crc 目前的 CRC 值（未取補數）
+ * @param data 資料
+ * @param length 資料長度
+ * @return 更新後的 CRC 值
  */
-void *get_page(Pager *pager, uint32_t page_num) {
-  if (page_num > TABLE_MAX_PAGES) {
-    printf("Error: Page number %u exceeds maximum allowed pages (%d)\n", 
-           page_num, TABLE_MAX_PAGES);
-    exit(EXIT_FAILURE);
+static uint32_t crc32c_update_portable(uint32_t crc, const void *data, size_t length) {
+  const uint8_t *bytes = data;
+  for (size_t i = 0; i < length; i++) {
+    crc = crc32c_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
   }
+  return crc;
+}
 
-  if (pager->pages[page_num] == NULL) {
-    // Cache miss：配置記憶體並從檔案載入
-    void *page = malloc(PAGE_SIZE);
-    if (page == NULL) {
-      printf("Error: Memory allocation failed for page %u\n", page_num);
-      exit(EXIT_FAILURE);
-    }
+#if defined(CRC32C_HAVE_SSE42)
+/**
+ * SSE4.2 版 CRC32C：每次處理 8 bytes，剩餘位元組逐一處理
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_update_sse42(uint32_t crc, const void *data, size_t length) {
+  const uint8_t *bytes = data;
+  uint64_t crc64 = crc;
+  while (length >= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+    bytes += sizeof(word);
+    length -= sizeof(word);
+  }
+  crc = (uint32_t)crc64;
+  while (length > 0) {
+    crc = _mm_crc32_u8(crc, *bytes++);
+    length--;
+  }
+  return crc;
+}
+#elif defined(CRC32C_HAVE_ARMV8)
+/**
+ * ARMv8 CRC 擴充版 CRC32C：每次處理 8 bytes，剩餘位元組逐一處理
+ */
+static uint32_t crc32c_update_armv8(uint32_t crc, const void *data, size_t length) {
+  const uint8_t *bytes = data;
+  while (length >= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    crc = __crc32cd(crc, word);
+    bytes += sizeof(word);
+    length -= sizeof(word);
+  }
+  while (length > 0) {
+    crc = __crc32cb(crc, *bytes++);
+    length--;
+  }
+  return crc;
+}
+#endif
 
-    uint32_t num_pages = pager->file_length / PAGE_SIZE;
+static uint32_t (*crc32c_update)(uint32_t crc, const void *data, size_t length) =
+    crc32c_update_portable;
 
-    // 檔案末端可能有部分頁面
-    if (pager->file_length % PAGE_SIZE) {
-      num_pages += 1;
+/**
+ * 建立查表並選擇 CRC32C 實作（CPU 支援時使用硬體指令）
+ */
+void crc32c_init(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLYNOMIAL : crc >> 1;
     }
+    crc32c_table[i] = crc;
+  }
 
-    if (page_num <= num_pages) {
-      off_t offset = lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
-      if (offset == -1) {
-        printf("Error: Failed to seek to page %u: %s\n", page_num, strerror(errno));
-        free(page);
-        exit(EXIT_FAILURE);
-      }
+#if defined(CRC32C_HAVE_SSE42)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) {
+    crc32c_update = crc32c_update_sse42;
+  }
+#elif defined(CRC32C_HAVE_ARMV8)
+  crc32c_update = crc32c_update_armv8;
+#endif
+}
 
-      ssize_t bytes_read = read(pager->file_descriptor, page, PAGE_SIZE);
-      if (bytes_read == -1) {
-        printf("Error: Failed to read page %u from file: %s\n", page_num, strerror(errno));
-        free(page);
-        exit(EXIT_FAILURE);
-      }
-    }
+/**
+ * 計算頁面的校驗碼
+ *
+ * 頁面編號也納入計算，因此寫到錯誤位置的頁面同樣會被偵測出來。
+ *
+ * @param page_num 頁面編號
+ * @param page 頁面內容
+ * @return 校驗碼
+ */
+static uint32_t page_checksum(uint32_t page_num, const void *page) {
+  uint32_t crc = crc32c_update(0xFFFFFFFFu, &page_num, sizeof(page_num));
+  crc = crc32c_update(crc, page, PAGE_CHECKSUM_OFFSET);
+  return ~crc;
+}
 
-    pager->pages[page_num] = page;
+/**
+ * 寫回檔案前更新頁面尾端的校驗碼
+ */
+static inline void page_set_checksum(uint32_t page_num, void *page) {
+  *page_checksum_field(page) = page_checksum(page_num, page);
+}
 
-    if (page_num >= pager->num_pages) {
-      pager->num_pages = page_num + 1;
+/**
+ * 檢查頁面是否全為 0
+ */
+static bool page_is_zeroed(const void *page) {
+  const uint8_t *bytes = page;
+  for (uint32_t i = 0; i < PAGE_SIZE; i++) {
+    if (bytes[i] != 0) {
+      return false;
     }
   }
-
-  return pager->pages[page_num];
+  return true;
 }
 
 /**
- * 將指定頁面寫回檔案
+ * 驗證從檔案載入的頁面，校驗碼不符時終止程式
+ *
+ * 標頭頁記錄的頁面總數之後、全為 0 的頁面視為從未寫入（檔案被延長但頁面
+ * 尚未寫回時當機），不檢查校驗碼；樹中的頁面全為 0 則視為損毀。
  *
  * @param pager Pager 指標
  * @param page_num 頁面編號
+ * @param page 頁面內容
  */
-void pager_flush(Pager *pager, uint32_t page_num) {
-  if (pager->pages[page_num] == NULL) {
-    printf("Error: Attempted to flush null page %u\n", page_num);
-    exit(EXIT_FAILURE);
+static void pager_verify_checksum(Pager *pager, uint32_t page_num, const void *page) {
+  if (!pager->verify_checksums) {
+    return;
   }
-
-  off_t offset = lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
-  if (offset == -1) {
-    printf("Error: Failed to seek to page %u for writing: %s\n", page_num, strerror(errno));
-    exit(EXIT_FAILURE);
+  uint32_t stored = *page_checksum_field((void *)page);
+  uint32_t computed = page_checksum(page_num, page);
+  if (stored == computed ||
+      (stored == 0 && page_num >= pager->recorded_pages && page_is_zeroed(page))) {
+    return;
   }
+  printf("Error: Page %u is corrupted (stored checksum %08x, computed %08x)\n",
+         page_num, stored, computed);
+  exit(EXIT_FAILURE);
+}
 
-  ssize_t bytes_written =
-      write(pager->file_descriptor, pager->pages[page_num], PAGE_SIZE);
-  if (bytes_written == -1) {
-    printf("Error: Failed to write page %u to file: %s\n", page_num, strerror(errno));
-    exit(EXIT_FAILURE);
-  }
+/* ============================================================================
+ * 節點內的鍵搜尋（向量化比較）
+ * ============================================================================
+ */
 
-  if (bytes_written != PAGE_SIZE) {
-    printf("Error: Incomplete write for page %u (wrote %zd bytes, expected %u)\n", 
-           page_num, bytes_written, PAGE_SIZE);
-    exit(EXIT_FAILURE);
+/**
+ * 可攜版：逐一比較，計算內部節點從 first 開始的 count 個鍵中小於 key 的數量
+ *
+ * @param node 內部節點指標
+ * @param first 第一個鍵的索引
+ * @param count 鍵的數量
+ * @param key 要比較的鍵
+ * @return 小於 key 的鍵數
+ */
+static uint32_t internal_node_count_below_portable(void *node, uint32_t first, uint32_t count,
+                                                   uint32_t key) {
+  uint32_t below = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    below += *internal_node_key(node, first + i) < key;
   }
+  return below;
 }
 
+#if defined(NODE_SEARCH_HAVE_SSE2)
 /**
- * 開啟資料庫，初始化 Table 結構
+ * SSE2 版：每次比較 4 個鍵，剩餘的鍵逐一比較
  *
- * @param filename 資料庫檔案路徑
- * @return 初始化完成的 Table 指標
+ * 鍵與子節點交錯存放，兩次載入 4 個 cell 後取出奇數位置的鍵。SSE2 只有有號比較，
+ * 兩邊都翻轉符號位元後再比較。
  */
-Table *db_open(const char *filename) {
-  Pager *pager = pager_open(filename);
+static uint32_t internal_node_count_below_sse2(void *node, uint32_t first, uint32_t count,
+                                               uint32_t key) {
+  const __m128i bias = _mm_set1_epi32(INT32_MIN);
+  const __m128i target = _mm_xor_si128(_mm_set1_epi32((int32_t)key), bias);
+  uint32_t below = 0;
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const float *cells = internal_node_cell(node, first + i);
+    __m128 low = _mm_loadu_ps(cells);
+    __m128 high = _mm_loadu_ps(cells + 4);
+    __m128i keys = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+    __m128i less = _mm_cmplt_epi32(_mm_xor_si128(keys, bias), target);
+    below += (uint32_t)__builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(less)));
+  }
+  return below + internal_node_count_below_portable(node, first + i, count - i, key);
+}
 
-  Table *table = malloc(sizeof(Table));
-  if (table == NULL) {
-    printf("Error: Memory allocation failed for table\n");
-    // 清理 pager 資源
-    close(pager->file_descriptor);
-    free(pager);
-    exit(EXIT_FAILURE);
+/**
+ * AVX2 版：每次比較 8 個鍵（鍵在向量中的順序不影響計數），剩餘的鍵交給 SSE2 版
+ */
+__attribute__((target("avx2")))
+static uint32_t internal_node_count_below_avx2(void *node, uint32_t first, uint32_t count,
+                                               uint32_t key) {
+  const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+  const __m256i target = _mm256_xor_si256(_mm256_set1_epi32((int32_t)key), bias);
+  uint32_t below = 0;
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const float *cells = internal_node_cell(node, first + i);
+    __m256 low = _mm256_loadu_ps(cells);
+    __m256 high = _mm256_loadu_ps(cells + 8);
+    __m256i keys = _mm256_castps_si256(_mm256_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+    __m256i less = _mm256_cmpgt_epi32(target, _mm256_xor_si256(keys, bias));
+    below += (uint32_t)__builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+  }
+  return below + internal_node_count_below_sse2(node, first + i, count - i, key);
+}
+#elif defined(NODE_SEARCH_HAVE_NEON)
+/**
+ * NEON 版：每次以交錯載入取出 4 個鍵比較，剩餘的鍵逐一比較
+ */
+static uint32_t internal_node_count_below_neon(void *node, uint32_t first, uint32_t count,
+                                               uint32_t key) {
+  const uint32x4_t target = vdupq_n_u32(key);
+  uint32x4_t below = vdupq_n_u32(0);
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    uint32x4x2_t cells = vld2q_u32(internal_node_cell(node, first + i));
+    // 比較結果為全 1（-1），相減即累加
+    below = vsubq_u32(below, vcltq_u32(cells.val[1], target));
+  }
+  return vaddvq_u32(below) + internal_node_count_below_portable(node, first + i, count - i, key);
+}
+#endif
+
+static uint32_t (*internal_node_count_below)(void *node, uint32_t first, uint32_t count,
+                                             uint32_t key) = internal_node_count_below_portable;
+
+/**
+ * 可攜版：計算連續鍵陣列（葉節點的 key 陣列）中小於 key 的數量
+ *
+ * @param keys 鍵陣列
+ * @param count 鍵的數量
+ * @param key 要比較的鍵
+ * @return 小於 key 的鍵數
+ */
+static uint32_t key_array_count_below_portable(const uint32_t *keys, uint32_t count,
+                                               uint32_t key) {
+  uint32_t below = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    below += keys[i] < key;
   }
+  return below;
+}
 
-  table->pager = pager;
-  table->root_page_num = 0;
+#if defined(NODE_SEARCH_HAVE_SSE2)
+/**
+ * SSE2 版：鍵連續存放，每次直接載入 4 個鍵比較
+ */
+static uint32_t key_array_count_below_sse2(const uint32_t *keys, uint32_t count, uint32_t key) {
+  const __m128i bias = _mm_set1_epi32(INT32_MIN);
+  const __m128i target = _mm_xor_si128(_mm_set1_epi32((int32_t)key), bias);
+  uint32_t below = 0;
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(keys + i));
+    __m128i less = _mm_cmplt_epi32(_mm_xor_si128(chunk, bias), target);
+    below += (uint32_t)__builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(less)));
+  }
+  return below + key_array_count_below_portable(keys + i, count - i, key);
+}
+
+/**
+ * AVX2 版：每次載入 8 個鍵比較，剩餘的鍵交給 SSE2 版
+ */
+__attribute__((target("avx2")))
+static uint32_t key_array_count_below_avx2(const uint32_t *keys, uint32_t count, uint32_t key) {
+  const __m256i bias = _mm256_set1_epi32(INT32_MIN);
+  const __m256i target = _mm256_xor_si256(_mm256_set1_epi32((int32_t)key), bias);
+  uint32_t below = 0;
+  uint32_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(keys + i));
+    __m256i less = _mm256_cmpgt_epi32(target, _mm256_xor_si256(chunk, bias));
+    below += (uint32_t)__builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(less)));
+  }
+  return below + key_array_count_below_sse2(keys + i, count - i, key);
+}
+#elif defined(NODE_SEARCH_HAVE_NEON)
+/**
+ * NEON 版：每次載入 4 個鍵比較
+ */
+static uint32_t key_array_count_below_neon(const uint32_t *keys, uint32_t count, uint32_t key) {
+  const uint32x4_t target = vdupq_n_u32(key);
+  uint32x4_t below = vdupq_n_u32(0);
+  uint32_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    below = vsubq_u32(below, vcltq_u32(vld1q_u32(keys + i), target));
+  }
+  return vaddvq_u32(below) + key_array_count_below_portable(keys + i, count - i, key);
+}
+#endif
+
+static uint32_t (*key_array_count_below)(const uint32_t *keys, uint32_t count,
+                                         uint32_t key) = key_array_count_below_portable;
+
+/**
+ * 選擇節點內鍵比較的實作（CPU 支援時使用向量指令）
+ */
+void node_search_init(void) {
+#if defined(NODE_SEARCH_HAVE_SSE2)
+  __builtin_cpu_init();
+  bool have_avx2 = __builtin_cpu_supports("avx2");
+  internal_node_count_below =
+      have_avx2 ? internal_node_count_below_avx2 : internal_node_count_below_sse2;
+  key_array_count_below = have_avx2 ? key_array_count_below_avx2 : key_array_count_below_sse2;
+#elif defined(NODE_SEARCH_HAVE_NEON)
+  internal_node_count_below = internal_node_count_below_neon;
+  key_array_count_below = key_array_count_below_neon;
+#endif
+}
+
+/* ============================================================================
+ * Pager 管理（檔案 I/O 與頁面快取）
+ * ============================================================================
+ */
+
+/**
+ * 計算頁面編號的雜湊桶索引
+ */
+static inline uint32_t pager_hash(Pager *pager, uint32_t page_num) {
+  return (page_num * 2654435761u) & pager->page_table_mask;
+}
+
+/**
+ * 重新建立頁面雜湊表，桶數量為不小於頁框容量兩倍的 2 的冪次
+ *
+ * @param pager Pager 指標
+ */
+static void pager_rebuild_page_table(Pager *pager) {
+  uint32_t num_buckets = 16;
+  while (num_buckets < pager->frame_capacity * 2) {
+    num_buckets *= 2;
+  }
+
+  uint32_t *page_table = malloc(num_buckets * sizeof(uint32_t));
+  if (page_table == NULL) {
+    printf("Error: Memory allocation failed for page table\n");
+    exit(EXIT_FAILURE);
+  }
+  for (uint32_t i = 0; i < num_buckets; i++) {
+    page_table[i] = INVALID_FRAME_INDEX;
+  }
+
+  free(pager->page_table);
+  pager->page_table = page_table;
+  pager->page_table_mask = num_buckets - 1;
+
+  for (uint32_t i = 0; i < pager->frame_capacity; i++) {
+    Frame *frame = &pager->frames[i];
+    if (frame->data == NULL) {
+      continue;
+    }
+    uint32_t bucket = pager_hash(pager, frame->page_num);
+    frame->hash_next = pager->page_table[bucket];
+    pager->page_table[bucket] = i;
+  }
+}
+
+/**
+ * 擴充頁框陣列，新的頁框加入閒置串列
+ *
+ * @param pager Pager 指標
+ * @param new_capacity 新的容量
+ */
+static void pager_grow_frames(Pager *pager, uint32_t new_capacity) {
+  Frame *frames = realloc(pager->frames, new_capacity * sizeof(Frame));
+  if (frames == NULL) {
+    printf("Error: Memory allocation failed for buffer pool frames\n");
+    exit(EXIT_FAILURE);
+  }
+  pager->frames = frames;
+
+  // 由後往前加入閒置串列，讓低索引的頁框先被使用
+  for (uint32_t i = new_capacity; i > pager->frame_capacity; i--) {
+    Frame *frame = &pager->frames[i - 1];
+    frame->data = NULL;
+    frame->page_num = INVALID_PAGE_NUM;
+    frame->pin_count = 0;
+    frame->referenced = false;
+    frame->dirty = false;
+    frame->row_logged = false;
+    frame->hash_next = pager->free_frame_head;
+    pager->free_frame_head = i - 1;
+  }
+  pager->frame_capacity = new_capacity;
+
+  pager_rebuild_page_table(pager);
+}
+
+/**
+ * 在緩衝池中查找頁面
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ * @return 頁框索引，未載入時返回 INVALID_FRAME_INDEX
+ */
+static uint32_t pager_lookup(Pager *pager, uint32_t page_num) {
+  uint32_t index = pager->page_table[pager_hash(pager, page_num)];
+  while (index != INVALID_FRAME_INDEX) {
+    if (pager->frames[index].page_num == page_num) {
+      return index;
+    }
+    index = pager->frames[index].hash_next;
+  }
+  return INVALID_FRAME_INDEX;
+}
+
+/**
+ * 將頁框從雜湊表移除並放回閒置串列，同時釋放其記憶體
+ *
+ * @param pager Pager 指標
+ * @param frame_index 頁框索引
+ */
+static void pager_release_frame(Pager *pager, uint32_t frame_index) {
+  Frame *frame = &pager->frames[frame_index];
+  uint32_t *link = &pager->page_table[pager_hash(pager, frame->page_num)];
+  while (*link != frame_index) {
+    link = &pager->frames[*link].hash_next;
+  }
+  *link = frame->hash_next;
+
+  if (frame->dirty) {
+    pager->num_dirty--;
+  }
+  page_arena_free(&pager->arena, frame->data);
+  frame->data = NULL;
+  frame->page_num = INVALID_PAGE_NUM;
+  frame->pin_count = 0;
+  frame->referenced = false;
+  frame->dirty = false;
+  frame->row_logged = false;
+  frame->hash_next = pager->free_frame_head;
+  pager->free_frame_head = frame_index;
+  pager->num_resident--;
+}
+
+/**
+ * 以 mmap 映射檔案中既有的頁面
+ *
+ * 使用 MAP_PRIVATE：未修改的頁面直接共用作業系統的頁面快取，
+ * B-tree 就地修改時由核心複製出私有頁面，不會直接寫入檔案；
+ * 髒頁仍經由 pwrite 寫回。開啟後才新增的頁面則由緩衝池管理。
+ * 映射失敗時退回一般的緩衝池讀取路徑。
+ *
+ * @param pager Pager 指標
+ */
+static void pager_map_file(Pager *pager) {
+  if ((uint64_t)pager->num_pages * PAGE_SIZE > SIZE_MAX) {
+    printf("Warning: Database is too large to map, falling back to buffered reads\n");
+    return;
+  }
+  size_t length = (size_t)pager->num_pages * PAGE_SIZE;
+  void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                    pager->file_descriptor, 0);
+  if (base == MAP_FAILED) {
+    printf("Warning: mmap failed (%s), falling back to buffered reads\n",
+           strerror(errno));
+    return;
+  }
+
+  pager->mmap_dirty = calloc(pager->num_pages, sizeof(bool));
+  pager->mmap_verified = calloc(pager->num_pages, sizeof(bool));
+  if (pager->mmap_dirty == NULL || pager->mmap_verified == NULL) {
+    printf("Error: Memory allocation failed for mmap dirty map\n");
+    exit(EXIT_FAILURE);
+  }
+  pager->mmap_base = base;
+  pager->mmap_pages = pager->num_pages;
+}
+
+/**
+ * 解除檔案映射（呼叫前必須先寫回映射中的髒頁）
+ *
+ * @param pager Pager 指標
+ */
+static void pager_unmap_file(Pager *pager) {
+  if (pager->mmap_base == NULL) {
+    return;
+  }
+  munmap(pager->mmap_base, (size_t)pager->mmap_pages * PAGE_SIZE);
+  free(pager->mmap_dirty);
+  free(pager->mmap_verified);
+  pager->mmap_base = NULL;
+  pager->mmap_dirty = NULL;
+  pager->mmap_verified = NULL;
+  pager->mmap_pages = 0;
+}
+
+/**
+ * 為檔案描述符開啟直接 I/O，讀寫不經過作業系統的頁面快取
+ *
+ * Linux 以 fcntl 設定 O_DIRECT，macOS 則設定 F_NOCACHE。
+ * 檔案系統不支援時返回 false，由呼叫端繼續使用一般的緩衝 I/O。
+ *
+ * @param fd 檔案描述符
+ * @return 是否成功開啟
+ */
+static bool pager_enable_direct_io(int fd) {
+#if defined(O_DIRECT)
+  int flags = fcntl(fd, F_GETFL);
+  return flags != -1 && fcntl(fd, F_SETFL, flags | O_DIRECT) != -1;
+#elif defined(F_NOCACHE)
+  return fcntl(fd, F_NOCACHE, 1) != -1;
+#else
+  (void)fd;
+  errno = ENOTSUP;
+  return false;
+#endif
+}
+
+/**
+ * 直接 I/O 的讀寫被拒絕（EINVAL）時改回緩衝 I/O，讓呼叫端重試
+ *
+ * 頁面緩衝區、位移與長度都以頁面大小對齊，因此只有在檔案系統於
+ * 讀寫時才拒絕直接 I/O 的情況下會走到這裡。
+ *
+ * @param pager Pager 指標
+ * @return 是否已改回緩衝 I/O（原本就未使用直接 I/O 或錯誤與對齊無關時返回 false）
+ */
+static bool pager_disable_direct_io(Pager *pager) {
+  if (!pager->direct_io || errno != EINVAL) {
+    return false;
+  }
+#if defined(O_DIRECT)
+  int flags = fcntl(pager->file_descriptor, F_GETFL);
+  if (flags == -1 || fcntl(pager->file_descriptor, F_SETFL, flags & ~O_DIRECT) == -1) {
+    return false;
+  }
+#elif defined(F_NOCACHE)
+  fcntl(pager->file_descriptor, F_NOCACHE, 0);
+#endif
+  printf("Warning: Direct I/O rejected by the file system, falling back to buffered I/O\n");
+  pager->direct_io = false;
+  return true;
+}
+
+/**
+ * 計算頁面在檔案中的位移（以 64 位元運算，避免超過 4 GiB 時溢位）
+ */
+static inline off_t pager_page_offset(uint32_t page_num) {
+  return (off_t)page_num * PAGE_SIZE;
+}
+
+/**
+ * 取得頁面目前在檔案中的實體位置（寫入時複製模式經由頁面對應表換算）
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ * @return 實體頁面編號，頁面尚未寫入檔案時返回 INVALID_PAGE_NUM
+ */
+static uint32_t pager_read_slot(Pager *pager, uint32_t page_num) {
+  if (pager->page_map.enabled) {
+    return page_map_lookup(&pager->page_map, page_num);
+  }
+  // 檔案末端可能有部分頁面
+  uint32_t num_pages = (uint32_t)((pager->file_length + PAGE_SIZE - 1) / PAGE_SIZE);
+  return page_num < num_pages ? page_num : INVALID_PAGE_NUM;
+}
+
+/**
+ * 取得寫出頁面的實體位置
+ *
+ * 一般模式就地覆寫；寫入時複製模式中已提交的頁面改寫到新配置的位置。
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ * @return 實體頁面編號
+ */
+static uint32_t pager_write_slot(Pager *pager, uint32_t page_num) {
+  if (pager->page_map.enabled) {
+    return page_map_assign(pager, page_num);
+  }
+  return page_num;
+}
+
+/**
+ * 檢查頁面是否位於檔案映射之中
+ */
+static inline bool pager_is_mapped(Pager *pager, uint32_t page_num) {
+  return page_num < pager->mmap_pages;
+}
+
+/**
+ * 取得映射頁面的位址
+ */
+static inline void *pager_mapped_page(Pager *pager, uint32_t page_num) {
+  return (char *)pager->mmap_base + (size_t)page_num * PAGE_SIZE;
+}
+
+/**
+ * 取得映射頁面的位址，第一次存取時驗證校驗碼
+ */
+static void *pager_verified_mapped_page(Pager *pager, uint32_t page_num) {
+  void *page = pager_mapped_page(pager, page_num);
+  if (!pager->mmap_verified[page_num]) {
+    pager_verify_checksum(pager, page_num, page);
+    pager->mmap_verified[page_num] = true;
+  }
+  return page;
+}
+
+/**
+ * 決定資料庫使用的頁面大小
+ *
+ * 新檔案使用命令列指定的大小；既有檔案讀取標頭頁（或寫入時複製資料庫的
+ * meta 頁）開頭的欄位，沒有標頭頁的舊版檔案則一律為 DEFAULT_PAGE_SIZE。
+ * 只有新檔案與第 2 版以後的檔案在載入時驗證頁面校驗碼。
+ *
+ * @param fd 檔案描述符
+ * @param file_length 檔案長度
+ * @param filename 資料庫檔案路徑（用於錯誤訊息）
+ * @param options 開啟選項
+ * @param has_checksums 輸出：檔案中的頁面是否帶有校驗碼
+ * @param interleaved_leaves 輸出：葉節點是否為 key 與 value 交錯的舊版佈局
+ * @param recorded_pages 輸出：標頭頁記錄的頁面總數（寫入時複製資料庫為 UINT32_MAX：
+ *                       對應表中的頁面一定已寫入）
+ * @param is_cow 輸出：是否為寫入時複製資料庫
+ * @return 頁面大小
+ */
+static uint32_t pager_detect_page_size(int fd, off_t file_length, const char *filename,
+                                       const OpenOptions *options, bool *has_checksums,
+                                       bool *interleaved_leaves, uint32_t *recorded_pages,
+                                       bool *is_cow) {
+  *has_checksums = false;
+  *interleaved_leaves = true;
+  *recorded_pages = 0;
+  *is_cow = false;
+  if (file_length == 0) {
+    *has_checksums = true;
+    *interleaved_leaves = false;
+    *is_cow = options->use_cow;
+    return options->page_size ? options->page_size : DEFAULT_PAGE_SIZE;
+  }
+
+  uint8_t prefix[HEADER_PAGE_COUNT_OFFSET + HEADER_PAGE_COUNT_SIZE];
+  ssize_t bytes_read = pread(fd, prefix, sizeof(prefix), 0);
+  if (bytes_read == -1) {
+    printf("Error: Failed to read header of '%s': %s\n", filename, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  *is_cow = bytes_read == (ssize_t)sizeof(prefix) &&
+            memcmp(prefix + HEADER_MAGIC_OFFSET, COW_META_MAGIC, HEADER_MAGIC_SIZE) == 0;
+  if (options->use_cow && !*is_cow) {
+    printf("Note: '%s' is not a copy-on-write database; --cow ignored.\n", filename);
+  }
+  if (!*is_cow &&
+      (bytes_read < (ssize_t)sizeof(prefix) || !header_is_valid(prefix))) {
+    return DEFAULT_PAGE_SIZE;
+  }
+
+  uint32_t format_version = *header_format_version(prefix);
+  *has_checksums = (format_version == DB_FORMAT_VERSION ||
+                    format_version == DB_FORMAT_VERSION_INTERLEAVED_LEAVES);
+  *interleaved_leaves = (format_version != DB_FORMAT_VERSION);
+  *recorded_pages = *is_cow ? UINT32_MAX : *header_page_count(prefix);
+  if (*is_cow && !*has_checksums) {
+    printf("Error: Database file '%s' has unsupported format version %u "
+           "(expected %u)\n", filename, *header_format_version(prefix), DB_FORMAT_VERSION);
+    exit(EXIT_FAILURE);
+  }
+  uint32_t page_size = *header_page_size(prefix);
+  if (!page_size_is_valid(page_size)) {
+    printf("Error: Database file '%s' has unsupported page size %u\n", filename, page_size);
+    exit(EXIT_FAILURE);
+  }
+  if (options->page_size != 0 && options->page_size != page_size) {
+    printf("Note: '%s' was created with page size %u; --page-size ignored.\n",
+           filename, page_size);
+  }
+  return page_size;
+}
+
+/**
+ * 開啟資料庫檔案，初始化 Pager
+ *
+ * @param filename 資料庫檔案路徑
+ * @param options 開啟選項
+ * @return 初始化完成的 Pager 指標
+ */
+Pager *pager_open(const char *filename, const OpenOptions *options) {
+  int fd = open(filename, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+
+  if (fd == -1) {
+    printf("Error: Unable to open database file '%s': %s\n", filename, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  off_t file_length = lseek(fd, 0, SEEK_END);
+
+  if (file_length == -1) {
+    printf("Error: Unable to determine file size for '%s': %s\n", filename, strerror(errno));
+    close(fd);
+    exit(EXIT_FAILURE);
+  }
+
+  Pager *pager = malloc(sizeof(Pager));
+  if (pager == NULL) {
+    printf("Error: Memory allocation failed for pager\n");
+    close(fd);
+    exit(EXIT_FAILURE);
+  }
+
+  bool has_checksums;
+  bool interleaved_leaves;
+  uint32_t recorded_pages;
+  bool is_cow;
+  configure_page_layout(pager_detect_page_size(fd, file_length, filename, options,
+                                               &has_checksums, &interleaved_leaves,
+                                               &recorded_pages, &is_cow));
+  crc32c_init();
+  node_search_init();
+
+  if (file_length / PAGE_SIZE > PAGER_MAX_PAGES) {
+    printf("Error: Database file '%s' is too large (%lld bytes)\n",
+           filename, (long long)file_length);
+    free(pager);
+    close(fd);
+    exit(EXIT_FAILURE);
+  }
+
+  pager->file_descriptor = fd;
+  pager->file_length = file_length;
+  pager->num_pages = (uint32_t)(file_length / PAGE_SIZE);
+
+  if (file_length % PAGE_SIZE != 0) {
+    printf("Error: Database file '%s' is corrupted (size %lld is not a multiple of page size %u)\n", 
+           filename, (long long)file_length, PAGE_SIZE);
+    free(pager);
+    close(fd);
+    exit(EXIT_FAILURE);
+  }
+
+  pager->frames = NULL;
+  pager->frame_capacity = 0;
+  pager->num_resident = 0;
+  pager->num_dirty = 0;
+  pager->num_pinned = 0;
+  pager->free_frame_head = INVALID_FRAME_INDEX;
+  pager->page_table = NULL;
+  pager->clock_hand = 0;
+  pager->cache_hits = 0;
+  pager->cache_misses = 0;
+  pager->evictions = 0;
+  pager->page_writes = 0;
+  pager->write_calls = 0;
+  pager->mmap_base = NULL;
+  pager->mmap_pages = 0;
+  pager->mmap_dirty = NULL;
+  pager->mmap_verified = NULL;
+  pager->verify_checksums = has_checksums;
+  pager->interleaved_leaves = interleaved_leaves;
+  pager->recorded_pages = recorded_pages;
+  pager->max_frames = PAGER_DEFAULT_CACHE_PAGES;
+  pager_set_cache_size(pager, options->cache_pages);
+  pager_grow_frames(pager, pager->max_frames);
+  page_arena_init(&pager->arena, PAGE_SIZE, pager->max_frames);
+
+  pager->readahead = options->readahead;
+  pager->readahead_parent = INVALID_PAGE_NUM;
+  pager->readahead_end = 0;
+  pager->readahead_pages = 0;
+
+  // 重做日誌中已提交的交易（在映射檔案之前，映射才會涵蓋重做後的頁面）；
+  // 寫入時複製資料庫改為載入最後提交的頁面對應表
+  pager->needs_sync = false;
+  pager->sync_level = options->sync_level;
+  if (is_cow && !options->sync_level_given) {
+    // 其他等級的寫入者在語句之間持有寫入鎖直到檢查點，預設每個語句都提交
+    pager->sync_level = SYNC_FULL;
+  }
+  pager->page_map.enabled = is_cow;
+  if (is_cow) {
+    page_map_open(pager, filename);
+  }
+  pager->wal.group_commits = options->group_commits;
+  pager->wal.group_delay_ms = options->group_delay_ms;
+  wal_open(pager, filename);
+
+  pager->direct_io = false;
+  if (options->use_direct) {
+    // 頁面大小在此之前已由未對齊的讀取決定，因此最後才開啟直接 I/O
+    if (pager_enable_direct_io(fd)) {
+      pager->direct_io = true;
+    } else {
+      printf("Warning: Direct I/O unavailable (%s), falling back to buffered I/O\n",
+             strerror(errno));
+    }
+  }
+
+  if (options->use_mmap && is_cow) {
+    // 映射的頁面會被就地修改，與寫入時複製不相容
+    printf("Note: '%s' is a copy-on-write database; --mmap ignored.\n", filename);
+  } else if (options->use_mmap && pager->num_pages > 0) {
+    pager_map_file(pager);
+  }
+
+  return pager;
+}
+
+
+/**
+ * 設定緩衝池的頁框預算，超出的頁面會在下一個安全點被置換
+ *
+ * @param pager Pager 指標
+ * @param max_frames 頁框預算（0 表示使用預設值）
+ */
+void pager_set_cache_size(Pager *pager, uint32_t max_frames) {
+  if (max_frames == 0) {
+    max_frames = PAGER_DEFAULT_CACHE_PAGES;
+  }
+  if (max_frames < PAGER_MIN_CACHE_PAGES) {
+    max_frames = PAGER_MIN_CACHE_PAGES;
+  }
+  pager->max_frames = max_frames;
+}
+
+/**
+ * 以 CLOCK 演算法置換一個未被釘選的頁框
+ *
+ * 參考位元被設定的頁框會得到第二次機會；被置換的髒頁會先寫回檔案，
+ * 乾淨的頁面直接丟棄。每個頁框最多被檢查兩次，因此一定會結束。
+ *
+ * @param pager Pager 指標
+ * @return 是否置換了頁框（所有頁框都被釘選時返回 false）
+ */
+static bool pager_evict_one(Pager *pager) {
+  for (uint32_t scanned = 0; scanned < pager->frame_capacity * 2; scanned++) {
+    uint32_t frame_index = pager->clock_hand;
+    Frame *frame = &pager->frames[frame_index];
+    pager->clock_hand = (pager->clock_hand + 1) % pager->frame_capacity;
+
+    // 日誌中只有列變更記錄的頁面要等檢查點整頁記錄後才能寫回
+    if (frame->data == NULL || frame->pin_count > 0 || frame->row_logged) {
+      continue;
+    }
+    if (frame->referenced) {
+      // 給予第二次機會
+      frame->referenced = false;
+      continue;
+    }
+
+    pager_flush(pager, frame->page_num);
+    pager_release_frame(pager, frame_index);
+    pager->evictions++;
+    return true;
+  }
+  return false;
+}
+
+/**
+ * 取得頁面並返回其頁框索引，若未載入則從檔案讀取
+ *
+ * 緩衝池已達預算時，先置換一個未被釘選的頁框再載入；
+ * 所有頁框都被釘選時緩衝池可暫時超出預算。
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ * @param frame_index_out 輸出頁框索引（映射頁面為 INVALID_FRAME_INDEX）
+ * @return 頁面的記憶體位址
+ */
+static void *pager_fetch(Pager *pager, uint32_t page_num, uint32_t *frame_index_out) {
+  if (page_num == INVALID_PAGE_NUM) {
+    printf("Error: Tried to fetch invalid page number\n");
+    exit(EXIT_FAILURE);
+  }
+
+  if (pager_is_mapped(pager, page_num)) {
+    // mmap 模式：直接返回映射中的位址，不需複製到頁框
+    pager->cache_hits++;
+    *frame_index_out = INVALID_FRAME_INDEX;
+    return pager_verified_mapped_page(pager, page_num);
+  }
+
+  uint32_t frame_index = pager_lookup(pager, page_num);
+  if (frame_index != INVALID_FRAME_INDEX) {
+    pager->cache_hits++;
+    pager->frames[frame_index].referenced = true;
+    *frame_index_out = frame_index;
+    return pager->frames[frame_index].data;
+  }
+
+  // Cache miss：取得閒置頁框並從檔案載入
+  pager->cache_misses++;
+  if (pager->num_resident >= pager->max_frames) {
+    pager_evict_one(pager);
+  }
+  if (pager->free_frame_head == INVALID_FRAME_INDEX) {
+    pager_grow_frames(pager, pager->frame_capacity * 2);
+  }
+  frame_index = pager->free_frame_head;
+  Frame *frame = &pager->frames[frame_index];
+
+  void *page = page_arena_alloc(&pager->arena);
+
+  uint32_t slot = pager_read_slot(pager, page_num);
+
+  ssize_t bytes_read = 0;
+  if (slot != INVALID_PAGE_NUM) {
+    bytes_read = pread(pager->file_descriptor, page, PAGE_SIZE, pager_page_offset(slot));
+    if (bytes_read == -1 && pager_disable_direct_io(pager)) {
+      bytes_read = pread(pager->file_descriptor, page, PAGE_SIZE, pager_page_offset(slot));
+    }
+    if (bytes_read == -1) {
+      printf("Error: Failed to read page %u from file: %s\n", page_num, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+  // 新頁面與檔案末端不足一頁的部分補零
+  if (bytes_read < (ssize_t)PAGE_SIZE) {
+    memset((char *)page + bytes_read, 0, PAGE_SIZE - bytes_read);
+  } else {
+    pager_verify_checksum(pager, page_num, page);
+  }
+
+  pager->free_frame_head = frame->hash_next;
+  frame->data = page;
+  frame->page_num = page_num;
+  frame->referenced = true;
+  // 檔案中尚不存在的新頁面一定要寫回（寫入時複製資料庫只有寫入者會新增頁面）
+  frame->dirty = (slot == INVALID_PAGE_NUM) &&
+                 (!pager->page_map.enabled || pager->page_map.writer_locked);
+  if (frame->dirty) {
+    pager->num_dirty++;
+  }
+  uint32_t bucket = pager_hash(pager, page_num);
+  frame->hash_next = pager->page_table[bucket];
+  pager->page_table[bucket] = frame_index;
+  pager->num_resident++;
+
+  if (page_num >= pager->num_pages) {
+    pager->num_pages = page_num + 1;
+  }
+
+  *frame_index_out = frame_index;
+  return page;
+}
+
+/**
+ * 取得指定頁面的記憶體位址，若未載入則從檔案讀取
+ *
+ * 載入頁面時可能置換其他未被釘選的頁面，因此返回的指標只保證在下一次
+ * 取得頁面之前有效。需要在存取其他頁面的同時持有頁面時，改用 pager_pin。
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ * @return 頁面的記憶體位址
+ */
+void *get_page(Pager *pager, uint32_t page_num) {
+  uint32_t frame_index;
+  return pager_fetch(pager, page_num, &frame_index);
+}
+
+/**
+ * 釘選頁面：釘選期間頁面不會被置換，handle.data 保持有效
+ *
+ * 同一頁面可被釘選多次（例如多個 cursor 或遞迴中的節點），
+ * 每次釘選都必須對應一次 pager_unpin。
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ * @return 頁面 handle
+ */
+PageHandle pager_pin(Pager *pager, uint32_t page_num) {
+  PageHandle handle;
+  handle.page_num = page_num;
+  handle.data = pager_fetch(pager, page_num, &handle.frame_index);
+  if (handle.frame_index != INVALID_FRAME_INDEX) {
+    Frame *frame = &pager->frames[handle.frame_index];
+    if (frame->pin_count == 0) {
+      pager->num_pinned++;
+    }
+    frame->pin_count++;
+  }
+  return handle;
+}
+
+/**
+ * 釋放頁面的釘選，handle 之後不可再使用（data 被設為 NULL）
+ *
+ * @param pager Pager 指標
+ * @param handle 由 pager_pin 取得的 handle
+ */
+void pager_unpin(Pager *pager, PageHandle *handle) {
+  if (handle->frame_index != INVALID_FRAME_INDEX) {
+    Frame *frame = &pager->frames[handle->frame_index];
+    if (frame->pin_count == 0 || frame->page_num != handle->page_num) {
+      printf("Error: Attempted to unpin page %u that is not pinned\n", handle->page_num);
+      exit(EXIT_FAILURE);
+    }
+    frame->pin_count--;
+    if (frame->pin_count == 0) {
+      pager->num_pinned--;
+    }
+  }
+  handle->data = NULL;
+  handle->frame_index = INVALID_FRAME_INDEX;
+}
+
+/**
+ * 將一個頁面寫到檔案中的指定實體位置（校驗碼由呼叫端設定）
+ *
+ * @param pager Pager 指標
+ * @param slot 實體頁面編號
+ * @param page 頁面內容
+ */
+static void pager_write_slot_page(Pager *pager, uint32_t slot, void *page) {
+  ssize_t bytes_written = pwrite(pager->file_descriptor, page, PAGE_SIZE,
+                                 pager_page_offset(slot));
+  if (bytes_written == -1 && pager_disable_direct_io(pager)) {
+    bytes_written = pwrite(pager->file_descriptor, page, PAGE_SIZE,
+                           pager_page_offset(slot));
+  }
+  if (bytes_written == -1) {
+    printf("Error: Failed to write page %u to file: %s\n", slot, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  if (bytes_written != PAGE_SIZE) {
+    printf("Error: Incomplete write for page %u (wrote %zd bytes, expected %u)\n", 
+           slot, bytes_written, PAGE_SIZE);
+    exit(EXIT_FAILURE);
+  }
+
+  off_t end = pager_page_offset(slot) + PAGE_SIZE;
+  if (end > pager->file_length) {
+    pager->file_length = end;
+  }
+  pager->needs_sync = true;
+  pager->page_writes++;
+  pager->write_calls++;
+}
+
+/**
+ * 將頁面寫入檔案（寫入前更新校驗碼）
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ * @param page 頁面內容
+ */
+static void pager_write_page(Pager *pager, uint32_t page_num, void *page) {
+  // 頁面可能來自尚未 fsync 的群組，日誌必須先於資料庫檔案落盤
+  if (pager->wal.pending_commits > 0) {
+    wal_sync(&pager->wal);
+  }
+  page_set_checksum(page_num, page);
+  pager_write_slot_page(pager, pager_write_slot(pager, page_num), page);
+}
+
+/**
+ * 取得髒頁的內容位址
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ * @return 頁面內容位址，頁面乾淨或未載入時返回 NULL
+ */
+static void *pager_dirty_page(Pager *pager, uint32_t page_num) {
+  if (pager_is_mapped(pager, page_num)) {
+    return pager->mmap_dirty[page_num] ? pager_mapped_page(pager, page_num) : NULL;
+  }
+
+  uint32_t frame_index = pager_lookup(pager, page_num);
+  if (frame_index == INVALID_FRAME_INDEX || !pager->frames[frame_index].dirty) {
+    return NULL;
+  }
+  return pager->frames[frame_index].data;
+}
+
+/**
+ * 清除頁面的髒頁標記（頁面必須是髒頁）
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ */
+static void pager_clear_dirty(Pager *pager, uint32_t page_num) {
+  if (pager_is_mapped(pager, page_num)) {
+    pager->mmap_dirty[page_num] = false;
+  } else {
+    pager->frames[pager_lookup(pager, page_num)].dirty = false;
+  }
+  pager->num_dirty--;
+}
+
+/**
+ * 以單次 pwritev 將一段頁面寫到相鄰的實體位置（校驗碼由呼叫端設定）
+ *
+ * 若發生部分寫入，剩餘的頁面改以 pwrite 逐頁寫出。
+ *
+ * @param pager Pager 指標
+ * @param first_page_num 第一個頁面的編號
+ * @param first_slot 第一個頁面的實體頁面編號
+ * @param iov 各頁面的緩衝區
+ * @param count 頁面數量
+ */
+static void pager_write_slot_run(Pager *pager, uint32_t first_page_num, uint32_t first_slot,
+                                 struct iovec *iov, uint32_t count) {
+  ssize_t bytes_written = pwritev(pager->file_descriptor, iov, (int)count,
+                                  pager_page_offset(first_slot));
+  if (bytes_written == -1 && pager_disable_direct_io(pager)) {
+    bytes_written = pwritev(pager->file_descriptor, iov, (int)count,
+                            pager_page_offset(first_slot));
+  }
+  if (bytes_written == -1) {
+    printf("Error: Failed to write pages %u-%u to file: %s\n", first_page_num,
+           first_page_num + count - 1, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  pager->write_calls++;
+  pager->needs_sync = true;
+
+  uint32_t pages_written = (uint32_t)(bytes_written / PAGE_SIZE);
+  pager->page_writes += pages_written;
+  off_t end = pager_page_offset(first_slot) + (off_t)pages_written * PAGE_SIZE;
+  if (end > pager->file_length) {
+    pager->file_length = end;
+  }
+  for (uint32_t i = pages_written; i < count; i++) {
+    pager_write_page(pager, first_page_num + i, iov[i].iov_base);
+  }
+}
+
+/**
+ * 寫出一段相鄰頁面，並清除其髒頁標記
+ *
+ * 一般模式以單次 pwritev 寫出；寫入時複製模式的頁面被寫到新配置的位置，
+ * 實體位置仍然相鄰的部分才合併為一次寫入。
+ *
+ * @param pager Pager 指標
+ * @param first_page_num 第一個頁面的編號
+ * @param iov 各頁面的緩衝區
+ * @param count 頁面數量
+ */
+static void pager_write_run(Pager *pager, uint32_t first_page_num,
+                            struct iovec *iov, uint32_t count) {
+  if (pager->wal.pending_commits > 0) {
+    wal_sync(&pager->wal);
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    page_set_checksum(first_page_num + i, iov[i].iov_base);
+  }
+
+  uint32_t run_start = 0;
+  uint32_t run_slot = pager_write_slot(pager, first_page_num);
+  for (uint32_t i = 1; i <= count; i++) {
+    uint32_t slot = (i < count) ? pager_write_slot(pager, first_page_num + i) : 0;
+    if (i == count || slot != run_slot + (i - run_start)) {
+      pager_write_slot_run(pager, first_page_num + run_start, run_slot, iov + run_start,
+                           i - run_start);
+      run_start = i;
+      run_slot = slot;
+    }
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    pager_clear_dirty(pager, first_page_num + i);
+  }
+}
+
+/**
+ * 將指定頁面寫回檔案（乾淨的頁面會被略過）
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ */
+void pager_flush(Pager *pager, uint32_t page_num) {
+  if (!pager_is_mapped(pager, page_num) &&
+      pager_lookup(pager, page_num) == INVALID_FRAME_INDEX) {
+    printf("Error: Attempted to flush null page %u\n", page_num);
+    exit(EXIT_FAILURE);
+  }
+
+  void *page = pager_dirty_page(pager, page_num);
+  if (page == NULL) {
+    return;
+  }
+  pager_write_page(pager, page_num, page);
+  pager_clear_dirty(pager, page_num);
+}
+
+/**
+ * 比較兩個頁面編號（供 qsort 使用）
+ */
+static int compare_page_nums(const void *a, const void *b) {
+  uint32_t left = *(const uint32_t *)a;
+  uint32_t right = *(const uint32_t *)b;
+  return (left > right) - (left < right);
+}
+
+/**
+ * 將一組頁面中的髒頁寫回檔案
+ *
+ * 頁面依編號排序後，連續的髒頁會合併為單次 pwritev，
+ * 乾淨或未載入的頁面則被略過。
+ *
+ * @param pager Pager 指標
+ * @param page_nums 頁面編號陣列（會被就地排序）
+ * @param count 頁面數量
+ */
+void pager_flush_pages(Pager *pager, uint32_t *page_nums, uint32_t count) {
+  qsort(page_nums, count, sizeof(uint32_t), compare_page_nums);
+
+  struct iovec iov[PAGER_MAX_WRITE_RUN];
+  uint32_t run_start = 0;
+  uint32_t run_length = 0;
+
+  for (uint32_t i = 0; i <= count; i++) {
+    void *page = (i < count) ? pager_dirty_page(pager, page_nums[i]) : NULL;
+
+    // 目前的區段無法延伸時先寫出
+    bool extends_run = page != NULL && run_length > 0 &&
+                       page_nums[i] == run_start + run_length &&
+                       run_length < PAGER_MAX_WRITE_RUN;
+    if (run_length > 0 && !extends_run) {
+      pager_write_run(pager, run_start, iov, run_length);
+      run_length = 0;
+    }
+    if (page == NULL) {
+      continue;
+    }
+
+    if (run_length == 0) {
+      run_start = page_nums[i];
+    }
+    iov[run_length].iov_base = page;
+    iov[run_length].iov_len = PAGE_SIZE;
+    run_length++;
+  }
+}
+
+/**
+ * 將所有髒頁（緩衝池與檔案映射）寫回檔案
+ *
+ * @param pager Pager 指標
+ */
+void pager_flush_all(Pager *pager) {
+  if (pager->num_dirty == 0) {
+    return;
+  }
+
+  uint32_t *page_nums = malloc(pager->num_dirty * sizeof(uint32_t));
+  if (page_nums == NULL) {
+    printf("Error: Memory allocation failed for flush list\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < pager->mmap_pages; i++) {
+    if (pager->mmap_dirty[i]) {
+      page_nums[count++] = i;
+    }
+  }
+  for (uint32_t i = 0; i < pager->frame_capacity; i++) {
+    if (pager->frames[i].data != NULL && pager->frames[i].dirty) {
+      page_nums[count++] = pager->frames[i].page_num;
+    }
+  }
+
+  pager_flush_pages(pager, page_nums, count);
+  free(page_nums);
+}
+
+/**
+ * 將已載入的頁面標記為髒頁，使其在置換或關閉時被寫回
+ *
+ * 任何直接透過 get_page 或 pager_pin 取得並修改頁面的程式碼都必須呼叫此函式；
+ * table_pin_page_for_write 會自動標記。
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ */
+void pager_mark_dirty(Pager *pager, uint32_t page_num) {
+  if (pager_is_mapped(pager, page_num)) {
+    if (!pager->mmap_dirty[page_num]) {
+      pager->mmap_dirty[page_num] = true;
+      pager->num_dirty++;
+    }
+    return;
+  }
+
+  uint32_t frame_index = pager_lookup(pager, page_num);
+  if (frame_index == INVALID_FRAME_INDEX) {
+    printf("Error: Attempted to mark non-resident page %u dirty\n", page_num);
+    exit(EXIT_FAILURE);
+  }
+
+  Frame *frame = &pager->frames[frame_index];
+  if (!frame->dirty) {
+    frame->dirty = true;
+    pager->num_dirty++;
+  }
+}
+
+/**
+ * 以 CLOCK 演算法置換頁面，直到載入的頁面數量回到預算內
+ *
+ * 載入新頁面時只會置換一個頁框；被釘選的頁框讓緩衝池暫時超出預算，
+ * 釘選釋放後由此函式收回。呼叫點包括每個語句執行結束、掃描跨越葉節點時、
+ * 以及批次刪除的每一筆之間。被釘選的頁框不會被置換。
+ *
+ * @param pager Pager 指標
+ */
+void pager_evict_to_budget(Pager *pager) {
+  while (pager->num_resident > pager->max_frames) {
+    if (!pager_evict_one(pager)) {
+      break;
+    }
+  }
+}
+
+/**
+ * 丟棄緩衝池中的所有頁面（頁面都必須是乾淨且未被釘選的）
+ *
+ * 寫入時複製資料庫切換到其他行程提交的版本時使用，之後的存取從新版本重新載入。
+ *
+ * @param pager Pager 指標
+ */
+void pager_discard_frames(Pager *pager) {
+  for (uint32_t i = 0; i < pager->frame_capacity; i++) {
+    if (pager->frames[i].data != NULL) {
+      pager_release_frame(pager, i);
+    }
+  }
+  pager->readahead_parent = INVALID_PAGE_NUM;
+}
+
+/**
+ * 取得已載入（或已映射）的頁面，不會觸發讀取
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號
+ * @return 頁面的記憶體位址，頁面不在記憶體中時返回 NULL
+ */
+void *pager_resident_page(Pager *pager, uint32_t page_num) {
+  if (pager_is_mapped(pager, page_num)) {
+    return pager_verified_mapped_page(pager, page_num);
+  }
+  uint32_t frame_index = pager_lookup(pager, page_num);
+  return frame_index == INVALID_FRAME_INDEX ? NULL : pager->frames[frame_index].data;
+}
+
+/**
+ * 提示作業系統預先讀取一段相鄰的頁面
+ *
+ * @param pager Pager 指標
+ * @param first_page_num 第一個頁面的編號
+ * @param count 頁面數量
+ */
+static void pager_prefetch_run(Pager *pager, uint32_t first_page_num, uint32_t count) {
+  if (pager_is_mapped(pager, first_page_num)) {
+    madvise(pager_mapped_page(pager, first_page_num), (size_t)count * PAGE_SIZE,
+            MADV_WILLNEED);
+  } else {
+    posix_fadvise(pager->file_descriptor, pager_page_offset(first_page_num),
+                  (off_t)count * PAGE_SIZE, POSIX_FADV_WILLNEED);
+  }
+  pager->readahead_pages += count;
+}
+
+/**
+ * 提示作業系統預先讀取一組頁面，不等待讀取完成
+ *
+ * 已在緩衝池中或尚未寫入檔案的頁面會被略過，相鄰的頁面合併為一次提示。
+ * 一般模式使用 posix_fadvise(POSIX_FADV_WILLNEED)，mmap 模式使用
+ * madvise(MADV_WILLNEED)；直接 I/O 不經過頁面快取，因此不預讀。
+ *
+ * @param pager Pager 指標
+ * @param page_nums 頁面編號陣列（會被就地排序）
+ * @param count 頁面數量
+ */
+void pager_prefetch(Pager *pager, uint32_t *page_nums, uint32_t count) {
+  if (pager->direct_io) {
+    return;
+  }
+  if (pager->page_map.enabled) {
+    // 寫入時複製模式：只保留不在緩衝池中的頁面，換算為實體位置後再合併
+    uint32_t num_wanted = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t slot = pager_read_slot(pager, page_nums[i]);
+      if (slot != INVALID_PAGE_NUM &&
+          pager_lookup(pager, page_nums[i]) == INVALID_FRAME_INDEX) {
+        page_nums[num_wanted++] = slot;
+      }
+    }
+    count = num_wanted;
+  }
+  qsort(page_nums, count, sizeof(uint32_t), compare_page_nums);
+
+  uint32_t run_start = 0;
+  uint32_t run_length = 0;
+  for (uint32_t i = 0; i <= count; i++) {
+    uint32_t page_num = (i < count) ? page_nums[i] : INVALID_PAGE_NUM;
+    bool wanted = i < count && pager_page_offset(page_num) < pager->file_length &&
+                  (pager->page_map.enabled || pager_is_mapped(pager, page_num) ||
+                   pager_lookup(pager, page_num) == INVALID_FRAME_INDEX);
+
+    // 目前的區段無法延伸時先送出（映射與未映射的頁面分開處理）
+    bool extends_run = wanted && run_length > 0 && page_num == run_start + run_length &&
+                       pager_is_mapped(pager, page_num) == pager_is_mapped(pager, run_start);
+    if (run_length > 0 && !extends_run) {
+      pager_prefetch_run(pager, run_start, run_length);
+      run_length = 0;
+    }
+    if (!wanted) {
+      continue;
+    }
+
+    if (run_length == 0) {
+      run_start = page_num;
+    }
+    run_length++;
+  }
+}
+
+/**
+ * 將舊版資料庫檔案（沒有標頭頁、根節點位於第 0 頁）升級為目前的格式
+ *
+ * 舊的根節點被搬到檔案末端的新頁面，其子節點的 parent 指標隨之更新，
+ * 第 0 頁則改寫為標頭頁。next_leaf 不會指向根節點，因此葉節點鏈不需調整。
+ *
+ * @param pager Pager 指標
+ * @param filename 資料庫檔案路徑（用於錯誤訊息）
+ */
+static void db_upgrade_legacy_layout(Pager *pager, const char *filename) {
+  PageHandle old_root = pager_pin(pager, HEADER_PAGE_NUM);
+  uint8_t node_type = *((uint8_t *)(old_root.data + NODE_TYPE_OFFSET));
+  if ((node_type != NODE_INTERNAL && node_type != NODE_LEAF) ||
+      !is_node_root(old_root.data)) {
+    printf("Error: '%s' is not a C-SQL database file\n", filename);
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t new_root_page_num = pager->num_pages;
+  PageHandle new_root = pager_pin(pager, new_root_page_num);
+  memcpy(new_root.data, old_root.data, PAGE_SIZE);
+
+  if (get_node_type(new_root.data) == NODE_INTERNAL) {
+    uint32_t num_keys = *internal_node_num_keys(new_root.data);
+    for (uint32_t i = 0; i <= num_keys; i++) {
+      uint32_t child_page_num = *internal_node_child(new_root.data, i);
+      *node_parent(get_page(pager, child_page_num)) = new_root_page_num;
+      pager_mark_dirty(pager, child_page_num);
+    }
+  }
+  pager_unpin(pager, &new_root);
+
+  initialize_header_page(old_root.data, new_root_page_num);
+  // 頁面還沒有校驗碼，接著由 db_upgrade_checksums 補上
+  *header_format_version(old_root.data) = DB_FORMAT_VERSION_NO_CHECKSUMS;
+  pager_mark_dirty(pager, HEADER_PAGE_NUM);
+  pager_unpin(pager, &old_root);
+  printf("Note: Upgraded '%s' to the header page format.\n", filename);
+}
+
+/**
+ * 為沒有頁面校驗碼的檔案（第 1 版格式或剛升級的舊版檔案）補上校驗碼
+ *
+ * 所有頁面以新的校驗碼重新寫出後，才寫回新版本號的標頭頁，
+ * 中途中斷時檔案仍是可重新升級的舊版本。其他版本留給 db_read_header 回報錯誤。
+ *
+ * @param pager Pager 指標
+ * @param filename 資料庫檔案路徑（用於訊息）
+ * @param announce 是否印出升級訊息（剛從沒有標頭頁的舊版檔案升級時不印）
+ */
+static void db_upgrade_checksums(Pager *pager, const char *filename, bool announce) {
+  PageHandle header = pager_pin(pager, HEADER_PAGE_NUM);
+  if (*header_format_version(header.data) != DB_FORMAT_VERSION_NO_CHECKSUMS) {
+    pager_unpin(pager, &header);
+    return;
+  }
+
+  for (uint32_t page_num = HEADER_PAGE_NUM + 1; page_num < pager->num_pages; page_num++) {
+    get_page(pager, page_num);
+    pager_mark_dirty(pager, page_num);
+    pager_flush(pager, page_num);
+  }
+
+  // 葉節點佈局仍是舊版，接著由 db_upgrade_leaf_layout 改寫
+  *header_format_version(header.data) = DB_FORMAT_VERSION_INTERLEAVED_LEAVES;
+  pager_mark_dirty(pager, HEADER_PAGE_NUM);
+  pager_flush(pager, HEADER_PAGE_NUM);
+  pager_unpin(pager, &header);
+
+  pager->verify_checksums = true;
+  if (announce) {
+    printf("Note: Added page checksums to '%s'.\n", filename);
+  }
+}
+
+/**
+ * 讀取並檢查標頭頁，返回根節點頁面編號
+ *
+ * 格式版本或頁面大小不符、檔案比標頭記錄的頁面數短、
+ * 或根節點編號超出範圍時視為無法開啟。
+ *
+ * @param pager Pager 指標
+ * @param filename 資料庫檔案路徑（用於錯誤訊息）
+ * @return 根節點頁面編號
+ */
+static uint32_t db_read_header(Pager *pager, const char *filename) {
+  void *header = get_page(pager, HEADER_PAGE_NUM);
+
+  uint32_t format_version = *header_format_version(header);
+  if (format_version != DB_FORMAT_VERSION &&
+      format_version != DB_FORMAT_VERSION_INTERLEAVED_LEAVES) {
+    printf("Error: Database file '%s' has unsupported format version %u "
+           "(expected %u)\n", filename, format_version, DB_FORMAT_VERSION);
+    exit(EXIT_FAILURE);
+  }
+  // 重做日誌之後的標頭頁才是準確的版本
+  pager->interleaved_leaves = (format_version != DB_FORMAT_VERSION);
+
+  uint32_t page_size = *header_page_size(header);
+  if (page_size != PAGE_SIZE) {
+    printf("Error: Database file '%s' uses page size %u (expected %u)\n",
+           filename, page_size, PAGE_SIZE);
+    exit(EXIT_FAILURE);
+  }
+
+  // 檔案可能因異常結束而比記錄的更長（新頁面已寫出但標頭尚未更新），
+  // 但不應該更短
+  uint32_t page_count = *header_page_count(header);
+  if (page_count > pager->num_pages) {
+    printf("Error: Database file '%s' is truncated (%u of %u pages)\n",
+           filename, pager->num_pages, page_count);
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t root_page_num = *header_root_page(header);
+  if (root_page_num == 0 || root_page_num >= pager->num_pages) {
+    printf("Error: Database file '%s' is corrupted (invalid root page %u)\n",
+           filename, root_page_num);
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t stats_page_num = *header_stats_page(header);
+  if (stats_page_num == root_page_num || stats_page_num >= pager->num_pages) {
+    printf("Error: Database file '%s' is corrupted (invalid statistics page %u)\n",
+           filename, stats_page_num);
+    exit(EXIT_FAILURE);
+  }
+
+  return root_page_num;
+}
+
+/**
+ * 將葉節點 key 與 value 交錯存放的第 2 版檔案改寫為 key 陣列在前的目前佈局
+ *
+ * 沿著葉節點串列逐頁改寫，最後更新標頭頁的版本號，全部在一個交易中提交：
+ * 日誌（或寫入時複製的新版本）保證中途中斷時檔案仍是完整的第 2 版。
+ * 提交後立即執行檢查點，之後的列變更記錄不會落在舊版的頁面上。
+ *
+ * @param table Table 指標（交易與統計資訊已初始化）
+ * @param filename 資料庫檔案路徑（用於訊息）
+ */
+static void db_upgrade_leaf_layout(Table *table, const char *filename) {
+  Pager *pager = table->pager;
+  if (!pager->interleaved_leaves) {
+    return;
+  }
+  if (table_begin_write(table) != EXECUTE_SUCCESS) {
+    printf("Error: Database file '%s' needs an upgrade but is locked by another process\n",
+           filename);
+    exit(EXIT_FAILURE);
+  }
+  transaction_begin(table);
+
+  uint32_t page_num = table->root_page_num;
+  PageHandle node = table_pin_page(table, page_num);
+  while (get_node_type(node.data) == NODE_INTERNAL) {
+    page_num = *internal_node_child(node.data, 0);
+    table_unpin_page(table, &node);
+    node = table_pin_page(table, page_num);
+  }
+  table_unpin_page(table, &node);
+
+  uint8_t *old_page = page_arena_alloc(&pager->arena);
+  while (page_num != 0) {
+    PageHandle leaf = table_pin_page_for_write(table, page_num);
+    uint32_t num_cells = *leaf_node_num_cells(leaf.data);
+    if (num_cells > LEAF_NODE_MAX_CELLS) {
+      printf("Error: Database file '%s' has a corrupted leaf (page %u)\n", filename, page_num);
+      exit(EXIT_FAILURE);
+    }
+    memcpy(old_page, leaf.data, PAGE_SIZE);
+    memset(leaf.data + LEAF_NODE_HEADER_SIZE, 0, PAGE_CHECKSUM_OFFSET - LEAF_NODE_HEADER_SIZE);
+    for (uint32_t i = 0; i < num_cells; i++) {
+      uint8_t *old_cell = old_page + LEAF_NODE_HEADER_SIZE + i * LEAF_NODE_CELL_SIZE;
+      memcpy(leaf_node_key(leaf.data, i), old_cell, LEAF_NODE_KEY_SIZE);
+      memcpy(leaf_node_value(leaf.data, i), old_cell + LEAF_NODE_KEY_SIZE, LEAF_NODE_VALUE_SIZE);
+    }
+    page_num = *leaf_node_next_leaf(leaf.data);
+    table_unpin_page(table, &leaf);
+  }
+  page_arena_free(&pager->arena, old_page);
+
+  PageHandle header = table_pin_page_for_write(table, HEADER_PAGE_NUM);
+  *header_format_version(header.data) = DB_FORMAT_VERSION;
+  table_unpin_page(table, &header);
+
+  transaction_commit(table);
+  pager->interleaved_leaves = false;
+  if (!pager->page_map.enabled) {
+    pager_checkpoint(pager);
+  }
+  table_end_statement(table);
+  printf("Note: Upgraded '%s' to the separate leaf key layout.\n", filename);
+}
+
+/**
+ * 開啟資料庫，初始化 Table 結構
+ *
+ * @param filename 資料庫檔案路徑
+ * @param options 開啟選項
+ * @return 初始化完成的 Table 指標
+ */
+Table *db_open(const char *filename, const OpenOptions *options) {
+  Pager *pager = pager_open(filename, options);
+
+  Table *table = malloc(sizeof(Table));
+  if (table == NULL) {
+    printf("Error: Memory allocation failed for table\n");
+    // 清理 pager 資源
+    close(pager->file_descriptor);
+    free(pager);
+    exit(EXIT_FAILURE);
+  }
+
+  table->pager = pager;
+  table->checkpointer = NULL;
+
+  bool is_new_database = (pager->num_pages == 0);
+  if (is_new_database) {
+    if (pager->page_map.enabled) {
+      if (!page_map_lock_writer(pager)) {
+        printf("Error: Database file '%s' is being created by another process\n", filename);
+        exit(EXIT_FAILURE);
+      }
+      page_map_prepare_write(pager);
+    }
+    // 新資料庫檔案：第 0 頁為標頭頁，第 1 頁初始化為根節點（葉節點）
+    void *header = get_page(pager, HEADER_PAGE_NUM);
+    initialize_header_page(header, 1);
+    void *root_node = get_page(pager, 1);
+    initialize_leaf_node(root_node);
+    set_node_root(root_node, true);
+    if (pager->page_map.enabled) {
+      // 立即提交第一個版本，其他行程開啟時一定讀得到標頭頁
+      page_map_commit(pager);
+    }
+  }
+  bool is_legacy = !is_new_database && !header_is_valid(get_page(pager, HEADER_PAGE_NUM));
+  if (is_legacy) {
+    db_upgrade_legacy_layout(pager, filename);
+  }
+  if (!pager->verify_checksums) {
+    db_upgrade_checksums(pager, filename, !is_legacy);
+  }
+
+  table->root_page_num = db_read_header(pager, filename);
+  
+  // 初始化交易結構
+  table->transaction = malloc(sizeof(Transaction));
+  if (table->transaction == NULL) {
+    printf("Error: Memory allocation failed for transaction\n");
+    close(pager->file_descriptor);
+    free(pager);
+    free(table);
+    exit(EXIT_FAILURE);
+  }
+
+  table->transaction->state = TXN_STATE_NONE;
+  table->transaction->log_mode = options->txn_log;
+  table->transaction->num_modified = 0;
+  table->transaction->start_num_pages = 0;
+  table->transaction->shadows = NULL;
+  table->transaction->shadow_capacity = 0;
+  table->transaction->shadow_table = NULL;
+  table->transaction->shadow_table_mask = 0;
+  table->transaction->row_changes = NULL;
+  table->transaction->num_row_changes = 0;
+  table->transaction->row_change_capacity = 0;
+  table->transaction->row_images = NULL;
+  table->transaction->row_images_size = 0;
+  table->transaction->row_images_capacity = 0;
+  table->transaction->savepoints = NULL;
+  table->transaction->num_savepoints = 0;
+  table->transaction->savepoint_capacity = 0;
+  table->transaction->savepoint_images = NULL;
+  table->transaction->num_savepoint_images = 0;
+  table->transaction->savepoint_image_capacity = 0;
+  table->transaction->next_savepoint_id = 1;
+  table->transaction->max_shadow_pages = options->txn_shadow_pages < TXN_MIN_SHADOW_PAGES
+                                             ? TXN_MIN_SHADOW_PAGES
+                                             : options->txn_shadow_pages;
+  table->transaction->num_resident_shadows = 0;
+  table->transaction->num_spilled = 0;
+  table->transaction->num_row_pages = 0;
+  table->transaction->spill_clock_hand = 0;
+  table->transaction->spill_fd = -1;
+  table->transaction->spill_writes = 0;
+  table->transaction->spill_reads = 0;
+  // 暫存檔放在資料庫檔案旁：/tmp 常是 tmpfs，溢出到記憶體就失去意義
+  table->transaction->spill_path = malloc(strlen(filename) + sizeof("-spill-XXXXXX"));
+  if (table->transaction->spill_path == NULL) {
+    printf("Error: Memory allocation failed for transaction\n");
+    exit(EXIT_FAILURE);
+  }
+  sprintf(table->transaction->spill_path, "%s-spill-XXXXXX", filename);
+
+  // 初始化統計資訊
+  table->statistics = malloc(sizeof(TableStatistics));
+  if (table->statistics == NULL) {
+    printf("Error: Memory allocation failed for statistics\n");
+    close(pager->file_descriptor);
+    free(pager);
+    free(table->transaction);
+    free(table);
+    exit(EXIT_FAILURE);
+  }
+  
+  statistics_reset(table->statistics);
+  
+  // 嘗試載入統計資訊（與葉節點佈局無關），葉節點升級後才能收集新的統計資訊
+  bool statistics_loaded = statistics_load(table);
+  db_upgrade_leaf_layout(table, filename);
+  if (!statistics_loaded) {
+    // 如果表不為空，收集統計資訊（其他行程正在修改時只保留在記憶體中）
+    if (!is_new_database) {
+      TableStatistics *stats = collect_table_statistics(table);
+      if (stats != NULL) {
+        memcpy(table->statistics, stats, sizeof(TableStatistics));
+        free(stats);
+        if (table_begin_write(table) == EXECUTE_SUCCESS) {
+          statistics_save(table);
+        }
+      }
+    }
+  }
+
+  if (options->checkpoint_interval_ms > 0 || options->checkpoint_pages > 0) {
+    checkpointer_start(table, options->checkpoint_interval_ms, options->checkpoint_pages);
+  }
+
+  return table;
+}
+
+/**
+ * 保存統計資訊並更新標頭頁的頁面總數（檢查點之前），與其他髒頁一起寫回
+ *
+ * 寫入時複製資料庫只有持有寫入鎖時才寫入（統計資訊已隨每次提交保存）。
+ *
+ * @param table Table 指標
+ */
+static void table_save_header(Table *table) {
+  Pager *pager = table->pager;
+  if (pager->page_map.enabled && !pager->page_map.writer_locked) {
+    return;
+  }
+  if (table->statistics) {
+    statistics_save(table);
+  }
+  void *header = get_page(pager, HEADER_PAGE_NUM);
+  if (*header_page_count(header) != pager->num_pages) {
+    *header_page_count(header) = pager->num_pages;
+    pager_mark_dirty(pager, HEADER_PAGE_NUM);
+  }
+}
+
+/**
+ * 關閉資料庫，將所有髒頁寫回檔案並釋放資源
+ *
+ * @param table Table 指標
+ */
+void db_close(Table *table) {
+  Pager *pager = table->pager;
+
+  // 先停止背景檢查點，之後只有本執行緒存取資料庫
+  checkpointer_stop(table);
+  
+  // 如果有活動的交易，強制提交
+  if (table->transaction && table->transaction->state == TXN_STATE_ACTIVE) {
+    printf("Warning: Active transaction will be committed.\n");
+    transaction_commit(table);
+  }
+
+  table_save_header(table);
+  pager_checkpoint(pager);
+  wal_close(pager);
+  page_map_close(pager);
+  pager_unmap_file(pager);
+  for (uint32_t i = 0; i < pager->frame_capacity; i++) {
+    if (pager->frames[i].data != NULL) {
+      pager_release_frame(pager, i);
+    }
+  }
+
+  int result = close(pager->file_descriptor);
+  if (result == -1) {
+    printf("Error: Failed to close database file: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  // 清理交易資源
+  if (table->transaction) {
+    transaction_clear(table->transaction, pager);
+    free(table->transaction->shadows);
+    free(table->transaction->shadow_table);
+    free(table->transaction->row_changes);
+    free(table->transaction->row_images);
+    free(table->transaction->savepoints);
+    free(table->transaction->savepoint_images);
+    free(table->transaction->spill_path);
+    free(table->transaction);
+  }
+
+  // 清理統計資訊
+  if (table->statistics) {
+    free(table->statistics);
+  }
+
+  page_arena_destroy(&pager->arena);
+  free(pager->frames);
+  free(pager->page_table);
+  free(pager);
+  free(table);
+}
+
+/* ============================================================================
+ * 預寫日誌（Write-Ahead Log）
+ * ============================================================================
+ */
+
+uint32_t *wal_header_format_version(void *header) {
+  return header + WAL_FORMAT_VERSION_OFFSET;
+}
+
+uint32_t *wal_header_page_size(void *header) {
+  return header + WAL_PAGE_SIZE_OFFSET;
+}
+
+uint32_t *wal_header_salt(void *header) {
+  return header + WAL_SALT_OFFSET;
+}
+
+uint32_t *wal_header_checksum(void *header) {
+  return header + WAL_HEADER_CHECKSUM_OFFSET;
+}
+
+uint32_t *wal_frame_page_num(void *frame_header) {
+  return frame_header + WAL_FRAME_PAGE_NUM_OFFSET;
+}
+
+uint32_t *wal_frame_db_size(void *frame_header) {
+  return frame_header + WAL_FRAME_DB_SIZE_OFFSET;
+}
+
+uint32_t *wal_frame_salt(void *frame_header) {
+  return frame_header + WAL_FRAME_SALT_OFFSET;
+}
+
+uint32_t *wal_frame_checksum(void *frame_header) {
+  return frame_header + WAL_FRAME_CHECKSUM_OFFSET;
+}
+
+/**
+ * 將頁面編號加入串列尾端
+ *
+ * @param list PageList 指標
+ * @param page_num 頁面編號
+ */
+static void page_list_push(PageList *list, uint32_t page_num) {
+  if (list->count == list->capacity) {
+    uint32_t new_capacity = list->capacity ? list->capacity * 2 : 64;
+    uint32_t *pages = realloc(list->pages, new_capacity * sizeof(uint32_t));
+    if (pages == NULL) {
+      printf("Error: Memory allocation failed for page list\n");
+      exit(EXIT_FAILURE);
+    }
+    list->pages = pages;
+    list->capacity = new_capacity;
+  }
+  list->pages[list->count++] = page_num;
+}
+
+/**
+ * 將檔案內容（不含非必要的中繼資料）同步到磁碟
+ *
+ * @param fd 檔案描述符
+ * @param what 檔案說明（用於錯誤訊息）
+ */
+static void sync_file(int fd, const char *what) {
+#if defined(__linux__)
+  int result = fdatasync(fd);
+#else
+  int result = fsync(fd);
+#endif
+  if (result == -1) {
+    printf("Error: Failed to sync %s: %s\n", what, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * 計算訊框的校驗碼（訊框標頭的前三個欄位與內容）
+ */
+static uint32_t wal_frame_compute_checksum(void *frame_header, const void *payload,
+                                           uint32_t payload_size) {
+  uint32_t crc = crc32c_update(0xFFFFFFFFu, frame_header, WAL_FRAME_CHECKSUM_OFFSET);
+  crc = crc32c_update(crc, payload, payload_size);
+  return ~crc;
+}
+
+/**
+ * 列變更記錄的長度（刪除只記錄位置與鍵，插入與更新再加上 cell 的值）
+ */
+static inline uint32_t wal_row_record_size(uint32_t type) {
+  return WAL_ROW_HEADER_SIZE + (type == ROW_CHANGE_DELETE ? 0 : LEAF_NODE_VALUE_SIZE);
+}
+
+/**
+ * 從 offset 開始，內容不超過一頁的列變更訊框能容納的記錄總長度（依記錄邊界切分）
+ *
+ * @param records 連續的列變更記錄
+ * @param size 記錄的總長度
+ * @param offset 這個訊框的第一筆記錄
+ * @return 這個訊框的記錄總長度
+ */
+static uint32_t wal_row_frame_length(const uint8_t *records, uint32_t size, uint32_t offset) {
+  uint32_t length = 0;
+  while (offset + length < size) {
+    uint32_t record_size =
+        wal_row_record_size(*(const uint32_t *)(records + offset + length + WAL_ROW_TYPE_OFFSET));
+    if (WAL_ROW_FRAME_LENGTH_SIZE + length + record_size > PAGE_SIZE) {
+      break;
+    }
+    length += record_size;
+  }
+  return length;
+}
+
+/**
+ * 以 pwritev 寫出所有緩衝區，處理部分寫入
+ *
+ * @param wal Wal 指標
+ * @param iov 緩衝區陣列（內容會被修改）
+ * @param count 緩衝區數量
+ * @param offset 寫入位移
+ */
+static void wal_write_all(Wal *wal, struct iovec *iov, uint32_t count, off_t offset) {
+  while (count > 0) {
+    int batch = count < PAGER_MAX_WRITE_RUN ? (int)count : PAGER_MAX_WRITE_RUN;
+    ssize_t bytes_written = pwritev(wal->file_descriptor, iov, batch, offset);
+    if (bytes_written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      printf("Error: Failed to write to '%s': %s\n", wal->path, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    offset += bytes_written;
+    while (count > 0 && (size_t)bytes_written >= iov->iov_len) {
+      bytes_written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *)iov->iov_base + bytes_written;
+      iov->iov_len -= bytes_written;
+    }
+  }
+}
+
+/**
+ * 清空日誌：截斷檔案並寫入新一輪的日誌標頭
+ *
+ * @param wal Wal 指標
+ */
+static void wal_reset(Wal *wal) {
+  if (ftruncate(wal->file_descriptor, 0) == -1) {
+    printf("Error: Failed to truncate '%s': %s\n", wal->path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  uint8_t header[WAL_HEADER_SIZE];
+  memset(header, 0, sizeof(header));
+  memcpy(header + WAL_MAGIC_OFFSET, WAL_MAGIC, WAL_MAGIC_SIZE);
+  *wal_header_format_version(header) = WAL_FORMAT_VERSION;
+  *wal_header_page_size(header) = PAGE_SIZE;
+  *wal_header_salt(header) = wal->salt;
+  *wal_header_checksum(header) =
+      ~crc32c_update(0xFFFFFFFFu, header, WAL_HEADER_CHECKSUM_OFFSET);
+
+  struct iovec iov = {header, sizeof(header)};
+  wal_write_all(wal, &iov, 1, 0);
+  wal->num_frames = 0;
+  wal->size = WAL_HEADER_SIZE;
+}
+
+/**
+ * 讀取日誌標頭
+ *
+ * @param wal Wal 指標
+ * @param salt 輸出：日誌的輪次
+ * @return 標頭是否完整且有效
+ */
+static bool wal_read_header(Wal *wal, uint32_t *salt) {
+  uint8_t header[WAL_HEADER_SIZE];
+  ssize_t bytes_read = pread(wal->file_descriptor, header, sizeof(header), 0);
+  if (bytes_read == -1) {
+    printf("Error: Failed to read '%s': %s\n", wal->path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if (bytes_read < (ssize_t)sizeof(header) ||
+      memcmp(header + WAL_MAGIC_OFFSET, WAL_MAGIC, WAL_MAGIC_SIZE) != 0 ||
+      (*wal_header_format_version(header) != WAL_FORMAT_VERSION &&
+       *wal_header_format_version(header) != WAL_FORMAT_VERSION_PAGES_ONLY) ||
+      *wal_header_checksum(header) !=
+          ~crc32c_update(0xFFFFFFFFu, header, WAL_HEADER_CHECKSUM_OFFSET)) {
+    return false;
+  }
+  if (*wal_header_page_size(header) != PAGE_SIZE) {
+    printf("Error: Write-ahead log '%s' uses page size %u (expected %u)\n",
+           wal->path, *wal_header_page_size(header), PAGE_SIZE);
+    exit(EXIT_FAILURE);
+  }
+  *salt = *wal_header_salt(header);
+  return true;
+}
+
+/**
+ * 讀取並驗證一個訊框
+ *
+ * 訊框的內容最多一頁，因此整頁訊框與列變更訊框都以一次 preadv 讀取。
+ *
+ * @param wal Wal 指標
+ * @param salt 日誌的輪次
+ * @param offset 訊框在日誌檔案中的位移
+ * @param frame_header 輸出：訊框標頭
+ * @param payload 輸出：訊框內容（一頁大小的緩衝區）
+ * @param frame_size 輸出：訊框的總長度
+ * @return 訊框是否完整且屬於這一輪日誌
+ */
+static bool wal_read_frame(Wal *wal, uint32_t salt, off_t offset, uint8_t *frame_header,
+                           void *payload, uint32_t *frame_size) {
+  struct iovec iov[2] = {{frame_header, WAL_FRAME_HEADER_SIZE}, {payload, PAGE_SIZE}};
+  ssize_t bytes_read = preadv(wal->file_descriptor, iov, 2, offset);
+  if (bytes_read == -1) {
+    printf("Error: Failed to read '%s': %s\n", wal->path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  if (bytes_read < (ssize_t)WAL_FRAME_HEADER_SIZE || *wal_frame_salt(frame_header) != salt) {
+    return false;
+  }
+
+  uint32_t payload_size = PAGE_SIZE;
+  if (*wal_frame_page_num(frame_header) == WAL_ROW_FRAME) {
+    uint32_t length = *(uint32_t *)payload;
+    if (bytes_read < (ssize_t)(WAL_FRAME_HEADER_SIZE + WAL_ROW_FRAME_LENGTH_SIZE) ||
+        length > PAGE_SIZE - WAL_ROW_FRAME_LENGTH_SIZE) {
+      return false;
+    }
+    payload_size = WAL_ROW_FRAME_LENGTH_SIZE + length;
+  }
+  *frame_size = WAL_FRAME_HEADER_SIZE + payload_size;
+  return bytes_read >= (ssize_t)*frame_size &&
+         *wal_frame_checksum(frame_header) ==
+             wal_frame_compute_checksum(frame_header, payload, payload_size);
+}
+
+/**
+ * 比較兩個 64 位元整數（供 qsort 與 bsearch 使用）
+ */
+static int compare_u64(const void *a, const void *b) {
+  uint64_t left = *(const uint64_t *)a;
+  uint64_t right = *(const uint64_t *)b;
+  return (left > right) - (left < right);
+}
+
+/**
+ * 記錄頁面在日誌中只有列變更記錄，檢查點之前不可寫回資料庫檔案
+ *
+ * @param pager Pager 指標
+ * @param page_num 頁面編號（必須已載入）
+ */
+static void wal_track_row_page(Pager *pager, uint32_t page_num) {
+  if (!pager_is_mapped(pager, page_num)) {
+    // 映射的頁面不會被置換，只有頁框需要標記
+    Frame *frame = &pager->frames[pager_lookup(pager, page_num)];
+    if (frame->row_logged) {
+      return;
+    }
+    frame->row_logged = true;
+  }
+  page_list_push(&pager->wal.row_pages, page_num);
+}
+
+/**
+ * 重做一個列變更訊框中的記錄
+ *
+ * 同一頁面在之後（已提交的範圍內）還有整頁訊框時，記錄已被整頁取代而略過；
+ * 沒有被取代的頁面一定還沒有寫回資料庫檔案，在緩衝池中依序套用。
+ *
+ * @param pager Pager 指標
+ * @param payload 訊框內容
+ * @param frame_index 訊框索引
+ * @param last_images 各頁面最後一個整頁訊框（頁面編號 << 32 | 訊框索引，依頁面排序）
+ * @param num_images last_images 的數量
+ */
+static void wal_redo_rows(Pager *pager, uint8_t *payload, uint32_t frame_index,
+                          uint64_t *last_images, uint32_t num_images) {
+  uint32_t length = *(uint32_t *)payload;
+  uint8_t *record = payload + WAL_ROW_FRAME_LENGTH_SIZE;
+  uint8_t *end = record + length;
+  while (record < end) {
+    uint32_t type = *(uint32_t *)(record + WAL_ROW_TYPE_OFFSET);
+    uint32_t page_num = *(uint32_t *)(record + WAL_ROW_PAGE_NUM_OFFSET);
+    if (type > ROW_CHANGE_DELETE || record + wal_row_record_size(type) > end ||
+        page_num == HEADER_PAGE_NUM || page_num == INVALID_PAGE_NUM) {
+      printf("Error: Write-ahead log '%s' has an invalid row record\n", pager->wal.path);
+      exit(EXIT_FAILURE);
+    }
+
+    // 找出頁面最後一個整頁訊框（上半部為頁面編號，下一個頁面的最小值之前即為該頁面的最大值）
+    uint64_t upper = ((uint64_t)page_num << 32) | UINT32_MAX;
+    uint32_t low = 0;
+    uint32_t high = num_images;
+    while (low < high) {
+      uint32_t mid = low + (high - low) / 2;
+      if (last_images[mid] <= upper) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    bool superseded = low > 0 && (last_images[low - 1] >> 32) == page_num &&
+                      (uint32_t)last_images[low - 1] > frame_index;
+
+    if (!superseded) {
+      if (pager->interleaved_leaves) {
+        // 列變更記錄以目前的葉節點佈局套用，無法重做在舊版佈局的頁面上
+        printf("Error: Write-ahead log '%s' has row records for the old leaf layout\n",
+               pager->wal.path);
+        exit(EXIT_FAILURE);
+      }
+      void *node = get_page(pager, page_num);
+      if (!leaf_node_apply_row_change(node, type,
+                                      *(uint32_t *)(record + WAL_ROW_CELL_NUM_OFFSET),
+                                      *(uint32_t *)(record + WAL_ROW_KEY_OFFSET),
+                                      record + WAL_ROW_HEADER_SIZE)) {
+        printf("Error: Write-ahead log '%s' does not match page %u\n", pager->wal.path,
+               page_num);
+        exit(EXIT_FAILURE);
+      }
+      pager_mark_dirty(pager, page_num);
+      wal_track_row_page(pager, page_num);
+    }
+    record += wal_row_record_size(type);
+  }
+}
+
+/**
+ * 重做日誌中已提交的交易
+ *
+ * 第一輪找出最後一個提交訊框與各頁面最後一個整頁訊框，第二輪依序將到提交訊框
+ * 為止的頁面寫回資料庫檔案（同一頁面較晚的訊框覆蓋較早的訊框），列變更記錄則
+ * 套用在緩衝池中的頁面上。這些頁面先整頁附加到日誌並同步，再寫回資料庫檔案，
+ * 復原途中再次當機時也不會重複套用列變更記錄。完成後同步資料庫檔案並清空日誌。
+ *
+ * @param pager Pager 指標
+ */
+static void wal_recover(Pager *pager) {
+  Wal *wal = &pager->wal;
+  uint32_t salt;
+  if (!wal_read_header(wal, &salt)) {
+    wal_reset(wal);
+    return;
+  }
+  // 日誌開始前資料庫檔案一定已經寫出，空的資料庫檔案表示日誌屬於已刪除的資料庫
+  if (pager->num_pages == 0) {
+    printf("Warning: Ignoring write-ahead log '%s' left by a deleted database\n", wal->path);
+    wal->salt = salt + 1;
+    wal_reset(wal);
+    return;
+  }
+
+  uint8_t frame_header[WAL_FRAME_HEADER_SIZE];
+  void *payload = page_arena_alloc(&pager->arena);
+
+  uint32_t num_frames = 0;
+  uint32_t num_committed = 0;
+  off_t committed_size = WAL_HEADER_SIZE;
+  uint32_t db_size = pager->num_pages;
+  uint64_t *images = NULL;
+  uint32_t num_images = 0;
+  uint32_t images_capacity = 0;
+  off_t offset = WAL_HEADER_SIZE;
+  uint32_t frame_size;
+  while (wal_read_frame(wal, salt, offset, frame_header, payload, &frame_size)) {
+    uint32_t page_num = *wal_frame_page_num(frame_header);
+    if (page_num != WAL_ROW_FRAME) {
+      if (num_images == images_capacity) {
+        images_capacity = images_capacity ? images_capacity * 2 : 64;
+        images = realloc(images, images_capacity * sizeof(uint64_t));
+        if (images == NULL) {
+          printf("Error: Memory allocation failed for write-ahead log recovery\n");
+          exit(EXIT_FAILURE);
+        }
+      }
+      images[num_images++] = ((uint64_t)page_num << 32) | num_frames;
+    }
+    offset += frame_size;
+    num_frames++;
+    if (*wal_frame_db_size(frame_header) != 0) {
+      num_committed = num_frames;
+      committed_size = offset;
+      db_size = *wal_frame_db_size(frame_header);
+    }
+  }
+
+  // 只保留已提交範圍內、每個頁面最後一個整頁訊框
+  uint32_t num_last_images = 0;
+  qsort(images, num_images, sizeof(uint64_t), compare_u64);
+  for (uint32_t i = 0; i < num_images; i++) {
+    if ((uint32_t)images[i] >= num_committed) {
+      continue;
+    }
+    if (num_last_images > 0 && images[num_last_images - 1] >> 32 == images[i] >> 32) {
+      num_last_images--;
+    }
+    images[num_last_images++] = images[i];
+  }
+
+  if (db_size > pager->num_pages) {
+    pager->num_pages = db_size;
+  }
+  offset = WAL_HEADER_SIZE;
+  for (uint32_t i = 0; i < num_committed; i++) {
+    wal_read_frame(wal, salt, offset, frame_header, payload, &frame_size);
+    uint32_t page_num = *wal_frame_page_num(frame_header);
+    if (page_num == WAL_ROW_FRAME) {
+      wal_redo_rows(pager, payload, i, images, num_last_images);
+    } else {
+      pager_write_page(pager, page_num, payload);
+    }
+    offset += frame_size;
+  }
+  page_arena_free(&pager->arena, payload);
+  free(images);
+
+  if (num_committed > 0) {
+    if (wal->row_pages.count > 0) {
+      // 截斷未提交的訊框後，在已提交的訊框之後附加整頁訊框
+      if (ftruncate(wal->file_descriptor, committed_size) == -1) {
+        printf("Error: Failed to truncate '%s': %s\n", wal->path, strerror(errno));
+        exit(EXIT_FAILURE);
+      }
+      wal->salt = salt;
+      wal->num_frames = num_committed;
+      wal->size = committed_size;
+      wal_log_row_pages(pager);
+      sync_file(wal->file_descriptor, "write-ahead log");
+      wal->pending_commits = 0;
+      pager_flush_all(pager);
+    }
+    sync_file(pager->file_descriptor, "database file");
+    pager->needs_sync = false;
+    printf("Note: Recovered %u committed frame(s) from '%s'.\n", num_committed, wal->path);
+  }
+
+  wal->salt = salt + 1;
+  wal_reset(wal);
+}
+
+/**
+ * 開啟資料庫的預寫日誌，重做上次異常結束時留下的已提交交易
+ *
+ * 日誌檔案不存在時不建立，留待第一次提交。
+ *
+ * @param pager Pager 指標
+ * @param filename 資料庫檔案路徑
+ */
+void wal_open(Pager *pager, const char *filename) {
+  Wal *wal = &pager->wal;
+  size_t path_length = strlen(filename) + sizeof("-wal");
+  wal->path = malloc(path_length);
+  if (wal->path == NULL) {
+    printf("Error: Memory allocation failed for write-ahead log path\n");
+    exit(EXIT_FAILURE);
+  }
+  snprintf(wal->path, path_length, "%s-wal", filename);
+
+  wal->salt = 0;
+  wal->num_frames = 0;
+  wal->size = WAL_HEADER_SIZE;
+  wal->row_pages = (PageList){NULL, 0, 0};
+  wal->pending_commits = 0;
+  wal->confirmations = NULL;
+  wal->confirmations_length = 0;
+  wal->confirmations_capacity = 0;
+  wal->commits = 0;
+  wal->frames_written = 0;
+  wal->row_records_written = 0;
+  wal->bytes_written = 0;
+  wal->syncs = 0;
+  wal->checkpoints = 0;
+  wal->file_descriptor = -1;
+
+  // 寫入時複製資料庫的提交本身就不會留下部分寫入的頁面，不使用日誌
+  if (pager->page_map.enabled) {
+    return;
+  }
+
+  wal->file_descriptor = open(wal->path, O_RDWR);
+  if (wal->file_descriptor == -1) {
+    if (errno == ENOENT) {
+      return;
+    }
+    printf("Error: Unable to open write-ahead log '%s': %s\n", wal->path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  wal_recover(pager);
+}
+
+/**
+ * 將日誌同步到磁碟，目前群組中的交易全部持久化，再送出群組的提交確認
+ *
+ * @param wal Wal 指標
+ */
+void wal_sync(Wal *wal) {
+  if (wal->pending_commits == 0) {
+    return;
+  }
+  sync_file(wal->file_descriptor, "write-ahead log");
+  wal->pending_commits = 0;
+  wal->syncs++;
+  if (wal->confirmations_length > 0) {
+    fwrite(wal->confirmations, 1, wal->confirmations_length, stdout);
+    fflush(stdout);
+    wal->confirmations_length = 0;
+  }
+}
+
+/**
+ * 輸出提交確認訊息
+ *
+ * SYNC_FULL 下剛提交的交易還在群組中等待 fsync 時，訊息暫存到 wal_sync 完成後
+ * 才輸出：群組提交中的交易在整組同步之前不會被確認。其他等級本來就不等待
+ * fsync，立即輸出。
+ *
+ * @param pager Pager 指標
+ * @param message 確認訊息（含換行）
+ */
+void wal_confirm_commit(Pager *pager, const char *message) {
+  Wal *wal = &pager->wal;
+  if (pager->sync_level != SYNC_FULL || wal->pending_commits == 0) {
+    fputs(message, stdout);
+    return;
+  }
+  size_t length = strlen(message);
+  if (wal->confirmations_length + length > wal->confirmations_capacity) {
+    size_t capacity = wal->confirmations_capacity ? wal->confirmations_capacity * 2 : 256;
+    while (capacity < wal->confirmations_length + length) {
+      capacity *= 2;
+    }
+    char *confirmations = realloc(wal->confirmations, capacity);
+    if (confirmations == NULL) {
+      printf("Error: Memory allocation failed for commit confirmations\n");
+      exit(EXIT_FAILURE);
+    }
+    wal->confirmations = confirmations;
+    wal->confirmations_capacity = capacity;
+  }
+  memcpy(wal->confirmations + wal->confirmations_length, message, length);
+  wal->confirmations_length += length;
+}
+
+/**
+ * 目前群組距離最長等待時間還剩多久
+ *
+ * @param wal Wal 指標
+ * @return 剩餘毫秒數（沒有待同步的交易或已逾時時為 0）
+ */
+uint32_t wal_group_time_left_ms(Wal *wal) {
+  if (wal->pending_commits == 0) {
+    return 0;
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t elapsed_ms = (int64_t)(now.tv_sec - wal->group_start.tv_sec) * 1000 +
+                       (now.tv_nsec - wal->group_start.tv_nsec) / 1000000;
+  if (elapsed_ms >= (int64_t)wal->group_delay_ms) {
+    return 0;
+  }
+  return wal->group_delay_ms - (uint32_t)elapsed_ms;
+}
+
+/**
+ * 將一個交易修改過的頁面與列變更記錄附加到日誌
+ *
+ * 列變更記錄依記錄邊界切成內容不超過一頁的列變更訊框，接著是整頁訊框；
+ * 所有訊框以連續的 pwritev 寫在日誌尾端，最後一個訊框標記為提交訊框。
+ * 交易的頁面也可以分成多次以 wal_append_frames 附加，只有最後一次標記提交。
+ * 群組提交：寫入後先不 fsync，群組累積到 group_commits 個交易或第一個交易
+ * 已等待 group_delay_ms 時才以一次 fsync 提交整個群組；REPL 在沒有下一個命令
+ * 可執行時也會提早同步（見 main）。
+ * 日誌為空時，日誌開始前的修改（例如交易外的寫入）先寫回並同步資料庫檔案，
+ * 確保復原時只需在資料庫檔案上重做日誌。
+ *
+ * @param pager Pager 指標
+ * @param page_nums 頁面編號
+ * @param pages 頁面內容（與 page_nums 對應）
+ * @param count 頁面數量
+ * @param row_records 連續的列變更記錄（沒有時為 NULL）
+ * @param row_records_size 列變更記錄的總長度
+ */
+void wal_append_commit(Pager *pager, uint32_t *page_nums, void **pages, uint32_t count,
+                       const uint8_t *row_records, uint32_t row_records_size) {
+  wal_append_frames(pager, page_nums, pages, count, row_records, row_records_size, true);
+}
+
+/**
+ * 將訊框附加到日誌，commit 為 true 時最後一個訊框標記為提交訊框（見 wal_append_commit）
+ *
+ * 沒有標記提交的訊框在復原時被捨棄，直到之後的提交訊框為止都屬於同一個交易。
+ *
+ * @param pager Pager 指標
+ * @param page_nums 頁面編號
+ * @param pages 頁面內容（與 page_nums 對應）
+ * @param count 頁面數量
+ * @param row_records 連續的列變更記錄（沒有時為 NULL）
+ * @param row_records_size 列變更記錄的總長度
+ * @param commit 是否為交易的最後一批訊框
+ */
+void wal_append_frames(Pager *pager, uint32_t *page_nums, void **pages, uint32_t count,
+                       const uint8_t *row_records, uint32_t row_records_size, bool commit) {
+  Wal *wal = &pager->wal;
+  if (count == 0 && row_records_size == 0) {
+    return;
+  }
+
+  if (wal->file_descriptor == -1) {
+    wal->file_descriptor = open(wal->path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (wal->file_descriptor == -1) {
+      printf("Error: Unable to create write-ahead log '%s': %s\n", wal->path,
+             strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    wal_reset(wal);
+  }
+
+  if (wal->num_frames == 0) {
+    pager_flush_all(pager);
+    if (pager->needs_sync && pager->sync_level != SYNC_OFF) {
+      sync_file(pager->file_descriptor, "database file");
+      pager->needs_sync = false;
+    }
+  }
+
+  uint32_t num_row_frames = 0;
+  for (uint32_t offset = 0; offset < row_records_size; num_row_frames++) {
+    offset += wal_row_frame_length(row_records, row_records_size, offset);
+  }
+  uint32_t num_frames = num_row_frames + count;
+
+  // 列變更訊框連同標頭複製到連續的緩衝區（記錄本身很小）
+  size_t row_frames_size = (size_t)num_row_frames *
+                               (WAL_FRAME_HEADER_SIZE + WAL_ROW_FRAME_LENGTH_SIZE) +
+                           row_records_size;
+  uint8_t *row_frames = malloc(row_frames_size + 1);
+  uint8_t *frame_headers = malloc((size_t)count * WAL_FRAME_HEADER_SIZE + 1);
+  struct iovec *iov = malloc(((size_t)num_row_frames + (size_t)count * 2) * sizeof(struct iovec));
+  if (row_frames == NULL || frame_headers == NULL || iov == NULL) {
+    printf("Error: Memory allocation failed for write-ahead log frames\n");
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t num_iov = 0;
+  uint32_t frame_index = 0;
+  uint8_t *row_frame = row_frames;
+  for (uint32_t offset = 0; offset < row_records_size; frame_index++) {
+    uint32_t length = wal_row_frame_length(row_records, row_records_size, offset);
+    uint8_t *payload = row_frame + WAL_FRAME_HEADER_SIZE;
+    *wal_frame_page_num(row_frame) = WAL_ROW_FRAME;
+    *wal_frame_db_size(row_frame) =
+        (commit && frame_index == num_frames - 1) ? pager->num_pages : 0;
+    *wal_frame_salt(row_frame) = wal->salt;
+    *(uint32_t *)payload = length;
+    memcpy(payload + WAL_ROW_FRAME_LENGTH_SIZE, row_records + offset, length);
+    *wal_frame_checksum(row_frame) =
+        wal_frame_compute_checksum(row_frame, payload, WAL_ROW_FRAME_LENGTH_SIZE + length);
+    iov[num_iov].iov_base = row_frame;
+    iov[num_iov].iov_len = WAL_FRAME_HEADER_SIZE + WAL_ROW_FRAME_LENGTH_SIZE + length;
+    num_iov++;
+    row_frame += WAL_FRAME_HEADER_SIZE + WAL_ROW_FRAME_LENGTH_SIZE + length;
+    offset += length;
+  }
+  for (uint32_t offset = 0; offset < row_records_size;
+       offset += wal_row_record_size(*(const uint32_t *)(row_records + offset))) {
+    wal->row_records_written++;
+  }
+
+  for (uint32_t i = 0; i < count; i++, frame_index++) {
+    uint8_t *frame_header = frame_headers + (size_t)i * WAL_FRAME_HEADER_SIZE;
+    *wal_frame_page_num(frame_header) = page_nums[i];
+    *wal_frame_db_size(frame_header) =
+        (commit && frame_index == num_frames - 1) ? pager->num_pages : 0;
+    *wal_frame_salt(frame_header) = wal->salt;
+    *wal_frame_checksum(frame_header) =
+        wal_frame_compute_checksum(frame_header, pages[i], PAGE_SIZE);
+    iov[num_iov].iov_base = frame_header;
+    iov[num_iov].iov_len = WAL_FRAME_HEADER_SIZE;
+    iov[num_iov + 1].iov_base = pages[i];
+    iov[num_iov + 1].iov_len = PAGE_SIZE;
+    num_iov += 2;
+  }
+
+  off_t bytes = (off_t)row_frames_size + (off_t)count * (WAL_FRAME_HEADER_SIZE + PAGE_SIZE);
+  wal_write_all(wal, iov, num_iov, wal->size);
+  free(iov);
+  free(frame_headers);
+  free(row_frames);
+
+  wal->size += bytes;
+  wal->num_frames += num_frames;
+  wal->frames_written += num_frames;
+  wal->bytes_written += (uint64_t)bytes;
+  if (!commit) {
+    return;
+  }
+  wal->commits++;
+  if (pager->sync_level == SYNC_OFF) {
+    return;
+  }
+  if (wal->pending_commits++ == 0) {
+    clock_gettime(CLOCK_MONOTONIC, &wal->group_start);
+  }
+  // SYNC_NORMAL 留待檢查點或寫回頁面之前再同步
+  if (pager->sync_level == SYNC_FULL &&
+      (wal->pending_commits >= wal->group_commits || wal_group_time_left_ms(wal) == 0)) {
+    wal_sync(wal);
+  }
+}
+
+/**
+ * 將日誌中只有列變更記錄的頁面整頁附加到日誌（寫回這些頁面之前）
+ *
+ * 列變更記錄不能重複套用：頁面寫回資料庫檔案之後、日誌清空之前當機的話，
+ * 復原時會在已經包含變更的頁面上再套用一次。附加整頁訊框之後，復原時會略過
+ * 同一頁面之前的列變更記錄，頁面也就可以寫回與置換。
+ *
+ * @param pager Pager 指標
+ */
+void wal_log_row_pages(Pager *pager) {
+  PageList *row_pages = &pager->wal.row_pages;
+  if (row_pages->count == 0) {
+    return;
+  }
+
+  // 映射的頁面可能重複出現，排序後去除重複
+  qsort(row_pages->pages, row_pages->count, sizeof(uint32_t), compare_page_nums);
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < row_pages->count; i++) {
+    if (count == 0 || row_pages->pages[count - 1] != row_pages->pages[i]) {
+      row_pages->pages[count++] = row_pages->pages[i];
+    }
+  }
+
+  void **pages = malloc(count * sizeof(void *));
+  if (pages == NULL) {
+    printf("Error: Memory allocation failed for checkpoint page list\n");
+    exit(EXIT_FAILURE);
+  }
+  // 這些頁面不會被置換，取得其他頁面時指標仍然有效
+  for (uint32_t i = 0; i < count; i++) {
+    pages[i] = get_page(pager, row_pages->pages[i]);
+  }
+  wal_append_commit(pager, row_pages->pages, pages, count, NULL, 0);
+  free(pages);
+
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t frame_index = pager_lookup(pager, row_pages->pages[i]);
+    if (frame_index != INVALID_FRAME_INDEX) {
+      pager->frames[frame_index].row_logged = false;
+    }
+  }
+  row_pages->count = 0;
+}
+
+/**
+ * 執行檢查點：將所有髒頁寫回資料庫檔案並同步，然後清空日誌
+ *
+ * SYNC_OFF 不做 fsync；日誌為空時只寫回髒頁。寫入時複製資料庫則提交所有髒頁。
+ * 日誌中只有列變更記錄的頁面先整頁附加到日誌。
+ *
+ * @param pager Pager 指標
+ */
+void pager_checkpoint(Pager *pager) {
+  if (pager->page_map.enabled) {
+    // 寫入時複製模式沒有日誌，檢查點即為提交目前所有的修改
+    page_map_commit(pager);
+    return;
+  }
+
+  wal_log_row_pages(pager);
+  wal_sync(&pager->wal);
+  pager_flush_all(pager);
+  if (pager->needs_sync && pager->sync_level != SYNC_OFF) {
+    sync_file(pager->file_descriptor, "database file");
+    pager->needs_sync = false;
+  }
+  if (pager->wal.num_frames == 0) {
+    return;
+  }
+
+  pager->wal.salt++;
+  wal_reset(&pager->wal);
+  pager->wal.checkpoints++;
+}
+
+/**
+ * 關閉預寫日誌（呼叫前必須先執行檢查點），並刪除已清空的日誌檔案
+ *
+ * @param pager Pager 指標
+ */
+void wal_close(Pager *pager) {
+  Wal *wal = &pager->wal;
+  if (wal->file_descriptor != -1) {
+    close(wal->file_descriptor);
+    if (wal->num_frames == 0) {
+      unlink(wal->path);
+    }
+  }
+  free(wal->path);
+  wal->path = NULL;
+  free(wal->row_pages.pages);
+  wal->row_pages = (PageList){NULL, 0, 0};
+  free(wal->confirmations);
+  wal->confirmations = NULL;
+}
+
+/* ============================================================================
+ * 寫入時複製（Copy-on-Write）
+ * ============================================================================
+ */
+
+/**
+ * 取得 meta 頁中提交版本號的指標
+ */
+uint32_t *cow_meta_generation(void *meta) {
+  return meta + COW_META_GENERATION_OFFSET;
+}
+
+/**
+ * 取得 meta 頁中邏輯頁面總數的指標
+ */
+uint32_t *cow_meta_page_count(void *meta) {
+  return meta + COW_META_PAGE_COUNT_OFFSET;
+}
+
+/**
+ * 取得 meta 頁中對應表頁數量的指標
+ */
+uint32_t *cow_meta_map_page_count(void *meta) {
+  return meta + COW_META_MAP_PAGE_COUNT_OFFSET;
+}
+
+/**
+ * 取得 meta 頁中對應表頁編號陣列的指標
+ */
+uint32_t *cow_meta_map_pages(void *meta) {
+  return meta + COW_META_MAP_PAGES_OFFSET;
+}
+
+/**
+ * 檢查位元圖中的位元
+ */
+static inline bool bitmap_test(const uint64_t *bitmap, uint32_t index) {
+  return (bitmap[index / 64] >> (index % 64)) & 1;
+}
+
+/**
+ * 設定位元圖中的位元
+ */
+static inline void bitmap_set(uint64_t *bitmap, uint32_t index) {
+  bitmap[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+/**
+ * 清除位元圖中的位元
+ */
+static inline void bitmap_clear(uint64_t *bitmap, uint32_t index) {
+  bitmap[index / 64] &= ~((uint64_t)1 << (index % 64));
+}
+
+/**
+ * 確保實體頁面的位元圖涵蓋 slot
+ *
+ * @param map PageMap 指標
+ * @param slot 實體頁面編號
+ */
+static void page_map_reserve_bitmaps(PageMap *map, uint32_t slot) {
+  if (slot < map->bitmap_capacity) {
+    return;
+  }
+
+  uint64_t new_capacity = map->bitmap_capacity ? map->bitmap_capacity : 1024;
+  while (new_capacity <= slot) {
+    new_capacity *= 2;
+  }
+  size_t old_words = map->bitmap_capacity / 64;
+  size_t new_words = (size_t)(new_capacity / 64);
+
+  uint64_t *used = realloc(map->used, new_words * sizeof(uint64_t));
+  uint64_t *fresh = realloc(map->fresh, new_words * sizeof(uint64_t));
+  if (used == NULL || fresh == NULL) {
+    printf("Error: Memory allocation failed for page map bitmaps\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(used + old_words, 0, (new_words - old_words) * sizeof(uint64_t));
+  memset(fresh + old_words, 0, (new_words - old_words) * sizeof(uint64_t));
+  map->used = used;
+  map->fresh = fresh;
+  map->bitmap_capacity = (uint32_t)(new_capacity > UINT32_MAX ? UINT32_MAX : new_capacity);
+}
+
+/**
+ * 確保對應表能以 page_num 索引（容量以對應表頁為單位擴充）
+ *
+ * @param map PageMap 指標
+ * @param page_num 邏輯頁面編號
+ */
+static void page_map_reserve(PageMap *map, uint32_t page_num) {
+  if (page_num < map->capacity) {
+    return;
+  }
+  uint64_t max_pages = (uint64_t)COW_META_MAX_MAP_PAGES * COW_MAP_ENTRIES_PER_PAGE;
+  if (page_num >= max_pages) {
+    printf("Error: Copy-on-write database is full (%llu pages)\n",
+           (unsigned long long)max_pages);
+    exit(EXIT_FAILURE);
+  }
+
+  uint64_t new_capacity = map->capacity ? map->capacity : COW_MAP_ENTRIES_PER_PAGE;
+  while (new_capacity <= page_num) {
+    new_capacity *= 2;
+  }
+  if (new_capacity > max_pages) {
+    new_capacity = max_pages;
+  }
+
+  uint32_t *slots = realloc(map->slots, (size_t)new_capacity * sizeof(uint32_t));
+  if (slots == NULL) {
+    printf("Error: Memory allocation failed for page map\n");
+    exit(EXIT_FAILURE);
+  }
+  memset(slots + map->capacity, 0, (size_t)(new_capacity - map->capacity) * sizeof(uint32_t));
+  map->slots = slots;
+  map->capacity = (uint32_t)new_capacity;
+}
+
+/**
+ * 配置一個空閒的實體頁面（沒有空閒頁面時延長檔案）
+ *
+ * @param map PageMap 指標
+ * @return 實體頁面編號
+ */
+static uint32_t page_map_allocate(PageMap *map) {
+  uint32_t slot = map->alloc_hint;
+  while (slot < map->num_physical) {
+    if (slot % 64 == 0 && map->used[slot / 64] == UINT64_MAX) {
+      slot += 64; // 整個字組都在使用中
+      continue;
+    }
+    if (!bitmap_test(map->used, slot)) {
+      break;
+    }
+    slot++;
+  }
+  if (slot >= map->num_physical) {
+    if (map->num_physical == PAGER_MAX_PAGES) {
+      printf("Error: Copy-on-write database file is full\n");
+      exit(EXIT_FAILURE);
+    }
+    slot = map->num_physical++;
+  }
+
+  page_map_reserve_bitmaps(map, slot);
+  bitmap_set(map->used, slot);
+  bitmap_set(map->fresh, slot);
+  page_list_push(&map->allocated, slot);
+  map->alloc_hint = slot + 1;
+  return slot;
+}
+
+/**
+ * 查詢邏輯頁面目前的實體位置
+ *
+ * @param map PageMap 指標
+ * @param page_num 邏輯頁面編號
+ * @return 實體頁面編號，頁面尚未寫出時返回 INVALID_PAGE_NUM
+ */
+uint32_t page_map_lookup(PageMap *map, uint32_t page_num) {
+  if (page_num >= map->capacity || map->slots[page_num] == 0) {
+    return INVALID_PAGE_NUM;
+  }
+  return map->slots[page_num];
+}
+
+/**
+ * 取得寫出邏輯頁面的實體位置
+ *
+ * 提交後才寫出過的頁面就地覆寫；屬於已提交版本的頁面則配置新的位置，
+ * 舊的位置記錄為已取代，留給仍引用它的版本。
+ *
+ * @param pager Pager 指標
+ * @param page_num 邏輯頁面編號
+ * @return 實體頁面編號
+ */
+uint32_t page_map_assign(Pager *pager, uint32_t page_num) {
+  PageMap *map = &pager->page_map;
+  if (!map->writer_locked || !map->free_space_valid) {
+    printf("Error: Attempted to write page %u without the write lock\n", page_num);
+    exit(EXIT_FAILURE);
+  }
+  page_map_reserve(map, page_num);
+
+  uint32_t slot = map->slots[page_num];
+  if (slot != 0 && bitmap_test(map->fresh, slot)) {
+    return slot;
+  }
+  if (slot != 0) {
+    page_list_push(&map->released, slot);
+  }
+  slot = page_map_allocate(map);
+  map->slots[page_num] = slot;
+  map->map_dirty[page_num / COW_MAP_ENTRIES_PER_PAGE] = true;
+  return slot;
+}
+
+/**
+ * 寫出 meta 頁
+ *
+ * @param pager Pager 指標
+ * @param slot meta 頁的位置（0 或 1）
+ * @param meta 頁面緩衝區
+ * @param generation 提交版本號
+ * @param num_map_pages 對應表頁數量
+ */
+static void page_map_write_meta(Pager *pager, uint32_t slot, void *meta, uint32_t generation,
+                                uint32_t num_map_pages) {
+  PageMap *map = &pager->page_map;
+  memset(meta, 0, PAGE_SIZE);
+  memcpy(meta + HEADER_MAGIC_OFFSET, COW_META_MAGIC, HEADER_MAGIC_SIZE);
+  *header_format_version(meta) = DB_FORMAT_VERSION;
+  *header_page_size(meta) = PAGE_SIZE;
+  *cow_meta_generation(meta) = generation;
+  *cow_meta_page_count(meta) = pager->num_pages;
+  *cow_meta_map_page_count(meta) = num_map_pages;
+  memcpy(cow_meta_map_pages(meta), map->map_slots, num_map_pages * sizeof(uint32_t));
+  page_set_checksum(slot, meta);
+  pager_write_slot_page(pager, slot, meta);
+}
+
+/**
+ * 讀取並驗證 meta 頁
+ *
+ * @param pager Pager 指標
+ * @param slot meta 頁的位置（0 或 1）
+ * @param meta 頁面緩衝區
+ * @return 是否為完整且有效的 meta 頁
+ */
+static bool page_map_read_meta(Pager *pager, uint32_t slot, void *meta) {
+  ssize_t bytes_read = pread(pager->file_descriptor, meta, PAGE_SIZE, pager_page_offset(slot));
+  return bytes_read == (ssize_t)PAGE_SIZE &&
+         memcmp(meta + HEADER_MAGIC_OFFSET, COW_META_MAGIC, HEADER_MAGIC_SIZE) == 0 &&
+         *page_checksum_field(meta) == page_checksum(slot, meta) &&
+         *header_page_size(meta) == PAGE_SIZE &&
+         *cow_meta_map_page_count(meta) <= COW_META_MAX_MAP_PAGES &&
+         *cow_meta_page_count(meta) <=
+             (uint64_t)*cow_meta_map_page_count(meta) * COW_MAP_ENTRIES_PER_PAGE;
+}
+
+/**
+ * 找出校驗碼正確且版本最新的 meta 頁（版本號以序列算術比較，溢位後仍然正確）
+ *
+ * @param pager Pager 指標
+ * @param scratch 讀取用的頁面緩衝區
+ * @param meta 複製最新 meta 頁的緩衝區（NULL 表示只需要版本號）
+ * @param generation 輸出最新的版本號
+ * @param meta_slot 輸出最新 meta 頁的位置（可為 NULL）
+ * @return 是否找到有效的 meta 頁
+ */
+static bool page_map_find_newest_meta(Pager *pager, void *scratch, void *meta,
+                                      uint32_t *generation, uint32_t *meta_slot) {
+  bool found = false;
+  for (uint32_t slot = 0; slot < COW_META_SLOTS; slot++) {
+    if (!page_map_read_meta(pager, slot, scratch)) {
+      continue;
+    }
+    if (!found || (int32_t)(*cow_meta_generation(scratch) - *generation) > 0) {
+      found = true;
+      *generation = *cow_meta_generation(scratch);
+      if (meta_slot != NULL) {
+        *meta_slot = slot;
+      }
+      if (meta != NULL) {
+        memcpy(meta, scratch, PAGE_SIZE);
+      }
+    }
+  }
+  return found;
+}
+
+/**
+ * 更新本行程在讀取者表中的項目
+ *
+ * @param map PageMap 指標
+ * @param generation 釘選的版本號
+ * @param active 是否正在讀取（語句或交易進行中）
+ */
+static void page_map_publish(PageMap *map, uint32_t generation, bool active) {
+  uint32_t entry[2] = {generation, active ? 1 : 0};
+  off_t offset = COW_READERS_SLOTS_OFFSET + (off_t)map->reader_slot * COW_READERS_SLOT_SIZE;
+  if (pwrite(map->readers_fd, entry, sizeof(entry), offset) != (ssize_t)sizeof(entry)) {
+    printf("Error: Failed to update reader table: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * 掃描讀取者表中其他行程正在讀取的版本
+ *
+ * 項目的 fcntl 鎖已經釋放（行程已結束）時忽略該項目。
+ *
+ * @param map PageMap 指標
+ * @param oldest 傳入目前的下限，輸出它與其他讀取者釘選的版本中最舊的一個
+ * @return 其他正在讀取的行程數量
+ */
+static uint32_t page_map_scan_readers(PageMap *map, uint32_t *oldest) {
+  uint32_t entries[COW_READERS_MAX_SLOTS * 2];
+  ssize_t bytes_read = pread(map->readers_fd, entries, sizeof(entries),
+                             COW_READERS_SLOTS_OFFSET);
+  if (bytes_read < 0) {
+    printf("Error: Failed to read reader table: %s\n", strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  uint32_t num_readers = 0;
+  uint32_t num_slots = (uint32_t)bytes_read / COW_READERS_SLOT_SIZE;
+  for (uint32_t i = 0; i < num_slots; i++) {
+    if (i == map->reader_slot || entries[i * 2 + 1] == 0) {
+      continue;
+    }
+    struct flock lock = {0};
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = COW_READERS_SLOTS_OFFSET + (off_t)i * COW_READERS_SLOT_SIZE;
+    lock.l_len = COW_READERS_SLOT_SIZE;
+    if (fcntl(map->readers_fd, F_GETLK, &lock) == -1 || lock.l_type == F_UNLCK) {
+      continue;
+    }
+    uint32_t generation = entries[i * 2];
+    if ((int32_t)(generation - *oldest) < 0) {
+      *oldest = generation;
+    }
+    num_readers++;
+  }
+  return num_readers;
+}
+
+/**
+ * 開啟讀取者表並佔用一個項目
+ *
+ * @param map PageMap 指標
+ * @param filename 資料庫檔案路徑
+ */
+static void page_map_open_readers(PageMap *map, const char *filename) {
+  size_t path_length = strlen(filename) + sizeof("-readers");
+  char *path = malloc(path_length);
+  if (path == NULL) {
+    printf("Error: Memory allocation failed for reader table path\n");
+    exit(EXIT_FAILURE);
+  }
+  snprintf(path, path_length, "%s-readers", filename);
+
+  map->readers_fd = open(path, O_RDWR | O_CREAT, S_IWUSR | S_IRUSR);
+  if (map->readers_fd == -1) {
+    printf("Error: Unable to open reader table '%s': %s\n", path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+
+  for (uint32_t i = 0; i < COW_READERS_MAX_SLOTS; i++) {
+    struct flock lock = {0};
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = COW_READERS_SLOTS_OFFSET + (off_t)i * COW_READERS_SLOT_SIZE;
+    lock.l_len = COW_READERS_SLOT_SIZE;
+    if (fcntl(map->readers_fd, F_SETLK, &lock) == 0) {
+      map->reader_slot = i;
+      free(path);
+      return;
+    }
+    if (errno != EACCES && errno != EAGAIN) {
+      printf("Error: Unable to lock reader table '%s': %s\n", path, strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+  }
+  printf("Error: Too many processes have '%s' open (at most %d)\n", filename,
+         COW_READERS_MAX_SLOTS);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * 釘選最新提交的版本
+ *
+ * 先在讀取者表中寫入版本號，再確認它仍是最新的版本：寫入者在寫出新的 meta 頁
+ * 之後才掃描讀取者表決定可重用的頁面，因此確認通過時，這個版本的頁面都不會被重用。
+ *
+ * @param pager Pager 指標
+ * @param meta 輸出最新 meta 頁的緩衝區
+ * @param scratch 讀取用的頁面緩衝區
+ * @return 最新 meta 頁的位置
+ */
+static uint32_t page_map_pin_newest(Pager *pager, void *meta, void *scratch) {
+  PageMap *map = &pager->page_map;
+  while (true) {
+    uint32_t generation = 0;
+    uint32_t meta_slot = 0;
+    if (!page_map_find_newest_meta(pager, scratch, meta, &generation, &meta_slot)) {
+      printf("Error: Database file '%s' has no valid copy-on-write meta page\n", map->path);
+      exit(EXIT_FAILURE);
+    }
+    page_map_publish(map, generation, true);
+
+    uint32_t newest = 0;
+    if (page_map_find_newest_meta(pager, scratch, NULL, &newest, NULL) &&
+        newest == generation) {
+      return meta_slot;
+    }
+  }
+}
+
+/**
+ * 載入 meta 頁所描述的版本（邏輯頁面總數與對應表）
+ *
+ * @param pager Pager 指標
+ * @param meta meta 頁
+ * @param meta_slot meta 頁的位置
+ * @param scratch 讀取用的頁面緩衝區
+ */
+static void page_map_load_version(Pager *pager, void *meta, uint32_t meta_slot,
+                                  void *scratch) {
+  PageMap *map = &pager->page_map;
+  map->generation = *cow_meta_generation(meta);
+  map->meta_slot = meta_slot;
+  pager->num_pages = *cow_meta_page_count(meta);
+  map->committed_pages = pager->num_pages;
+
+  // 其他行程可能已經延長檔案
+  struct stat st;
+  if (fstat(pager->file_descriptor, &st) == 0 &&
+      st.st_size / PAGE_SIZE > (off_t)map->num_physical) {
+    map->num_physical = (uint32_t)(st.st_size / PAGE_SIZE);
+  }
+
+  uint32_t num_map_pages = *cow_meta_map_page_count(meta);
+  memset(map->map_slots, 0, COW_META_MAX_MAP_PAGES * sizeof(uint32_t));
+  memset(map->map_dirty, 0, COW_META_MAX_MAP_PAGES * sizeof(bool));
+  memcpy(map->map_slots, cow_meta_map_pages(meta), num_map_pages * sizeof(uint32_t));
+  if (num_map_pages > 0) {
+    page_map_reserve(map, num_map_pages * COW_MAP_ENTRIES_PER_PAGE - 1);
+  }
+  if (map->capacity > 0) {
+    memset(map->slots, 0, (size_t)map->capacity * sizeof(uint32_t));
+  }
+
+  for (uint32_t i = 0; i < num_map_pages; i++) {
+    uint32_t slot = map->map_slots[i];
+    ssize_t bytes_read = -1;
+    if (slot >= COW_META_SLOTS && slot < map->num_physical) {
+      bytes_read = pread(pager->file_descriptor, scratch, PAGE_SIZE, pager_page_offset(slot));
+    }
+    if (bytes_read != (ssize_t)PAGE_SIZE ||
+        *page_checksum_field(scratch) != page_checksum(slot, scratch)) {
+      printf("Error: Database file '%s' is corrupted (invalid page map page %u)\n",
+             map->path, slot);
+      exit(EXIT_FAILURE);
+    }
+    memcpy(map->slots + (size_t)i * COW_MAP_ENTRIES_PER_PAGE, scratch,
+           COW_MAP_ENTRIES_PER_PAGE * sizeof(uint32_t));
+  }
+}
+
+/**
+ * 載入寫入時複製資料庫的頁面對應表
+ *
+ * 新檔案寫出兩個第 0 版（沒有任何頁面）的 meta 頁。既有檔案使用有效且版本
+ * 較新的 meta 頁（另一個可能在寫出時中斷），並在讀取者表中釘選這個版本。
+ * 實體頁面的使用狀況在第一次取得寫入鎖時才建立（page_map_prepare_write）。
+ *
+ * @param pager Pager 指標
+ * @param filename 資料庫檔案路徑（用於錯誤訊息）
+ */
+void page_map_open(Pager *pager, const char *filename) {
+  PageMap *map = &pager->page_map;
+  map->slots = NULL;
+  map->capacity = 0;
+  map->map_slots = calloc(COW_META_MAX_MAP_PAGES, sizeof(uint32_t));
+  map->map_dirty = calloc(COW_META_MAX_MAP_PAGES, sizeof(bool));
+  map->path = strdup(filename);
+  if (map->map_slots == NULL || map->map_dirty == NULL || map->path == NULL) {
+    printf("Error: Memory allocation failed for page map\n");
+    exit(EXIT_FAILURE);
+  }
+  map->used = NULL;
+  map->fresh = NULL;
+  map->bitmap_capacity = 0;
+  map->num_physical = pager->num_pages;
+  map->alloc_hint = COW_META_SLOTS;
+  map->allocated = (PageList){NULL, 0, 0};
+  map->released = (PageList){NULL, 0, 0};
+  map->retired = (PageList){NULL, 0, 0};
+  map->retired_generations = (PageList){NULL, 0, 0};
+  map->writer_locked = false;
+  map->free_space_valid = false;
+  map->commits = 0;
+  map->map_pages_written = 0;
+  map->snapshots_loaded = 0;
+  page_map_open_readers(map, filename);
+
+  void *meta = page_arena_alloc(&pager->arena);
+  if (map->num_physical == 0) {
+    pager->num_pages = 0;
+    map->generation = 0;
+    map->meta_slot = 0;
+    map->committed_pages = 0;
+    for (uint32_t slot = 0; slot < COW_META_SLOTS; slot++) {
+      page_map_write_meta(pager, slot, meta, 0, 0);
+    }
+    map->num_physical = COW_META_SLOTS;
+    page_map_publish(map, 0, true);
+    page_arena_free(&pager->arena, meta);
+    return;
+  }
+
+  void *scratch = page_arena_alloc(&pager->arena);
+  uint32_t meta_slot = page_map_pin_newest(pager, meta, scratch);
+  page_map_load_version(pager, meta, meta_slot, scratch);
+  page_arena_free(&pager->arena, scratch);
+  page_arena_free(&pager->arena, meta);
+}
+
+/**
+ * 語句開始時切換到最新提交的版本並釘選它
+ *
+ * 其他行程提交了新的版本時重新載入對應表並丟棄緩衝池中的頁面。
+ * 持有寫入鎖時不可呼叫（寫入者的版本就是最新的版本）。
+ *
+ * @param pager Pager 指標
+ * @return 是否切換到不同的版本（呼叫者需重新讀取標頭頁等內容）
+ */
+bool page_map_refresh(Pager *pager) {
+  PageMap *map = &pager->page_map;
+  void *meta = page_arena_alloc(&pager->arena);
+  void *scratch = page_arena_alloc(&pager->arena);
+  uint32_t meta_slot = page_map_pin_newest(pager, meta, scratch);
+  bool changed = (*cow_meta_generation(meta) != map->generation);
+  if (changed) {
+    pager_discard_frames(pager);
+    page_map_load_version(pager, meta, meta_slot, scratch);
+    map->free_space_valid = false;
+    map->snapshots_loaded++;
+  }
+  page_arena_free(&pager->arena, scratch);
+  page_arena_free(&pager->arena, meta);
+  return changed;
+}
+
+/**
+ * 語句（或交易）結束時解除釘選，寫入者之後可以重用這個版本的頁面
+ *
+ * @param pager Pager 指標
+ */
+void page_map_release_snapshot(Pager *pager) {
+  PageMap *map = &pager->page_map;
+  page_map_publish(map, map->generation, false);
+}
+
+/**
+ * 檢查是否有尚未提交的修改
+ *
+ * @param pager Pager 指標
+ * @return 是否有髒頁、已寫出但尚未提交的頁面或新增的頁面
+ */
+bool page_map_has_changes(Pager *pager) {
+  PageMap *map = &pager->page_map;
+  return pager->num_dirty > 0 || map->allocated.count > 0 ||
+         pager->num_pages != map->committed_pages;
+}
+
+/**
+ * 嘗試取得寫入鎖（不等待）
+ *
+ * @param pager Pager 指標
+ * @return 是否取得寫入鎖（其他行程持有時返回 false）
+ */
+bool page_map_lock_writer(Pager *pager) {
+  PageMap *map = &pager->page_map;
+  if (map->writer_locked) {
+    return true;
+  }
+  struct flock lock = {0};
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = COW_READERS_WRITER_LOCK_OFFSET;
+  lock.l_len = 1;
+  if (fcntl(map->readers_fd, F_SETLK, &lock) == -1) {
+    if (errno == EACCES || errno == EAGAIN) {
+      return false;
+    }
+    printf("Error: Unable to lock '%s': %s\n", map->path, strerror(errno));
+    exit(EXIT_FAILURE);
+  }
+  map->writer_locked = true;
+  return true;
+}
+
+/**
+ * 釋放寫入鎖（所有修改都必須已經提交）
+ *
+ * @param pager Pager 指標
+ */
+void page_map_unlock_writer(Pager *pager) {
+  PageMap *map = &pager->page_map;
+  if (!map->writer_locked) {
+    return;
+  }
+  struct flock lock = {0};
+  lock.l_type = F_UNLCK;
+  lock.l_whence = SEEK_SET;
+  lock.l_start = COW_READERS_WRITER_LOCK_OFFSET;
+  lock.l_len = 1;
+  fcntl(map->readers_fd, F_SETLK, &lock);
+  map->writer_locked = false;
+}
+
+/**
+ * 檢查釘選的版本是否已不是最新提交的版本
+ *
+ * @param pager Pager 指標
+ * @return 其他行程是否已提交較新的版本
+ */
+bool page_map_is_stale(Pager *pager) {
+  PageMap *map = &pager->page_map;
+  void *scratch = page_arena_alloc(&pager->arena);
+  uint32_t newest = 0;
+  bool found = page_map_find_newest_meta(pager, scratch, NULL, &newest, NULL);
+  page_arena_free(&pager->arena, scratch);
+  return found && newest != map->generation;
+}
+
+/**
+ * 取得寫入鎖後，建立目前版本的實體頁面使用狀況
+ *
+ * 目前版本引用的頁面（meta 頁、對應表頁、資料頁）標記為使用中。其他行程仍在
+ * 讀取較舊的版本時，無法得知它們引用哪些頁面，沒有被目前版本引用的頁面也先
+ * 保留，等到那些讀取者結束才重用。本行程上次釋放寫入鎖後沒有其他行程提交時，
+ * 保留原本的使用狀況。
+ *
+ * @param pager Pager 指標
+ */
+void page_map_prepare_write(Pager *pager) {
+  PageMap *map = &pager->page_map;
+  struct stat st;
+  if (fstat(pager->file_descriptor, &st) == 0 &&
+      st.st_size / PAGE_SIZE > (off_t)map->num_physical) {
+    map->num_physical = (uint32_t)(st.st_size / PAGE_SIZE);
+  }
+  if (map->free_space_valid) {
+    page_map_reserve_bitmaps(map, map->num_physical);
+    return;
+  }
+
+  page_map_reserve_bitmaps(map, map->num_physical);
+  memset(map->used, 0, map->bitmap_capacity / 64 * sizeof(uint64_t));
+  memset(map->fresh, 0, map->bitmap_capacity / 64 * sizeof(uint64_t));
+  map->allocated.count = 0;
+  map->released.count = 0;
+  map->retired.count = 0;
+  map->retired_generations.count = 0;
+  for (uint32_t slot = 0; slot < COW_META_SLOTS; slot++) {
+    bitmap_set(map->used, slot);
+  }
+
+  uint32_t num_map_pages =
+      (map->committed_pages + COW_MAP_ENTRIES_PER_PAGE - 1) / COW_MAP_ENTRIES_PER_PAGE;
+  for (uint32_t i = 0; i < num_map_pages; i++) {
+    bitmap_set(map->used, map->map_slots[i]);
+  }
+  for (uint32_t page_num = 0; page_num < map->committed_pages; page_num++) {
+    uint32_t slot = map->slots[page_num];
+    if (slot == 0) {
+      continue;
+    }
+    if (slot < COW_META_SLOTS || slot >= map->num_physical || bitmap_test(map->used, slot)) {
+      printf("Error: Database file '%s' is corrupted (page %u mapped to invalid page %u)\n",
+             map->path, page_num, slot);
+      exit(EXIT_FAILURE);
+    }
+    bitmap_set(map->used, slot);
+  }
+
+  uint32_t oldest = map->generation;
+  page_map_scan_readers(map, &oldest);
+  if ((int32_t)(oldest - map->generation) < 0) {
+    for (uint32_t slot = COW_META_SLOTS; slot < map->num_physical; slot++) {
+      if (!bitmap_test(map->used, slot)) {
+        bitmap_set(map->used, slot);
+        page_list_push(&map->retired, slot);
+        page_list_push(&map->retired_generations, map->generation);
+      }
+    }
+  }
+  map->alloc_hint = COW_META_SLOTS;
+  map->free_space_valid = true;
+
+  // 前一個版本的頁面即將被重用，先確保目前的 meta 頁已經落盤
+  if (pager->sync_level != SYNC_OFF) {
+    sync_file(pager->file_descriptor, "database file");
+  }
+}
+
+/**
+ * 重用不再被任何版本引用的實體頁面
+ *
+ * 被第 G 版取代的頁面仍屬於第 G-1 版，等到另一個 meta 頁也不再指向第 G-1 版
+ * （即提交第 G+1 版之後），且其他行程釘選的版本都不早於第 G 版時才重用。
+ *
+ * @param map PageMap 指標
+ */
+static void page_map_reclaim(PageMap *map) {
+  uint32_t limit = map->generation - 1;
+  if (map->retired.count == 0 ||
+      (int32_t)(limit - map->retired_generations.pages[0]) < 0) {
+    return;
+  }
+  uint32_t oldest = limit;
+  page_map_scan_readers(map, &oldest);
+  if ((int32_t)(oldest - limit) < 0) {
+    limit = oldest;
+  }
+
+  uint32_t count = 0;
+  while (count < map->retired.count &&
+         (int32_t)(limit - map->retired_generations.pages[count]) >= 0) {
+    uint32_t slot = map->retired.pages[count++];
+    bitmap_clear(map->used, slot);
+    if (slot < map->alloc_hint) {
+      map->alloc_hint = slot;
+    }
+  }
+  map->retired.count -= count;
+  map->retired_generations.count -= count;
+  memmove(map->retired.pages, map->retired.pages + count,
+          map->retired.count * sizeof(uint32_t));
+  memmove(map->retired_generations.pages, map->retired_generations.pages + count,
+          map->retired_generations.count * sizeof(uint32_t));
+}
+
+/**
+ * 提交寫入時複製資料庫目前的所有修改
+ *
+ * 1. 髒頁寫到新的實體位置（pager_flush_all）
+ * 2. 有變更的對應表頁同樣寫到新的位置
+ * 3. fsync 後才寫出指向新對應表的 meta 頁（與上一個 meta 頁輪流使用）
+ *
+ * meta 頁寫出前異常結束時，檔案仍是上一個版本；寫出中斷的 meta 頁校驗碼不符，
+ * 開啟時退回另一個 meta 頁。SYNC_FULL 在 meta 頁寫出後再 fsync 一次，
+ * SYNC_NORMAL 留待下一次提交或檢查點，SYNC_OFF 完全不 fsync。
+ *
+ * @param pager Pager 指標
+ */
+void page_map_commit(Pager *pager) {
+  PageMap *map = &pager->page_map;
+  pager_flush_all(pager);
+
+  uint32_t num_map_pages =
+      (pager->num_pages + COW_MAP_ENTRIES_PER_PAGE - 1) / COW_MAP_ENTRIES_PER_PAGE;
+  bool changed = (pager->num_pages != map->committed_pages);
+  for (uint32_t i = 0; i < num_map_pages && !changed; i++) {
+    changed = map->map_dirty[i] || map->map_slots[i] == 0;
+  }
+  if (!changed) {
+    if (pager->needs_sync && pager->sync_level != SYNC_OFF) {
+      sync_file(pager->file_descriptor, "database file");
+      pager->needs_sync = false;
+    }
+    return;
+  }
+  page_map_reserve(map, pager->num_pages - 1);
+
+  void *page = page_arena_alloc(&pager->arena);
+  for (uint32_t i = 0; i < num_map_pages; i++) {
+    if (!map->map_dirty[i] && map->map_slots[i] != 0) {
+      continue;
+    }
+    uint32_t slot = page_map_allocate(map);
+    if (map->map_slots[i] != 0) {
+      page_list_push(&map->released, map->map_slots[i]);
+    }
+    memcpy(page, map->slots + (size_t)i * COW_MAP_ENTRIES_PER_PAGE,
+           COW_MAP_ENTRIES_PER_PAGE * sizeof(uint32_t));
+    page_set_checksum(slot, page);
+    pager_write_slot_page(pager, slot, page);
+    map->map_slots[i] = slot;
+    map->map_dirty[i] = false;
+    map->map_pages_written++;
+  }
+
+  // meta 頁只能在它引用的頁面都落盤之後寫出
+  if (pager->sync_level != SYNC_OFF) {
+    sync_file(pager->file_descriptor, "database file");
+  }
+  uint32_t meta_slot = map->meta_slot ^ 1;
+  page_map_write_meta(pager, meta_slot, page, map->generation + 1, num_map_pages);
+  page_arena_free(&pager->arena, page);
+  if (pager->sync_level == SYNC_FULL) {
+    sync_file(pager->file_descriptor, "database file");
+  }
+  pager->needs_sync = (pager->sync_level == SYNC_NORMAL);
+
+  map->meta_slot = meta_slot;
+  map->generation++;
+  map->committed_pages = pager->num_pages;
+  map->commits++;
+
+  // 這次取代的頁面仍屬於另一個 meta 頁的版本；新的 meta 頁寫出之後才掃描讀取者表，
+  // 之後才釘選的讀取者一定會看到新的版本
+  for (uint32_t i = 0; i < map->released.count; i++) {
+    page_list_push(&map->retired, map->released.pages[i]);
+    page_list_push(&map->retired_generations, map->generation);
+  }
+  map->released.count = 0;
+  page_map_reclaim(map);
+
+  for (uint32_t i = 0; i < map->allocated.count; i++) {
+    bitmap_clear(map->fresh, map->allocated.pages[i]);
+  }
+  map->allocated.count = 0;
+}
+
+/**
+ * 釋放頁面對應表的記憶體（呼叫前必須先提交）
+ *
+ * @param pager Pager 指標
+ */
+void page_map_close(Pager *pager) {
+  PageMap *map = &pager->page_map;
+  if (!map->enabled) {
+    return;
+  }
+  free(map->slots);
+  free(map->map_slots);
+  free(map->map_dirty);
+  free(map->used);
+  free(map->fresh);
+  free(map->allocated.pages);
+  free(map->released.pages);
+  free(map->retired.pages);
+  free(map->retired_generations.pages);
+  free(map->path);
+  // 關閉讀取者表同時釋放寫入鎖與佔用的項目
+  close(map->readers_fd);
+}
+
+/* ============================================================================
+ * 交易管理（Transaction Management）
+ * ============================================================================
+ */
+
+/**
+ * 檢查是否在交易中
+ *
+ * @param table Table 指標
+ * @return 是否在交易中
+ */
+bool is_in_transaction(Table *table) {
+  return table->transaction && table->transaction->state == TXN_STATE_ACTIVE;
+}
+
+/**
+ * 開始一個新交易
+ *
+ * @param table Table 指標
+ * @return Transaction 指標
+ */
+Transaction *transaction_begin(Table *table) {
+  if (is_in_transaction(table)) {
+    printf("Error: Transaction already in progress.\n");
+    return NULL;
+  }
+
+  Transaction *txn = table->transaction;
+  txn->state = TXN_STATE_ACTIVE;
+  txn->start_num_pages = table->pager->num_pages;
   
-  // 初始化交易結構
-  table->transaction = malloc(sizeof(Transaction));
-  if (table->transaction == NULL) {
-    printf("Error: Memory allocation failed for transaction\n");
-    close(pager->file_descriptor);
-    free(pager);
-    free(table);
+  // 清空影子頁面
+  transaction_clear(txn, table->pager);
+
+  return txn;
+}
+
+/**
+ * 計算頁面編號在影子頁面雜湊表中的桶索引
+ */
+static inline uint32_t transaction_hash(Transaction *txn, uint32_t page_num) {
+  return (page_num * 2654435761u) & txn->shadow_table_mask;
+}
+
+/**
+ * 查找交易修改過的頁面
+ *
+ * @param txn Transaction 指標
+ * @param page_num 頁面編號
+ * @return shadows 索引，交易沒有修改該頁面時返回 INVALID_SHADOW_INDEX
+ */
+static uint32_t transaction_find_page(Transaction *txn, uint32_t page_num) {
+  if (txn->num_modified == 0) {
+    return INVALID_SHADOW_INDEX;
+  }
+  uint32_t index = txn->shadow_table[transaction_hash(txn, page_num)];
+  while (index != INVALID_SHADOW_INDEX && txn->shadows[index].page_num != page_num) {
+    index = txn->shadows[index].hash_next;
+  }
+  return index;
+}
+
+/**
+ * 頁面在交易中是否有影子頁面（在記憶體中或已溢出到暫存檔）
+ */
+static inline bool transaction_has_shadow(const ShadowPage *shadow) {
+  return shadow->data != NULL || shadow->spilled;
+}
+
+/**
+ * 擴充影子頁面陣列並重新建立雜湊表，桶數量為容量的兩倍
+ *
+ * @param txn Transaction 指標
+ */
+static void transaction_grow(Transaction *txn) {
+  uint32_t new_capacity = txn->shadow_capacity ? txn->shadow_capacity * 2 : 16;
+  uint32_t num_buckets = new_capacity * 2;
+
+  ShadowPage *shadows = realloc(txn->shadows, new_capacity * sizeof(ShadowPage));
+  uint32_t *shadow_table = realloc(txn->shadow_table, num_buckets * sizeof(uint32_t));
+  if (shadows == NULL || shadow_table == NULL) {
+    printf("Error: Memory allocation failed for transaction page table\n");
+    exit(EXIT_FAILURE);
+  }
+  txn->shadows = shadows;
+  txn->shadow_table = shadow_table;
+  txn->shadow_capacity = new_capacity;
+  txn->shadow_table_mask = num_buckets - 1;
+
+  for (uint32_t i = 0; i < num_buckets; i++) {
+    shadow_table[i] = INVALID_SHADOW_INDEX;
+  }
+  for (uint32_t i = 0; i < txn->num_modified; i++) {
+    uint32_t bucket = transaction_hash(txn, shadows[i].page_num);
+    shadows[i].hash_next = shadow_table[bucket];
+    shadow_table[bucket] = i;
+  }
+}
+
+/**
+ * 記錄交易中新修改的頁面
+ *
+ * @param txn Transaction 指標
+ * @param page_num 頁面編號
+ * @param data 影子頁面（以列變更記錄修改時為 NULL）
+ * @param pinned 以列變更記錄修改的頁面的釘選（影子頁面的 data 為 NULL）
+ */
+static void transaction_add_page(Transaction *txn, uint32_t page_num, void *data,
+                                 PageHandle pinned) {
+  if (txn->num_modified == txn->shadow_capacity) {
+    transaction_grow(txn);
+  }
+
+  uint32_t index = txn->num_modified++;
+  uint32_t bucket = transaction_hash(txn, page_num);
+  txn->shadows[index].page_num = page_num;
+  txn->shadows[index].data = data;
+  txn->shadows[index].pinned = pinned;
+  txn->shadows[index].hash_next = txn->shadow_table[bucket];
+  txn->shadows[index].savepoint_id = 0;
+  txn->shadows[index].pin_count = 0;
+  txn->shadows[index].referenced = true;
+  txn->shadows[index].spilled = false;
+  txn->shadows[index].spill_current = false;
+  txn->shadow_table[bucket] = index;
+}
+
+/**
+ * 將一個影子頁面溢出到暫存檔並釋放它的記憶體
+ *
+ * 暫存檔在第一次溢出時建立並立即刪除目錄項目，交易結束時關閉即釋放空間。
+ * 影子頁面在暫存檔中的位置就是它在 shadows 中的索引，不需要另外配置。
+ *
+ * @param txn Transaction 指標
+ * @param pager 影子頁面所屬的 Pager
+ * @param index 影子頁面索引
+ */
+static void transaction_spill_shadow(Transaction *txn, Pager *pager, uint32_t index) {
+  ShadowPage *shadow = &txn->shadows[index];
+  if (txn->spill_fd == -1) {
+    char *path = strdup(txn->spill_path);
+    if (path == NULL) {
+      printf("Error: Memory allocation failed for spill file path\n");
+      exit(EXIT_FAILURE);
+    }
+    txn->spill_fd = mkstemp(path);
+    if (txn->spill_fd == -1) {
+      printf("Error: Unable to create transaction spill file '%s': %s\n", path,
+             strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    unlink(path);
+    free(path);
+  }
+
+  if (!shadow->spill_current) {
+    ssize_t bytes_written = pwrite(txn->spill_fd, shadow->data, PAGE_SIZE,
+                                   (off_t)index * PAGE_SIZE);
+    if (bytes_written != (ssize_t)PAGE_SIZE) {
+      printf("Error: Failed to write transaction spill file: %s\n",
+             bytes_written == -1 ? strerror(errno) : "short write");
+      exit(EXIT_FAILURE);
+    }
+    txn->spill_writes++;
+  }
+  page_arena_free(&pager->arena, shadow->data);
+  shadow->data = NULL;
+  shadow->spilled = true;
+  shadow->spill_current = true;
+  txn->num_resident_shadows--;
+  txn->num_spilled++;
+}
+
+/**
+ * 記憶體中的影子頁面達到上限時，依 CLOCK 溢出一個未被釘選的影子頁面
+ *
+ * 所有影子頁面都被釘選時暫時超出上限。
+ *
+ * @param txn Transaction 指標
+ * @param pager 影子頁面所屬的 Pager
+ */
+static void transaction_make_room(Transaction *txn, Pager *pager) {
+  if (txn->num_resident_shadows + txn->num_row_pages < txn->max_shadow_pages) {
+    return;
+  }
+  // 最多繞兩圈：第一圈清除參考位元，第二圈一定找得到未被釘選的頁面（如果有的話）
+  for (uint32_t scanned = 0; scanned < txn->num_modified * 2; scanned++) {
+    if (txn->spill_clock_hand >= txn->num_modified) {
+      txn->spill_clock_hand = 0;
+    }
+    uint32_t index = txn->spill_clock_hand++;
+    ShadowPage *shadow = &txn->shadows[index];
+    if (shadow->data == NULL || shadow->pin_count > 0) {
+      continue;
+    }
+    if (shadow->referenced) {
+      shadow->referenced = false;
+      continue;
+    }
+    transaction_spill_shadow(txn, pager, index);
+    return;
+  }
+}
+
+/**
+ * 確保影子頁面在記憶體中，已溢出時從暫存檔讀回
+ *
+ * @param txn Transaction 指標
+ * @param pager 影子頁面所屬的 Pager
+ * @param index 影子頁面索引
+ * @return 影子頁面內容，在下一次載入或建立影子頁面之前有效（釘選後一直有效）
+ */
+static void *transaction_load_shadow(Transaction *txn, Pager *pager, uint32_t index) {
+  ShadowPage *shadow = &txn->shadows[index];
+  shadow->referenced = true;
+  if (!shadow->spilled) {
+    return shadow->data;
+  }
+
+  transaction_make_room(txn, pager);
+  void *data = page_arena_alloc(&pager->arena);
+  ssize_t bytes_read = pread(txn->spill_fd, data, PAGE_SIZE, (off_t)index * PAGE_SIZE);
+  if (bytes_read != (ssize_t)PAGE_SIZE) {
+    printf("Error: Failed to read transaction spill file: %s\n",
+           bytes_read == -1 ? strerror(errno) : "short read");
+    exit(EXIT_FAILURE);
+  }
+  shadow->data = data;
+  shadow->spilled = false;
+  txn->num_resident_shadows++;
+  txn->num_spilled--;
+  txn->spill_reads++;
+  return data;
+}
+
+/**
+ * 釘選記憶體中的影子頁面
+ *
+ * @param txn Transaction 指標
+ * @param index 影子頁面索引
+ * @param for_write 是否用於寫入（暫存檔中的副本將會過期）
+ * @return 頁面 handle，用完以 table_unpin_page 釋放
+ */
+static PageHandle transaction_pin_shadow(Transaction *txn, uint32_t index, bool for_write) {
+  ShadowPage *shadow = &txn->shadows[index];
+  shadow->pin_count++;
+  shadow->referenced = true;
+  if (for_write) {
+    shadow->spill_current = false;
+  }
+  PageHandle handle = {shadow->data, shadow->page_num, SHADOW_HANDLE_FLAG | index};
+  return handle;
+}
+
+/**
+ * 丟棄影子頁面（在記憶體中或已溢出），頁面的項目保留
+ *
+ * @param txn Transaction 指標
+ * @param pager 影子頁面所屬的 Pager
+ * @param shadow 影子頁面
+ */
+static void transaction_drop_shadow(Transaction *txn, Pager *pager, ShadowPage *shadow) {
+  if (shadow->data != NULL) {
+    page_arena_free(&pager->arena, shadow->data);
+    shadow->data = NULL;
+    txn->num_resident_shadows--;
+  }
+  if (shadow->spilled) {
+    shadow->spilled = false;
+    txn->num_spilled--;
+  }
+}
+
+/**
+ * 修改既有的頁面之前，為最內層的保存點保存頁面目前的內容
+ *
+ * 只有保存點建立之前就已修改、且建立之後第一次修改的頁面需要保存；保存點之後
+ * 才加入的頁面在 ROLLBACK TO 時整個移除。以列變更記錄修改的頁面由列變更記錄
+ * 復原，只記錄它當時沒有影子頁面。
+ *
+ * @param txn Transaction 指標
+ * @param arena 影子頁面所屬的記憶體池
+ * @param index 頁面在 shadows 中的索引
+ */
+static void transaction_save_page(Transaction *txn, PageArena *arena, uint32_t index) {
+  if (txn->num_savepoints == 0) {
+    return;
+  }
+  Savepoint *savepoint = &txn->savepoints[txn->num_savepoints - 1];
+  ShadowPage *shadow = &txn->shadows[index];
+  if (index >= savepoint->num_modified || shadow->savepoint_id == savepoint->id) {
+    return;
+  }
+
+  if (txn->num_savepoint_images == txn->savepoint_image_capacity) {
+    uint32_t new_capacity =
+        txn->savepoint_image_capacity ? txn->savepoint_image_capacity * 2 : 16;
+    SavepointImage *images =
+        realloc(txn->savepoint_images, new_capacity * sizeof(SavepointImage));
+    if (images == NULL) {
+      printf("Error: Memory allocation failed for savepoint images\n");
+      exit(EXIT_FAILURE);
+    }
+    txn->savepoint_images = images;
+    txn->savepoint_image_capacity = new_capacity;
+  }
+
+  SavepointImage *image = &txn->savepoint_images[txn->num_savepoint_images++];
+  image->shadow_index = index;
+  image->data = NULL;
+  if (shadow->data != NULL) {
+    image->data = page_arena_alloc(arena);
+    memcpy(image->data, shadow->data, PAGE_SIZE);
+  }
+  shadow->savepoint_id = savepoint->id;
+}
+
+/**
+ * 釋放保存點保存的頁面內容
+ *
+ * @param txn Transaction 指標
+ * @param arena 頁面所屬的記憶體池
+ * @param first 保留前 first 個
+ */
+static void transaction_free_savepoint_images(Transaction *txn, PageArena *arena,
+                                              uint32_t first) {
+  for (uint32_t i = first; i < txn->num_savepoint_images; i++) {
+    if (txn->savepoint_images[i].data != NULL) {
+      page_arena_free(arena, txn->savepoint_images[i].data);
+    }
+  }
+  txn->num_savepoint_images = first;
+}
+
+/**
+ * 釋放所有影子頁面與列變更記錄修改的頁面的釘選，並清空雜湊表、列變更記錄、保存點
+ * 與溢出暫存檔
+ *
+ * 只重設被使用過的雜湊桶，成本與修改的頁面數成正比。
+ *
+ * @param txn Transaction 指標
+ * @param pager 影子頁面與釘選所屬的 Pager
+ */
+void transaction_clear(Transaction *txn, Pager *pager) {
+  for (uint32_t i = 0; i < txn->num_modified; i++) {
+    transaction_drop_shadow(txn, pager, &txn->shadows[i]);
+    if (txn->shadows[i].pinned.data != NULL) {
+      pager_unpin(pager, &txn->shadows[i].pinned);
+    }
+    txn->shadow_table[transaction_hash(txn, txn->shadows[i].page_num)] =
+        INVALID_SHADOW_INDEX;
+  }
+  txn->num_modified = 0;
+  txn->num_row_pages = 0;
+  txn->num_row_changes = 0;
+  txn->row_images_size = 0;
+  transaction_free_savepoint_images(txn, &pager->arena, 0);
+  txn->num_savepoints = 0;
+
+  // 關閉暫存檔即釋放它的空間（目錄項目在建立時已刪除）
+  if (txn->spill_fd != -1) {
+    close(txn->spill_fd);
+    txn->spill_fd = -1;
+  }
+  txn->spill_clock_hand = 0;
+}
+
+/**
+ * 記錄一筆列變更與其前影像，並保留後影像的空間
+ *
+ * @param txn Transaction 指標
+ * @param type 變更種類
+ * @param page_num 葉節點頁面編號
+ * @param cell_num cell 位置
+ * @param key 鍵
+ * @param before 前影像（插入時為 NULL）
+ * @return 後影像的位址，由呼叫端寫入（刪除時為 NULL）；下一筆記錄之前有效
+ */
+static void *transaction_record_row_change(Transaction *txn, RowChangeType type,
+                                           uint32_t page_num, uint32_t cell_num, uint32_t key,
+                                           const void *before) {
+  if (txn->num_row_changes == txn->row_change_capacity) {
+    uint32_t new_capacity = txn->row_change_capacity ? txn->row_change_capacity * 2 : 64;
+    RowChange *row_changes = realloc(txn->row_changes, new_capacity * sizeof(RowChange));
+    if (row_changes == NULL) {
+      printf("Error: Memory allocation failed for transaction row changes\n");
+      exit(EXIT_FAILURE);
+    }
+    txn->row_changes = row_changes;
+    txn->row_change_capacity = new_capacity;
+  }
+  bool has_after = type != ROW_CHANGE_DELETE;
+  uint32_t images_size = ((before != NULL) + has_after) * LEAF_NODE_VALUE_SIZE;
+  while (txn->row_images_size + images_size > txn->row_images_capacity) {
+    uint32_t new_capacity = txn->row_images_capacity ? txn->row_images_capacity * 2
+                                                     : 16 * LEAF_NODE_VALUE_SIZE;
+    uint8_t *row_images = realloc(txn->row_images, new_capacity);
+    if (row_images == NULL) {
+      printf("Error: Memory allocation failed for transaction row images\n");
+      exit(EXIT_FAILURE);
+    }
+    txn->row_images = row_images;
+    txn->row_images_capacity = new_capacity;
+  }
+
+  RowChange *change = &txn->row_changes[txn->num_row_changes++];
+  change->type = type;
+  change->page_num = page_num;
+  change->cell_num = cell_num;
+  change->key = key;
+  change->image_offset = txn->row_images_size;
+
+  uint8_t *image = txn->row_images + txn->row_images_size;
+  txn->row_images_size += images_size;
+  if (before != NULL) {
+    memcpy(image, before, LEAF_NODE_VALUE_SIZE);
+    image += LEAF_NODE_VALUE_SIZE;
+  }
+  return has_after ? image : NULL;
+}
+
+/**
+ * 釘選頁面用於讀取
+ * 如果在交易中且有影子頁面，返回影子頁面；否則釘選實際頁面
+ *
+ * 同一交易中稍後以 table_pin_page_for_write 修改的頁面會改寫到新的影子頁面，
+ * 因此要修改的頁面應從一開始就以寫入方式釘選。
+ *
+ * @param table Table 指標
+ * @param page_num 頁面編號
+ * @return 頁面 handle，用完以 table_unpin_page 釋放
+ */
+PageHandle table_pin_page(Table *table, uint32_t page_num) {
+  if (is_in_transaction(table)) {
+    Transaction *txn = table->transaction;
+    uint32_t index = transaction_find_page(txn, page_num);
+    if (index != INVALID_SHADOW_INDEX && transaction_has_shadow(&txn->shadows[index])) {
+      // 影子頁面不在緩衝池中；釘選期間不會溢出到暫存檔
+      transaction_load_shadow(txn, table->pager, index);
+      return transaction_pin_shadow(txn, index, false);
+    }
+  }
+  return pager_pin(table->pager, page_num);
+}
+
+/**
+ * 釋放 table_pin_page 或 table_pin_page_for_write 取得的釘選
+ *
+ * @param table Table 指標
+ * @param handle 頁面 handle
+ */
+void table_unpin_page(Table *table, PageHandle *handle) {
+  if (handle->frame_index != INVALID_FRAME_INDEX && (handle->frame_index & SHADOW_HANDLE_FLAG)) {
+    ShadowPage *shadow = &table->transaction->shadows[handle->frame_index & ~SHADOW_HANDLE_FLAG];
+    if (shadow->pin_count == 0 || shadow->page_num != handle->page_num) {
+      printf("Error: Attempted to unpin shadow page %u that is not pinned\n", handle->page_num);
+      exit(EXIT_FAILURE);
+    }
+    shadow->pin_count--;
+    handle->data = NULL;
+    handle->frame_index = INVALID_FRAME_INDEX;
+    return;
+  }
+  pager_unpin(table->pager, handle);
+}
+
+/**
+ * 釘選頁面用於寫入
+ * 如果在交易中，返回影子頁面；否則釘選實際頁面並將其標記為髒頁
+ *
+ * B-tree 的所有修改（包括分裂、合併與空閒頁串列）都經由此函式，
+ * 因此交易中的結構變更也由影子頁面涵蓋，回滾時一併丟棄。
+ *
+ * @param table Table 指標
+ * @param page_num 頁面編號
+ * @return 頁面 handle，用完以 table_unpin_page 釋放
+ */
+PageHandle table_pin_page_for_write(Table *table, uint32_t page_num) {
+  if (!is_in_transaction(table)) {
+    // 不在交易中，直接修改實際頁面。交易外的修改不經過日誌，
+    // 先執行檢查點，復原時重做日誌才不會覆蓋這些修改
+    if (table->pager->wal.num_frames > 0) {
+      pager_checkpoint(table->pager);
+    }
+    PageHandle handle = pager_pin(table->pager, page_num);
+    pager_mark_dirty(table->pager, page_num);
+    return handle;
+  }
+
+  Transaction *txn = table->transaction;
+  Pager *pager = table->pager;
+  uint32_t index = transaction_find_page(txn, page_num);
+  bool has_shadow = index != INVALID_SHADOW_INDEX && transaction_has_shadow(&txn->shadows[index]);
+  if (has_shadow) {
+    transaction_load_shadow(txn, pager, index);
+  }
+  if (index != INVALID_SHADOW_INDEX) {
+    transaction_save_page(txn, &pager->arena, index);
+  }
+  
+  // 如果這個頁面還沒有影子頁面，創建一個
+  if (!has_shadow) {
+    // 創建影子頁面並複製原始頁面的內容；記憶體中的影子頁面已達上限時先溢出一個
+    transaction_make_room(txn, pager);
+    void *shadow = page_arena_alloc(&pager->arena);
+
+    if (index != INVALID_SHADOW_INDEX) {
+      // 已以列變更記錄直接修改的頁面（分裂或合併）：影子頁面包含這些變更，
+      // 頁面繼續釘選，回滾時仍以前影像復原
+      memcpy(shadow, txn->shadows[index].pinned.data, PAGE_SIZE);
+      txn->shadows[index].data = shadow;
+    } else {
+      void *original_page = get_page(pager, page_num);
+      memcpy(shadow, original_page, PAGE_SIZE);
+
+      // 記錄這個頁面已被修改
+      PageHandle unpinned = {NULL, page_num, INVALID_FRAME_INDEX};
+      transaction_add_page(txn, page_num, shadow, unpinned);
+      index = txn->num_modified - 1;
+    }
+    txn->num_resident_shadows++;
+  }
+
+  return transaction_pin_shadow(txn, index, true);
+}
+
+/**
+ * 取得以列變更記錄直接修改的葉節點
+ *
+ * 交易以列變更記錄修改時，第一次修改的頁面在緩衝池中釘選到交易結束，之後的變更
+ * 都直接套用在頁框上，不複製整頁。以下情況返回 NULL，呼叫端改以
+ * table_pin_page_for_write 修改整頁：
+ * - 不在交易中，或交易記錄整頁
+ * - 頁面在這個交易中已有影子頁面（分裂或合併過）
+ * - 日誌為空而頁面是髒頁：頁面含有交易外尚未寫入日誌的修改，列變更記錄無法
+ *   在資料庫檔案的頁面上重做
+ * - 釘選的頁面已達影子頁面上限與頁框預算中較小者的一半：釘選的頁框無法置換，
+ *   之後的頁面改為複製成可以溢出到暫存檔的影子頁面，記憶體用量仍有上限
+ *
+ * @param table Table 指標
+ * @param page_num 葉節點頁面編號
+ * @return 頁面內容，不使用列變更記錄時返回 NULL
+ */
+static void *transaction_row_page(Table *table, uint32_t page_num) {
+  Transaction *txn = table->transaction;
+  if (!is_in_transaction(table) || txn->log_mode != TXN_LOG_ROW) {
+    return NULL;
+  }
+  uint32_t index = transaction_find_page(txn, page_num);
+  if (index != INVALID_SHADOW_INDEX) {
+    return transaction_has_shadow(&txn->shadows[index]) ? NULL
+                                                         : txn->shadows[index].pinned.data;
+  }
+
+  Pager *pager = table->pager;
+  uint32_t max_row_pages = txn->max_shadow_pages < pager->max_frames ? txn->max_shadow_pages
+                                                                     : pager->max_frames;
+  if (txn->num_row_pages >= max_row_pages / 2) {
+    return NULL;
+  }
+  PageHandle handle = pager_pin(pager, page_num);
+  if (!pager->page_map.enabled && pager->wal.num_frames == 0 &&
+      pager_dirty_page(pager, page_num) != NULL) {
+    pager_unpin(pager, &handle);
+    return NULL;
+  }
+  transaction_add_page(txn, page_num, NULL, handle);
+  txn->num_row_pages++;
+  return handle.data;
+}
+
+/**
+ * 在葉節點插入一個 cell（節點必須還有空間）
+ *
+ * 交易以列變更記錄修改時只記錄後影像並直接修改頁框，否則修改整頁。
+ *
+ * @param table Table 指標
+ * @param page_num 葉節點頁面編號
+ * @param cell_num 插入位置
+ * @param key 鍵
+ * @param value Row 資料指標
+ */
+void table_row_insert(Table *table, uint32_t page_num, uint32_t cell_num, uint32_t key,
+                      Row *value) {
+  void *node = transaction_row_page(table, page_num);
+  if (node != NULL) {
+    void *after = transaction_record_row_change(table->transaction, ROW_CHANGE_INSERT,
+                                                page_num, cell_num, key, NULL);
+    serialize_row(value, after);
+    leaf_node_apply_row_change(node, ROW_CHANGE_INSERT, cell_num, key, after);
+    return;
+  }
+
+  PageHandle handle = table_pin_page_for_write(table, page_num);
+  leaf_node_apply_row_change(handle.data, ROW_CHANGE_INSERT, cell_num, key, NULL);
+  serialize_row(value, leaf_node_value(handle.data, cell_num));
+  table_unpin_page(table, &handle);
+}
+
+/**
+ * 更新葉節點中 cell 的值
+ *
+ * @param table Table 指標
+ * @param page_num 葉節點頁面編號
+ * @param cell_num cell 位置
+ * @param value 更新後的 Row 資料指標
+ */
+void table_row_update(Table *table, uint32_t page_num, uint32_t cell_num, Row *value) {
+  void *node = transaction_row_page(table, page_num);
+  if (node != NULL) {
+    uint32_t key = *leaf_node_key(node, cell_num);
+    void *after = transaction_record_row_change(table->transaction, ROW_CHANGE_UPDATE,
+                                                page_num, cell_num, key,
+                                                leaf_node_value(node, cell_num));
+    serialize_row(value, after);
+    leaf_node_apply_row_change(node, ROW_CHANGE_UPDATE, cell_num, key, after);
+    return;
+  }
+
+  PageHandle handle = table_pin_page_for_write(table, page_num);
+  serialize_row(value, leaf_node_value(handle.data, cell_num));
+  table_unpin_page(table, &handle);
+}
+
+/**
+ * 從葉節點刪除一個 cell（不處理節點變空後的合併）
+ *
+ * @param table Table 指標
+ * @param page_num 葉節點頁面編號
+ * @param cell_num cell 位置
+ */
+void table_row_delete(Table *table, uint32_t page_num, uint32_t cell_num) {
+  void *node = transaction_row_page(table, page_num);
+  if (node != NULL) {
+    uint32_t key = *leaf_node_key(node, cell_num);
+    transaction_record_row_change(table->transaction, ROW_CHANGE_DELETE, page_num, cell_num,
+                                  key, leaf_node_value(node, cell_num));
+    leaf_node_apply_row_change(node, ROW_CHANGE_DELETE, cell_num, key, NULL);
+    return;
+  }
+
+  PageHandle handle = table_pin_page_for_write(table, page_num);
+  leaf_node_apply_row_change(handle.data, ROW_CHANGE_DELETE, cell_num,
+                             *leaf_node_key(handle.data, cell_num), NULL);
+  table_unpin_page(table, &handle);
+}
+
+/**
+ * 以前影像依相反順序復原列變更記錄直接修改的頁面
+ *
+ * @param txn Transaction 指標
+ * @param first 復原第 first 筆之後（含）的列變更記錄
+ */
+static void transaction_undo_row_changes(Transaction *txn, uint32_t first) {
+  for (uint32_t i = txn->num_row_changes; i-- > first;) {
+    RowChange *change = &txn->row_changes[i];
+    void *node = txn->shadows[transaction_find_page(txn, change->page_num)].pinned.data;
+    const uint8_t *before = txn->row_images + change->image_offset;
+    switch (change->type) {
+    case ROW_CHANGE_INSERT:
+      leaf_node_apply_row_change(node, ROW_CHANGE_DELETE, change->cell_num, change->key, NULL);
+      break;
+    case ROW_CHANGE_UPDATE:
+      leaf_node_apply_row_change(node, ROW_CHANGE_UPDATE, change->cell_num, change->key,
+                                 before);
+      break;
+    case ROW_CHANGE_DELETE:
+      leaf_node_apply_row_change(node, ROW_CHANGE_INSERT, change->cell_num, change->key,
+                                 before);
+      break;
+    }
+  }
+  txn->num_row_changes = first;
+}
+
+/**
+ * 將列變更記錄的後影像組成日誌的列變更記錄
+ *
+ * 頁面之後又複製為影子頁面時，整頁訊框已涵蓋這些變更，不再寫入。
+ *
+ * @param txn Transaction 指標
+ * @param size 輸出：記錄的總長度
+ * @return 連續的列變更記錄（沒有記錄時為 NULL，由呼叫端釋放）
+ */
+static uint8_t *transaction_build_row_records(Transaction *txn, uint32_t *size) {
+  *size = 0;
+  if (txn->num_row_changes == 0) {
+    return NULL;
+  }
+  uint8_t *records = malloc((size_t)txn->num_row_changes *
+                            (WAL_ROW_HEADER_SIZE + LEAF_NODE_VALUE_SIZE));
+  if (records == NULL) {
+    printf("Error: Memory allocation failed for row records\n");
     exit(EXIT_FAILURE);
   }
 
-  table->transaction->state = TXN_STATE_NONE;
-  table->transaction->num_modified = 0;
-  for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    table->transaction->shadow_pages[i] = NULL;
-    table->transaction->modified_pages[i] = false;
+  for (uint32_t i = 0; i < txn->num_row_changes; i++) {
+    RowChange *change = &txn->row_changes[i];
+    if (transaction_has_shadow(&txn->shadows[transaction_find_page(txn, change->page_num)])) {
+      continue;
+    }
+    uint8_t *record = records + *size;
+    *(uint32_t *)(record + WAL_ROW_TYPE_OFFSET) = change->type;
+    *(uint32_t *)(record + WAL_ROW_PAGE_NUM_OFFSET) = change->page_num;
+    *(uint32_t *)(record + WAL_ROW_CELL_NUM_OFFSET) = change->cell_num;
+    *(uint32_t *)(record + WAL_ROW_KEY_OFFSET) = change->key;
+    if (change->type != ROW_CHANGE_DELETE) {
+      // 後影像位於前影像（更新才有）之後
+      uint32_t after_offset =
+          change->image_offset + (change->type == ROW_CHANGE_UPDATE ? LEAF_NODE_VALUE_SIZE : 0);
+      memcpy(record + WAL_ROW_HEADER_SIZE, txn->row_images + after_offset,
+             LEAF_NODE_VALUE_SIZE);
+    }
+    *size += wal_row_record_size(change->type);
   }
+  return records;
+}
 
-  // 初始化統計資訊
-  table->statistics = malloc(sizeof(TableStatistics));
-  if (table->statistics == NULL) {
-    printf("Error: Memory allocation failed for statistics\n");
-    close(pager->file_descriptor);
-    free(pager);
-    free(table->transaction);
-    free(table);
+/**
+ * 提交交易
+ * 將所有影子頁面的內容寫回實際頁面並持久化
+ *
+ * @param table Table 指標
+ * @return 執行結果
+ */
+ExecuteResult transaction_commit(Table *table) {
+  if (!is_in_transaction(table)) {
+    printf("Error: No active transaction.\n");
+    return EXECUTE_TABLE_FULL; // 借用這個錯誤碼
+  }
+
+  Transaction *txn = table->transaction;
+  Pager *pager = table->pager;
+  uint32_t *committed_pages = malloc((txn->num_modified + 1) * sizeof(uint32_t));
+  if (committed_pages == NULL) {
+    printf("Error: Memory allocation failed for commit page list\n");
     exit(EXIT_FAILURE);
   }
+  // 只以列變更記錄修改的頁面沒有影子頁面，已經在緩衝池中修改
+  uint32_t num_committed = 0;
+  for (uint32_t i = 0; i < txn->num_modified; i++) {
+    if (transaction_has_shadow(&txn->shadows[i])) {
+      committed_pages[num_committed++] = txn->shadows[i].page_num;
+    }
+  }
+
+  // 依頁面編號排序，日誌中的訊框與之後的寫回都是循序的
+  qsort(committed_pages, num_committed, sizeof(uint32_t), compare_page_nums);
+
+  // 先將影子頁面與列變更記錄依序附加到預寫日誌並 fsync，交易即已持久化（Durability）；
+  // 資料庫檔案中的頁面留待檢查點或置換時再寫回
+  // 寫入時複製資料庫不使用日誌，影子頁面複製回緩衝池後以新的版本提交
+  if (!pager->page_map.enabled) {
+    uint32_t row_records_size;
+    uint8_t *row_records = transaction_build_row_records(txn, &row_records_size);
+
+    // 影子頁面可能已溢出到暫存檔：每次只載入並釘選上限一半的影子頁面，分批附加，
+    // 最後一批的最後一個訊框才標記為提交訊框
+    uint32_t batch_size = txn->max_shadow_pages / 2;
+    PageHandle *batch = malloc(batch_size * sizeof(PageHandle));
+    void **batch_pages = malloc(batch_size * sizeof(void *));
+    if (batch == NULL || batch_pages == NULL) {
+      printf("Error: Memory allocation failed for commit page list\n");
+      exit(EXIT_FAILURE);
+    }
+    uint32_t start = 0;
+    do {
+      uint32_t count = num_committed - start < batch_size ? num_committed - start : batch_size;
+      for (uint32_t i = 0; i < count; i++) {
+        batch[i] = table_pin_page(table, committed_pages[start + i]);
+        batch_pages[i] = batch[i].data;
+      }
+      wal_append_frames(pager, committed_pages + start, batch_pages, count,
+                        start == 0 ? row_records : NULL, start == 0 ? row_records_size : 0,
+                        start + count == num_committed);
+      for (uint32_t i = 0; i < count; i++) {
+        table_unpin_page(table, &batch[i]);
+      }
+      start += count;
+    } while (start < num_committed);
+    free(batch);
+    free(batch_pages);
+    free(row_records);
+  }
+
+  // 將所有影子頁面寫回實際頁面
+  for (uint32_t i = 0; i < num_committed; i++) {
+    uint32_t page_num = committed_pages[i];
+    uint32_t index = transaction_find_page(txn, page_num);
+    void *shadow = transaction_load_shadow(txn, pager, index);
+    void *original_page = get_page(pager, page_num);
+    memcpy(original_page, shadow, PAGE_SIZE);
+    pager_mark_dirty(pager, page_num);
+  }
+  free(committed_pages);
+
+  // 列變更記錄直接修改的頁面提交後才成為髒頁；日誌中只有列變更記錄的頁面
+  // 留在緩衝池中，直到檢查點整頁記錄後才寫回
+  for (uint32_t i = 0; i < txn->num_modified; i++) {
+    if (!transaction_has_shadow(&txn->shadows[i])) {
+      pager_mark_dirty(pager, txn->shadows[i].page_num);
+      if (!pager->page_map.enabled) {
+        wal_track_row_page(pager, txn->shadows[i].page_num);
+      }
+    }
+  }
+
+  // 釋放影子頁面
+  transaction_clear(txn, pager);
+
+  if (pager->page_map.enabled) {
+    // 統計資訊與交易的修改一起提交，其他行程讀到的統計資訊不會落後；
+    // 沒有取得寫入鎖的交易沒有修改任何頁面
+    txn->state = TXN_STATE_COMMITTED;
+    if (pager->page_map.writer_locked) {
+      statistics_save(table);
+      page_map_commit(pager);
+    }
+  } else if (pager->wal.num_frames >= WAL_AUTOCHECKPOINT_FRAMES ||
+             pager->wal.row_pages.count >= pager->max_frames / 2) {
+    // 留在緩衝池中的頁面達到頁框預算的一半時也執行檢查點
+    pager_checkpoint(pager);
+  }
+
+  txn->state = TXN_STATE_COMMITTED;
   
-  statistics_reset(table->statistics);
+  return EXECUTE_SUCCESS;
+}
+
+/**
+ * 回滾交易
+ * 丟棄所有影子頁面，恢復到交易開始前的狀態
+ *
+ * @param table Table 指標
+ * @return 執行結果
+ */
+ExecuteResult transaction_rollback(Table *table) {
+  if (!is_in_transaction(table)) {
+    printf("Error: No active transaction.\n");
+    return EXECUTE_TABLE_FULL; // 借用這個錯誤碼
+  }
+
+  Transaction *txn = table->transaction;
   
-  // 嘗試載入統計資訊，如果載入失敗則收集新的統計資訊
-  if (!statistics_load(table)) {
-    // 如果表不為空，收集統計資訊
-    if (pager->num_pages > 0) {
-      TableStatistics *stats = collect_table_statistics(table);
-      if (stats != NULL) {
-        memcpy(table->statistics, stats, sizeof(TableStatistics));
-        free(stats);
-        statistics_save(table);
-      }
+  // 復原列變更記錄直接修改的頁面，並釋放所有影子頁面（丟棄所有修改）
+  transaction_undo_row_changes(txn, 0);
+  transaction_clear(txn, table->pager);
+
+  txn->state = TXN_STATE_ABORTED;
+
+  // 交易中新增的頁面已不被任何節點引用，放回空閒頁串列
+  for (uint32_t page_num = txn->start_num_pages; page_num < table->pager->num_pages;
+       page_num++) {
+    table_free_page(table, page_num);
+  }
+  
+  return EXECUTE_SUCCESS;
+}
+
+/**
+ * 取出命令中的保存點名稱：略過開頭的空白與可省略的 SAVEPOINT 關鍵字
+ *
+ * @param text 關鍵字之後的文字
+ * @return 保存點名稱
+ */
+const char *savepoint_name(const char *text) {
+  while (*text == ' ')
+    text++;
+  if (strncmp(text, "savepoint ", 10) == 0) {
+    text += 10;
+    while (*text == ' ')
+      text++;
+  }
+  return text;
+}
+
+/**
+ * 由內而外尋找保存點（同名時以最內層的為準）
+ *
+ * @param table Table 指標
+ * @param name 保存點名稱
+ * @return 保存點在堆疊中的索引，找不到時返回 -1（並印出錯誤）
+ */
+static int32_t transaction_find_savepoint(Table *table, const char *name) {
+  if (!is_in_transaction(table)) {
+    printf("Error: No active transaction.\n");
+    return -1;
+  }
+  Transaction *txn = table->transaction;
+  for (uint32_t i = txn->num_savepoints; i-- > 0;) {
+    if (strcmp(txn->savepoints[i].name, name) == 0) {
+      return (int32_t)i;
+    }
+  }
+  printf("Error: No such savepoint: %s\n", name);
+  return -1;
+}
+
+/**
+ * 建立保存點（SAVEPOINT name）
+ *
+ * 只記錄交易目前各串列的長度，成本與交易已修改的頁面數量無關；之後第一次修改
+ * 既有的影子頁面時才保存該頁面的內容。
+ *
+ * @param table Table 指標
+ * @param name 保存點名稱
+ * @return 執行結果
+ */
+ExecuteResult transaction_savepoint(Table *table, const char *name) {
+  if (!is_in_transaction(table)) {
+    printf("Error: No active transaction.\n");
+    return EXECUTE_TABLE_FULL; // 借用這個錯誤碼
+  }
+  if (*name == '\0' || strlen(name) >= SAVEPOINT_NAME_SIZE || strchr(name, ' ') != NULL) {
+    printf("Error: Invalid savepoint name '%s'.\n", name);
+    return EXECUTE_TABLE_FULL;
+  }
+
+  Transaction *txn = table->transaction;
+  if (txn->num_savepoints == txn->savepoint_capacity) {
+    uint32_t new_capacity = txn->savepoint_capacity ? txn->savepoint_capacity * 2 : 8;
+    Savepoint *savepoints = realloc(txn->savepoints, new_capacity * sizeof(Savepoint));
+    if (savepoints == NULL) {
+      printf("Error: Memory allocation failed for savepoints\n");
+      exit(EXIT_FAILURE);
+    }
+    txn->savepoints = savepoints;
+    txn->savepoint_capacity = new_capacity;
+  }
+
+  Savepoint *savepoint = &txn->savepoints[txn->num_savepoints++];
+  strcpy(savepoint->name, name);
+  savepoint->id = txn->next_savepoint_id++;
+  savepoint->num_modified = txn->num_modified;
+  savepoint->num_row_changes = txn->num_row_changes;
+  savepoint->row_images_size = txn->row_images_size;
+  savepoint->num_images = txn->num_savepoint_images;
+  savepoint->num_pages = table->pager->num_pages;
+  return EXECUTE_SUCCESS;
+}
+
+/**
+ * 回滾到保存點（ROLLBACK TO name）
+ *
+ * 依相反順序復原保存點之後的列變更記錄與保存的頁面內容，移除保存點之後才
+ * 修改的頁面，成本與保存點之後修改的頁面與列數成正比。保存點本身保留，
+ * 之後建立的保存點一併移除。
+ *
+ * @param table Table 指標
+ * @param name 保存點名稱
+ * @return 執行結果
+ */
+ExecuteResult transaction_rollback_to(Table *table, const char *name) {
+  int32_t found = transaction_find_savepoint(table, name);
+  if (found < 0) {
+    return EXECUTE_TABLE_FULL; // 借用這個錯誤碼
+  }
+
+  Transaction *txn = table->transaction;
+  Pager *pager = table->pager;
+  Savepoint *savepoint = &txn->savepoints[found];
+
+  // 以前影像復原列變更記錄直接修改的頁面
+  transaction_undo_row_changes(txn, savepoint->num_row_changes);
+  txn->row_images_size = savepoint->row_images_size;
+
+  // 換回保存點之後第一次修改前的影子頁面內容
+  for (uint32_t i = txn->num_savepoint_images; i-- > savepoint->num_images;) {
+    SavepointImage *image = &txn->savepoint_images[i];
+    ShadowPage *shadow = &txn->shadows[image->shadow_index];
+    transaction_drop_shadow(txn, pager, shadow);
+    if (image->data != NULL) {
+      shadow->data = image->data;
+      shadow->spill_current = false;
+      txn->num_resident_shadows++;
+    }
+  }
+  txn->num_savepoint_images = savepoint->num_images;
+
+  // 移除保存點之後才修改的頁面；它們是各雜湊桶中最新的項目
+  for (uint32_t i = txn->num_modified; i-- > savepoint->num_modified;) {
+    ShadowPage *shadow = &txn->shadows[i];
+    transaction_drop_shadow(txn, pager, shadow);
+    if (shadow->pinned.data != NULL) {
+      pager_unpin(pager, &shadow->pinned);
+      txn->num_row_pages--;
+    }
+    txn->shadow_table[transaction_hash(txn, shadow->page_num)] = shadow->hash_next;
+  }
+  txn->num_modified = savepoint->num_modified;
+
+  // 之後修改的頁面都要重新保存
+  txn->num_savepoints = (uint32_t)found + 1;
+  savepoint->id = txn->next_savepoint_id++;
+
+  // 保存點之後新增的頁面已不被任何節點引用，放回空閒頁串列
+  for (uint32_t page_num = savepoint->num_pages; page_num < pager->num_pages; page_num++) {
+    table_free_page(table, page_num);
+  }
+  return EXECUTE_SUCCESS;
+}
+
+/**
+ * 釋放保存點（RELEASE name）：保存點與之後建立的保存點一併移除，修改保留在交易中
+ *
+ * 保存的頁面內容留給外層的保存點（它們在外層保存點之後也沒有再被修改過）；
+ * 沒有外層保存點時直接釋放。
+ *
+ * @param table Table 指標
+ * @param name 保存點名稱
+ * @return 執行結果
+ */
+ExecuteResult transaction_release(Table *table, const char *name) {
+  int32_t found = transaction_find_savepoint(table, name);
+  if (found < 0) {
+    return EXECUTE_TABLE_FULL; // 借用這個錯誤碼
+  }
+
+  Transaction *txn = table->transaction;
+  txn->num_savepoints = (uint32_t)found;
+  if (txn->num_savepoints == 0) {
+    transaction_free_savepoint_images(txn, &table->pager->arena, 0);
+  }
+  return EXECUTE_SUCCESS;
+}
+
+/**
+ * 切換到新的版本後重新讀取標頭頁與統計資訊
+ *
+ * @param table Table 指標
+ */
+static void table_reload_snapshot(Table *table) {
+  table->root_page_num = db_read_header(table->pager, table->pager->page_map.path);
+  statistics_reset(table->statistics);
+  statistics_load(table);
+}
+
+/**
+ * 語句開始前釘選讀取的版本（寫入時複製資料庫）
+ *
+ * 交易外的每個語句都讀取最新提交的版本；交易在 BEGIN 時釘選的版本一直使用到
+ * 交易結束，期間其他行程的提交不會影響交易讀到的內容。持有寫入鎖時本行程
+ * 的版本就是最新的版本。
+ *
+ * @param table Table 指標
+ */
+void table_begin_read(Table *table) {
+  PageMap *map = &table->pager->page_map;
+  if (!map->enabled || map->writer_locked || is_in_transaction(table)) {
+    return;
+  }
+  if (page_map_refresh(table->pager)) {
+    table_reload_snapshot(table);
+  }
+}
+
+/**
+ * 修改資料庫之前取得寫入鎖（寫入時複製資料庫）
+ *
+ * 寫入鎖不等待：其他行程正在修改時返回 EXECUTE_DATABASE_LOCKED。讀取者不會
+ * 阻擋寫入者，寫入者也不會阻擋讀取者。交易釘選的版本已被其他行程的提交取代時
+ * 返回 EXECUTE_SNAPSHOT_STALE，交易必須回滾後重新開始。
+ *
+ * @param table Table 指標
+ * @return 執行結果
+ */
+ExecuteResult table_begin_write(Table *table) {
+  Pager *pager = table->pager;
+  if (!pager->page_map.enabled || pager->page_map.writer_locked) {
+    return EXECUTE_SUCCESS;
+  }
+  if (!page_map_lock_writer(pager)) {
+    return EXECUTE_DATABASE_LOCKED;
+  }
+  // 持有寫入鎖之後不會再有其他行程提交
+  if (page_map_is_stale(pager)) {
+    if (is_in_transaction(table)) {
+      page_map_unlock_writer(pager);
+      return EXECUTE_SNAPSHOT_STALE;
     }
+    if (page_map_refresh(pager)) {
+      table_reload_snapshot(table);
+    }
+  }
+  page_map_prepare_write(pager);
+  return EXECUTE_SUCCESS;
+}
+
+/**
+ * 語句結束後解除釘選，沒有未提交的修改時釋放寫入鎖（寫入時複製資料庫）
+ *
+ * 交易外的修改連同統計資訊一起保留在緩衝池中；SYNC_FULL 立即提交，其他等級
+ * 則持有寫入鎖直到檢查點提交為止。
+ *
+ * @param table Table 指標
+ */
+void table_end_statement(Table *table) {
+  Pager *pager = table->pager;
+  PageMap *map = &pager->page_map;
+  if (!map->enabled || is_in_transaction(table)) {
+    return;
+  }
+  if (map->writer_locked && page_map_has_changes(pager)) {
+    statistics_save(table);
+    if (pager->sync_level == SYNC_FULL) {
+      page_map_commit(pager);
+    }
+  }
+  if (map->writer_locked && !page_map_has_changes(pager)) {
+    page_map_unlock_writer(pager);
   }
+  page_map_release_snapshot(pager);
+}
 
-  if (pager->num_pages == 0) {
-    // 新資料庫檔案：初始化第 0 頁為葉節點
-    void *root_node = get_page(pager, 0);
-    initialize_leaf_node(root_node);
-    set_node_root(root_node, true);
-  }
+/* ============================================================================
+ * 背景檢查點
+ * ============================================================================
+ */
 
-  return table;
+/**
+ * 交易外是否有尚未寫回資料庫檔案（或尚未提交到寫入時複製的新版本）的修改
+ *
+ * @param pager Pager 指標
+ * @return 是否有尚未寫回的修改
+ */
+static bool checkpointer_has_changes(Pager *pager) {
+  if (pager->page_map.enabled) {
+    // 沒有寫入鎖的行程不會有修改
+    return pager->page_map.writer_locked &&
+           (pager->num_dirty > 0 || page_map_has_changes(pager));
+  }
+  return pager->num_dirty > 0 || pager->wal.num_frames > 0 ||
+         (pager->needs_sync && pager->sync_level != SYNC_OFF);
 }
 
 /**
- * 關閉資料庫，將所有頁面寫回檔案並釋放資源
+ * 背景檢查點的一個步驟（呼叫端持有資料庫鎖）
+ *
+ * 尚未寫回的修改保留超過 interval_ms，或髒頁（或日誌訊框）達到 dirty_pages 時
+ * 開始寫回：每次最多寫回 CHECKPOINTER_BATCH_PAGES 個髒頁，髒頁都寫回之後執行
+ * 檢查點（同步資料庫檔案並清空日誌，寫入時複製資料庫則提交新版本並釋放寫入鎖）。
+ * 日誌中只有列變更記錄的頁面和置換時一樣留給檢查點處理。交易進行中不寫回：
+ * 影子頁面不在緩衝池中，以列變更記錄直接修改的頁面在提交之前不能寫回。
  *
  * @param table Table 指標
+ * @return 是否還有下一批要寫回
  */
-void db_close(Table *table) {
+static bool checkpointer_step(Table *table) {
+  Checkpointer *checkpointer = table->checkpointer;
   Pager *pager = table->pager;
-  
-  // 如果有活動的交易，強制提交
-  if (table->transaction && table->transaction->state == TXN_STATE_ACTIVE) {
-    printf("Warning: Active transaction will be committed.\n");
-    transaction_commit(table);
+  if (is_in_transaction(table)) {
+    checkpointer->active = false;
+    checkpointer->has_changes = false;
+    return false;
   }
 
-  for (uint32_t i = 0; i < pager->num_pages; i++) {
-    if (pager->pages[i] == NULL) {
-      continue;
+  if (!checkpointer->active) {
+    if (!checkpointer_has_changes(pager)) {
+      checkpointer->has_changes = false;
+      return false;
     }
-    pager_flush(pager, i);
-    free(pager->pages[i]);
-    pager->pages[i] = NULL;
-  }
-
-  int result = close(pager->file_descriptor);
-  if (result == -1) {
-    printf("Error: Failed to close database file: %s\n", strerror(errno));
-    exit(EXIT_FAILURE);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (!checkpointer->has_changes) {
+      checkpointer->has_changes = true;
+      checkpointer->changes_since = now;
+    }
+    int64_t elapsed_ms = (int64_t)(now.tv_sec - checkpointer->changes_since.tv_sec) * 1000 +
+                         (now.tv_nsec - checkpointer->changes_since.tv_nsec) / 1000000;
+    bool due = (checkpointer->interval_ms > 0 && elapsed_ms >= checkpointer->interval_ms) ||
+               (checkpointer->dirty_pages > 0 &&
+                (pager->num_dirty >= checkpointer->dirty_pages ||
+                 pager->wal.num_frames >= checkpointer->dirty_pages));
+    if (!due) {
+      return false;
+    }
+    checkpointer->active = true;
+    checkpointer->batches_left = pager->num_dirty / CHECKPOINTER_BATCH_PAGES + 1;
   }
 
-  for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    void *page = pager->pages[i];
-    if (page) {
-      free(page);
-      pager->pages[i] = NULL;
+  uint32_t page_nums[CHECKPOINTER_BATCH_PAGES];
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < pager->mmap_pages && count < CHECKPOINTER_BATCH_PAGES; i++) {
+    if (pager->mmap_dirty[i]) {
+      page_nums[count++] = i;
     }
   }
-
-  // 清理交易資源
-  if (table->transaction) {
-    for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-      if (table->transaction->shadow_pages[i]) {
-        free(table->transaction->shadow_pages[i]);
-      }
+  for (uint32_t i = 0; i < pager->frame_capacity && count < CHECKPOINTER_BATCH_PAGES; i++) {
+    Frame *frame = &pager->frames[i];
+    if (frame->data != NULL && frame->dirty && !frame->row_logged) {
+      page_nums[count++] = frame->page_num;
     }
-    free(table->transaction);
   }
-
-  // 保存並清理統計資訊
-  if (table->statistics) {
-    statistics_save(table);
-    free(table->statistics);
+  // 前景持續修改時不追趕新的髒頁，寫完開始時的髒頁就執行檢查點
+  if (count > 0 && checkpointer->batches_left > 0) {
+    pager_flush_pages(pager, page_nums, count);
+    checkpointer->pages_written += count;
+    checkpointer->batches_left--;
+    return true;
   }
 
-  free(pager);
-  free(table);
+  table_save_header(table);
+  pager_checkpoint(pager);
+  if (pager->page_map.enabled && !page_map_has_changes(pager)) {
+    page_map_unlock_writer(pager);
+  }
+  checkpointer->checkpoints++;
+  checkpointer->active = false;
+  checkpointer->has_changes = false;
+  return false;
 }
 
-/* ============================================================================
- * 交易管理（Transaction Management）
- * ============================================================================
+/**
+ * 背景檢查點執行緒的主迴圈
+ *
+ * 等待期間釋放資料庫鎖；前景忙碌時背景執行緒取不到鎖，寫回自然延後。
+ *
+ * @param arg Table 指標
+ * @return NULL
  */
+static void *checkpointer_main(void *arg) {
+  Table *table = arg;
+  Checkpointer *checkpointer = table->checkpointer;
+  pthread_mutex_lock(&checkpointer->lock);
+  while (!checkpointer->stopping) {
+    uint32_t wait_ms = checkpointer_step(table) ? CHECKPOINTER_BATCH_DELAY_MS
+                                                : CHECKPOINTER_POLL_MS;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += wait_ms / 1000;
+    deadline.tv_nsec += (long)(wait_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    while (!checkpointer->stopping &&
+           pthread_cond_timedwait(&checkpointer->wake, &checkpointer->lock, &deadline) == 0) {
+    }
+  }
+  pthread_mutex_unlock(&checkpointer->lock);
+  return NULL;
+}
 
 /**
- * 檢查是否在交易中
+ * 啟動背景檢查點執行緒，呼叫端（前景）取得資料庫鎖
  *
  * @param table Table 指標
- * @return 是否在交易中
+ * @param interval_ms 修改留在記憶體中的最長時間（0 表示不依時間觸發）
+ * @param dirty_pages 髒頁達到此數量時開始寫回（0 表示不依數量觸發）
  */
-bool is_in_transaction(Table *table) {
-  return table->transaction && table->transaction->state == TXN_STATE_ACTIVE;
+void checkpointer_start(Table *table, uint32_t interval_ms, uint32_t dirty_pages) {
+  Checkpointer *checkpointer = malloc(sizeof(Checkpointer));
+  if (checkpointer == NULL) {
+    printf("Error: Memory allocation failed for checkpointer\n");
+    exit(EXIT_FAILURE);
+  }
+  checkpointer->stopping = false;
+  checkpointer->interval_ms = interval_ms;
+  checkpointer->dirty_pages = dirty_pages;
+  checkpointer->active = false;
+  checkpointer->has_changes = false;
+  checkpointer->checkpoints = 0;
+  checkpointer->pages_written = 0;
+  pthread_mutex_init(&checkpointer->lock, NULL);
+  pthread_cond_init(&checkpointer->wake, NULL);
+  pthread_mutex_lock(&checkpointer->lock);
+  table->checkpointer = checkpointer;
+
+  int result = pthread_create(&checkpointer->thread, NULL, checkpointer_main, table);
+  if (result != 0) {
+    printf("Error: Unable to start checkpointer thread: %s\n", strerror(result));
+    exit(EXIT_FAILURE);
+  }
 }
 
 /**
- * 開始一個新交易
+ * 停止背景檢查點執行緒（呼叫端持有資料庫鎖），未啟動時不做任何事
+ *
+ * 背景執行緒正在等待時立即結束；尚未寫回的修改由呼叫端處理。
  *
  * @param table Table 指標
- * @return Transaction 指標
  */
-Transaction *transaction_begin(Table *table) {
-  if (is_in_transaction(table)) {
-    printf("Error: Transaction already in progress.\n");
-    return NULL;
-  }
-
-  Transaction *txn = table->transaction;
-  txn->state = TXN_STATE_ACTIVE;
-  txn->num_modified = 0;
-  
-  // 清空影子頁面
-  for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    if (txn->shadow_pages[i]) {
-      free(txn->shadow_pages[i]);
-      txn->shadow_pages[i] = NULL;
-    }
-    txn->modified_pages[i] = false;
+void checkpointer_stop(Table *table) {
+  Checkpointer *checkpointer = table->checkpointer;
+  if (checkpointer == NULL) {
+    return;
   }
+  checkpointer->stopping = true;
+  pthread_cond_signal(&checkpointer->wake);
+  pthread_mutex_unlock(&checkpointer->lock);
+  pthread_join(checkpointer->thread, NULL);
 
-  return txn;
+  pthread_cond_destroy(&checkpointer->wake);
+  pthread_mutex_destroy(&checkpointer->lock);
+  free(checkpointer);
+  table->checkpointer = NULL;
 }
 
 /**
- * 取得頁面用於讀取
- * 如果在交易中且有影子頁面，返回影子頁面；否則返回實際頁面
+ * 取得資料庫鎖（前景開始執行命令之前），背景檢查點停用時不做任何事
  *
  * @param table Table 指標
- * @param page_num 頁面編號
- * @return 頁面指標
  */
-void *get_page_for_read(Table *table, uint32_t page_num) {
-  if (is_in_transaction(table) &&
-      table->transaction->shadow_pages[page_num]) {
-    return table->transaction->shadow_pages[page_num];
+void table_lock(Table *table) {
+  if (table->checkpointer != NULL) {
+    pthread_mutex_lock(&table->checkpointer->lock);
   }
-  return get_page(table->pager, page_num);
 }
 
 /**
- * 取得用於寫入的頁面
- * 如果在交易中，返回影子頁面；否則返回實際頁面
+ * 釋放資料庫鎖（前景等待輸入之前），讓背景檢查點寫回修改
  *
  * @param table Table 指標
- * @param page_num 頁面編號
- * @return 頁面指標
  */
-void *get_page_for_write(Table *table, uint32_t page_num) {
-  if (!is_in_transaction(table)) {
-    // 不在交易中，直接返回實際頁面
-    return get_page(table->pager, page_num);
+void table_unlock(Table *table) {
+  if (table->checkpointer != NULL) {
+    pthread_mutex_unlock(&table->checkpointer->lock);
   }
+}
 
-  Transaction *txn = table->transaction;
-  
-  // 如果這個頁面還沒有影子頁面，創建一個
-  if (!txn->shadow_pages[page_num]) {
-    // 創建影子頁面並複製原始頁面的內容
-    txn->shadow_pages[page_num] = malloc(PAGE_SIZE);
-    if (txn->shadow_pages[page_num] == NULL) {
-      printf("Error: Memory allocation failed for shadow page %u\n", page_num);
-      exit(EXIT_FAILURE);
-    }
+/* ============================================================================
+ * 標頭頁與空閒頁
+ * ============================================================================
+ */
 
-    void *original_page = get_page(table->pager, page_num);
-    memcpy(txn->shadow_pages[page_num], original_page, PAGE_SIZE);
-    
-    // 標記這個頁面已被修改
-    if (!txn->modified_pages[page_num]) {
-      txn->modified_pages[page_num] = true;
-      txn->num_modified++;
-    }
-  }
+/**
+ * 取得標頭頁中檔案格式版本的指標
+ */
+uint32_t *header_format_version(void *header) {
+  return header + HEADER_FORMAT_VERSION_OFFSET;
+}
 
-  return txn->shadow_pages[page_num];
+/**
+ * 取得標頭頁中頁面大小的指標
+ */
+uint32_t *header_page_size(void *header) {
+  return header + HEADER_PAGE_SIZE_OFFSET;
 }
 
 /**
- * 提交交易
- * 將所有影子頁面的內容寫回實際頁面並持久化
- *
- * @param table Table 指標
- * @return 執行結果
+ * 取得標頭頁中根節點頁面編號的指標
  */
-ExecuteResult transaction_commit(Table *table) {
-  if (!is_in_transaction(table)) {
-    printf("Error: No active transaction.\n");
-    return EXECUTE_TABLE_FULL; // 借用這個錯誤碼
-  }
+uint32_t *header_root_page(void *header) {
+  return header + HEADER_ROOT_PAGE_OFFSET;
+}
 
-  Transaction *txn = table->transaction;
-  
-  // 將所有影子頁面寫回實際頁面
-  for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    if (txn->modified_pages[i] && txn->shadow_pages[i]) {
-      void *original_page = get_page(table->pager, i);
-      memcpy(original_page, txn->shadow_pages[i], PAGE_SIZE);
-      
-      // 立即寫回磁碟以確保持久性（Durability）
-      pager_flush(table->pager, i);
-      
-      // 釋放影子頁面
-      free(txn->shadow_pages[i]);
-      txn->shadow_pages[i] = NULL;
-      txn->modified_pages[i] = false;
-    }
-  }
+/**
+ * 取得標頭頁中空閒頁串列開頭的指標
+ */
+uint32_t *header_freelist_head(void *header) {
+  return header + HEADER_FREELIST_HEAD_OFFSET;
+}
 
-  txn->state = TXN_STATE_COMMITTED;
-  txn->num_modified = 0;
-  
-  return EXECUTE_SUCCESS;
+/**
+ * 取得標頭頁中空閒頁數量的指標
+ */
+uint32_t *header_free_page_count(void *header) {
+  return header + HEADER_FREE_PAGE_COUNT_OFFSET;
 }
 
 /**
- * 回滾交易
- * 丟棄所有影子頁面，恢復到交易開始前的狀態
- *
- * @param table Table 指標
- * @return 執行結果
+ * 取得標頭頁中頁面總數的指標
  */
-ExecuteResult transaction_rollback(Table *table) {
-  if (!is_in_transaction(table)) {
-    printf("Error: No active transaction.\n");
-    return EXECUTE_TABLE_FULL; // 借用這個錯誤碼
-  }
+uint32_t *header_page_count(void *header) {
+  return header + HEADER_PAGE_COUNT_OFFSET;
+}
 
-  Transaction *txn = table->transaction;
-  
-  // 釋放所有影子頁面（丟棄所有修改）
-  for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    if (txn->shadow_pages[i]) {
-      free(txn->shadow_pages[i]);
-      txn->shadow_pages[i] = NULL;
-    }
-    txn->modified_pages[i] = false;
-  }
+/**
+ * 取得標頭頁中統計資訊頁編號的指標
+ */
+uint32_t *header_stats_page(void *header) {
+  return header + HEADER_STATS_PAGE_OFFSET;
+}
 
-  txn->state = TXN_STATE_ABORTED;
-  txn->num_modified = 0;
-  
-  return EXECUTE_SUCCESS;
+/**
+ * 取得空閒頁中下一個空閒頁編號的指標
+ */
+uint32_t *free_page_next(void *page) {
+  return page + FREE_PAGE_NEXT_OFFSET;
+}
+
+uint32_t *page_checksum_field(void *page) {
+  return page + PAGE_CHECKSUM_OFFSET;
+}
+
+/**
+ * 初始化標頭頁
+ *
+ * @param header 標頭頁指標
+ * @param root_page_num 根節點頁面編號
+ */
+void initialize_header_page(void *header, uint32_t root_page_num) {
+  memset(header, 0, PAGE_SIZE);
+  memcpy(header + HEADER_MAGIC_OFFSET, HEADER_MAGIC, HEADER_MAGIC_SIZE);
+  *header_format_version(header) = DB_FORMAT_VERSION;
+  *header_page_size(header) = PAGE_SIZE;
+  *header_root_page(header) = root_page_num;
+  *header_freelist_head(header) = 0;
+  *header_free_page_count(header) = 0;
+  *header_page_count(header) = root_page_num + 1;
+  *header_stats_page(header) = 0;
+}
+
+/**
+ * 檢查標頭頁的檔案識別碼
+ *
+ * @param header 標頭頁指標
+ * @return 是否為有效的標頭頁
+ */
+bool header_is_valid(void *header) {
+  return memcmp(header + HEADER_MAGIC_OFFSET, HEADER_MAGIC, HEADER_MAGIC_SIZE) == 0;
 }
 
 /* ============================================================================
@@ -1019,18 +6294,36 @@ void set_node_root(void *node, bool is_root) {
 uint32_t *node_parent(void *node) { return node + PARENT_POINTER_OFFSET; }
 
 /**
- * 取得節點的最大鍵值（遞迴）
+ * 取得節點的最大鍵值（沿著 right_child 往下走到最右側的葉節點）
  *
- * @param pager Pager 指標
- * @param node 節點指標
+ * @param table Table 指標
+ * @param page_num 節點頁面編號
  * @return 最大鍵值
  */
-uint32_t get_node_max_key(Pager *pager, void *node) {
-  if (get_node_type(node) == NODE_LEAF) {
-    return *leaf_node_key(node, *leaf_node_num_cells(node) - 1);
-  }
-  void *right_child = get_page(pager, *internal_node_right_child(node));
-  return get_node_max_key(pager, right_child);
+uint32_t get_node_max_key(Table *table, uint32_t page_num) {
+  PageHandle node = table_pin_page(table, page_num);
+  while (get_node_type(node.data) == NODE_INTERNAL) {
+    uint32_t right_child_page_num = *internal_node_right_child(node.data);
+    table_unpin_page(table, &node);
+    node = table_pin_page(table, right_child_page_num);
+  }
+  uint32_t max_key = *leaf_node_key(node.data, *leaf_node_num_cells(node.data) - 1);
+  table_unpin_page(table, &node);
+  return max_key;
+}
+
+/**
+ * 更新節點的 parent 指標
+ *
+ * @param table Table 指標
+ * @param page_num 節點頁面編號
+ * @param parent_page_num 新的父節點頁面編號
+ */
+static void update_node_parent(Table *table, uint32_t page_num,
+                               uint32_t parent_page_num) {
+  PageHandle node = table_pin_page_for_write(table, page_num);
+  *node_parent(node.data) = parent_page_num;
+  table_unpin_page(table, &node);
 }
 
 /* ============================================================================
@@ -1052,25 +6345,35 @@ uint32_t *leaf_node_next_leaf(void *node) {
   return node + LEAF_NODE_NEXT_LEAF_OFFSET;
 }
 
-/**
- * 取得葉節點第 cell_num 個 cell 的位址
- */
-void *leaf_node_cell(void *node, uint32_t cell_num) {
-  return node + LEAF_NODE_HEADER_SIZE + cell_num * LEAF_NODE_CELL_SIZE;
-}
-
 /**
  * 取得葉節點第 cell_num 個 cell 的 key 指標
  */
 uint32_t *leaf_node_key(void *node, uint32_t cell_num) {
-  return leaf_node_cell(node, cell_num);
+  return node + LEAF_NODE_KEYS_OFFSET + cell_num * LEAF_NODE_KEY_SIZE;
 }
 
 /**
  * 取得葉節點第 cell_num 個 cell 的 value 位址
  */
 void *leaf_node_value(void *node, uint32_t cell_num) {
-  return leaf_node_cell(node, cell_num) + LEAF_NODE_VALUE_OFFSET;
+  return node + LEAF_NODE_VALUES_OFFSET + cell_num * LEAF_NODE_VALUE_SIZE;
+}
+
+/**
+ * 搬移連續的 cell（key 與 value 分別搬移），來源與目的可以是同一個節點且重疊
+ *
+ * @param destination 目的葉節點
+ * @param destination_cell 目的位置的第一個 cell
+ * @param source 來源葉節點
+ * @param source_cell 來源的第一個 cell
+ * @param count cell 數量
+ */
+void leaf_node_move_cells(void *destination, uint32_t destination_cell, void *source,
+                          uint32_t source_cell, uint32_t count) {
+  memmove(leaf_node_key(destination, destination_cell), leaf_node_key(source, source_cell),
+          (size_t)count * LEAF_NODE_KEY_SIZE);
+  memmove(leaf_node_value(destination, destination_cell), leaf_node_value(source, source_cell),
+          (size_t)count * LEAF_NODE_VALUE_SIZE);
 }
 
 /**
@@ -1084,7 +6387,32 @@ void initialize_leaf_node(void *node) {
 }
 
 /**
- * 在葉節點中使用二分搜尋找到 key 的位置
+ * 在葉節點的 key 陣列中找到第一個不小於 key 的 cell
+ *
+ * key 陣列連續存放：鍵數超過 NODE_SEARCH_WINDOW 時先以無分支的二分搜尋
+ * （只移動下界，以條件選擇取代分支）縮小範圍，再以向量比較計算剩餘鍵中小於
+ * key 的數量。4 KB 頁面的葉節點只有 13 個 cell，直接進行向量比較。
+ *
+ * @param node 葉節點指標
+ * @param key 要搜尋的鍵
+ * @return cell 索引（可能等於 cell 數量）
+ */
+uint32_t leaf_node_find_cell(void *node, uint32_t key) {
+  const uint32_t *keys = leaf_node_key(node, 0);
+  uint32_t base = 0;
+  uint32_t remaining = *leaf_node_num_cells(node);
+
+  while (remaining > NODE_SEARCH_WINDOW) {
+    uint32_t half = remaining / 2;
+    base = keys[base + half - 1] < key ? base + half : base;
+    remaining -= half;
+  }
+
+  return base + key_array_count_below(keys + base, remaining, key);
+}
+
+/**
+ * 在葉節點中找到 key 的位置
  *
  * @param table Table 指標
  * @param page_num 頁面編號
@@ -1092,9 +6420,6 @@ void initialize_leaf_node(void *node) {
  * @return Cursor 指標，指向 key 的位置或應插入的位置
  */
 Cursor *leaf_node_find(Table *table, uint32_t page_num, uint32_t key) {
-  void *node = get_page_for_read(table, page_num);
-  uint32_t num_cells = *leaf_node_num_cells(node);
-
   Cursor *cursor = malloc(sizeof(Cursor));
   if (cursor == NULL) {
     printf("Error: Memory allocation failed for cursor\n");
@@ -1104,25 +6429,12 @@ Cursor *leaf_node_find(Table *table, uint32_t page_num, uint32_t key) {
   cursor->table = table;
   cursor->page_num = page_num;
   cursor->end_of_table = false;  // 初始化 end_of_table
+  // cursor 持有葉節點的釘選，直到移動到其他葉節點或 cursor_close
+  cursor->leaf = table_pin_page(table, page_num);
+  void *node = cursor->leaf.data;
+  uint32_t num_cells = *leaf_node_num_cells(node);
 
-  // 二分搜尋
-  uint32_t min_index = 0;
-  uint32_t one_past_max_index = num_cells;
-  while (one_past_max_index != min_index) {
-    uint32_t index = (min_index + one_past_max_index) / 2;
-    uint32_t key_at_index = *leaf_node_key(node, index);
-    if (key == key_at_index) {
-      cursor->cell_num = index;
-      return cursor;
-    }
-    if (key < key_at_index) {
-      one_past_max_index = index;
-    } else {
-      min_index = index + 1;
-    }
-  }
-
-  cursor->cell_num = min_index;
+  cursor->cell_num = leaf_node_find_cell(node, key);
   
   // 如果 cursor 指向超出範圍的位置，標記為 end_of_table
   if (cursor->cell_num >= num_cells) {
@@ -1140,8 +6452,9 @@ Cursor *leaf_node_find(Table *table, uint32_t page_num, uint32_t key) {
  * @param value Row 資料指標
  */
 void leaf_node_insert(Cursor *cursor, uint32_t key, Row *value) {
-  void *node = get_page_for_write(cursor->table, cursor->page_num);
-  uint32_t num_cells = *leaf_node_num_cells(node);
+  PageHandle node = table_pin_page(cursor->table, cursor->page_num);
+  uint32_t num_cells = *leaf_node_num_cells(node.data);
+  table_unpin_page(cursor->table, &node);
 
   if (num_cells >= LEAF_NODE_MAX_CELLS) {
     // 節點已滿，需要分裂
@@ -1149,74 +6462,232 @@ void leaf_node_insert(Cursor *cursor, uint32_t key, Row *value) {
     return;
   }
 
-  if (cursor->cell_num < num_cells) {
+  table_row_insert(cursor->table, cursor->page_num, cursor->cell_num, key, value);
+}
+
+/**
+ * 在葉節點套用一筆列變更
+ *
+ * 交易以列變更記錄直接修改頁面、回滾時以前影像復原、以及復原時重做日誌的
+ * 列變更記錄都使用此函式。插入與更新的 value 為 NULL 時只調整 cell，
+ * 由呼叫端寫入值。
+ *
+ * @param node 葉節點
+ * @param type 變更種類
+ * @param cell_num cell 位置
+ * @param key 鍵（更新與刪除時必須與 cell 的鍵相同）
+ * @param value cell 的值（ROW_SIZE bytes）
+ * @return 變更是否符合節點目前的內容（不符合時不修改節點）
+ */
+bool leaf_node_apply_row_change(void *node, RowChangeType type, uint32_t cell_num,
+                                uint32_t key, const void *value) {
+  if (get_node_type(node) != NODE_LEAF) {
+    return false;
+  }
+  uint32_t num_cells = *leaf_node_num_cells(node);
+
+  switch (type) {
+  case ROW_CHANGE_INSERT:
+    if (num_cells >= LEAF_NODE_MAX_CELLS || cell_num > num_cells) {
+      return false;
+    }
     // 為新 cell 騰出空間
-    for (uint32_t i = num_cells; i > cursor->cell_num; i--) {
-      memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1),
-             LEAF_NODE_CELL_SIZE);
+    leaf_node_move_cells(node, cell_num + 1, node, cell_num, num_cells - cell_num);
+    *leaf_node_num_cells(node) = num_cells + 1;
+    *leaf_node_key(node, cell_num) = key;
+    break;
+  case ROW_CHANGE_UPDATE:
+    if (cell_num >= num_cells || *leaf_node_key(node, cell_num) != key) {
+      return false;
+    }
+    break;
+  case ROW_CHANGE_DELETE:
+    if (cell_num >= num_cells || *leaf_node_key(node, cell_num) != key) {
+      return false;
     }
+    // 將後面的 cell 向前移動以填補刪除的空缺
+    leaf_node_move_cells(node, cell_num, node, cell_num + 1, num_cells - cell_num - 1);
+    *leaf_node_num_cells(node) = num_cells - 1;
+    return true;
   }
 
-  *(leaf_node_num_cells(node)) = num_cells + 1;
-  *(leaf_node_key(node, cursor->cell_num)) = key;
-  serialize_row(value, leaf_node_value(node, cursor->cell_num));
+  if (value != NULL) {
+    memcpy(leaf_node_value(node, cell_num), value, LEAF_NODE_VALUE_SIZE);
+  }
+  return true;
 }
 
 /**
  * 從葉節點中刪除一筆資料
  *
+ * 刪除後節點仍有資料（或為根節點）時只是一筆列變更；節點變空時需要合併，
+ * 以整頁修改。
+ *
  * @param cursor Cursor 指標，指向要刪除的 cell 位置
  */
 void leaf_node_delete(Cursor *cursor) {
-  void *node = get_page_for_write(cursor->table, cursor->page_num);
-  uint32_t num_cells = *leaf_node_num_cells(node);
+  Table *table = cursor->table;
+  PageHandle node = table_pin_page(table, cursor->page_num);
+  uint32_t num_cells = *leaf_node_num_cells(node.data);
+  bool is_root = is_node_root(node.data);
+  table_unpin_page(table, &node);
 
   if (cursor->cell_num >= num_cells) {
     // 超出範圍，不應該發生
     return;
   }
+  if (num_cells > 1 || is_root) {
+    table_row_delete(table, cursor->page_num, cursor->cell_num);
+    return;
+  }
+
+  node = table_pin_page_for_write(table, cursor->page_num);
+  table_row_delete(table, cursor->page_num, cursor->cell_num);
+
+  // 節點已變空且不是根節點，需要合併
+  // 找到父節點；合併會以寫入方式釘選父節點，因此先讀出需要的資訊並釋放
+  uint32_t parent_page_num = *node_parent(node.data);
+  PageHandle parent = table_pin_page(table, parent_page_num);
+  uint32_t num_keys = *internal_node_num_keys(parent.data);
+  uint32_t child_index = internal_node_child_index(parent.data, cursor->page_num);
+  uint32_t left_sibling_page =
+      child_index > 0 ? *internal_node_child(parent.data, child_index - 1) : 0;
+  uint32_t right_sibling_page =
+      num_keys > 0 ? *internal_node_child(parent.data, 1) : 0;
+  table_unpin_page(table, &parent);
+
+  if (child_index > 0) {
+    // 與左兄弟節點合併：空節點沒有資料，左兄弟一定容納得下
+    leaf_node_merge(table, left_sibling_page, cursor->page_num);
+  } else if (num_keys > 0) {
+    // 最左側的子節點：將右兄弟節點併入此空節點
+    leaf_node_merge(table, cursor->page_num, right_sibling_page);
+  } else {
+    // 父節點只有這個子節點：將空葉節點從葉節點鏈與父節點中移除後釋放
+    uint32_t prev_page_num = leaf_node_predecessor(table, cursor->page_num);
+    if (prev_page_num != 0) {
+      PageHandle prev = table_pin_page_for_write(table, prev_page_num);
+      *leaf_node_next_leaf(prev.data) = *leaf_node_next_leaf(node.data);
+      table_unpin_page(table, &prev);
+    }
+    internal_node_remove_child(table, parent_page_num, cursor->page_num);
+    table_free_page(table, cursor->page_num);
+  }
+  table_unpin_page(table, &node);
+}
+
+/**
+ * 找出葉節點在 next_leaf 鏈中的前一個葉節點
+ *
+ * 沿著 parent 指標往上，找到第一個不是最左側子節點的祖先，
+ * 再往下走到其左兄弟子樹中最右側的葉節點。
+ *
+ * @param table Table 指標
+ * @param page_num 葉節點頁面編號
+ * @return 前一個葉節點的頁面編號；若已是最左側的葉節點則返回 0
+ */
+uint32_t leaf_node_predecessor(Table *table, uint32_t page_num) {
+  uint32_t child_page_num = page_num;
+  PageHandle node = table_pin_page(table, page_num);
+
+  while (!is_node_root(node.data)) {
+    uint32_t parent_page_num = *node_parent(node.data);
+    table_unpin_page(table, &node);
+    PageHandle parent = table_pin_page(table, parent_page_num);
+    uint32_t child_index = internal_node_child_index(parent.data, child_page_num);
+
+    if (child_index > 0) {
+      uint32_t cur_page_num = *internal_node_child(parent.data, child_index - 1);
+      table_unpin_page(table, &parent);
+      PageHandle cur = table_pin_page(table, cur_page_num);
+      while (get_node_type(cur.data) == NODE_INTERNAL) {
+        cur_page_num = *internal_node_right_child(cur.data);
+        table_unpin_page(table, &cur);
+        cur = table_pin_page(table, cur_page_num);
+      }
+      table_unpin_page(table, &cur);
+      return cur_page_num;
+    }
 
-  // 將後面的 cell 向前移動以填補刪除的空缺
-  for (uint32_t i = cursor->cell_num; i < num_cells - 1; i++) {
-    memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i + 1),
-           LEAF_NODE_CELL_SIZE);
+    child_page_num = parent_page_num;
+    node = parent;
   }
 
-  // 減少 cell 數量
-  *(leaf_node_num_cells(node)) = num_cells - 1;
+  table_unpin_page(table, &node);
+  return 0;
+}
 
-  // 檢查是否需要合併節點（只在節點為空且不是根節點時合併）
-  uint32_t current_cells = *leaf_node_num_cells(node);
-  if (current_cells == 0 && !is_node_root(node)) {
-    // 找到父節點
-    uint32_t parent_page_num = *node_parent(node);
-    void *parent = get_page(cursor->table->pager, parent_page_num);
+/**
+ * 取得子節點在內部節點中的位置
+ *
+ * @param node 內部節點指標
+ * @param child_page_num 子節點頁面編號
+ * @return 子節點的 cell 索引；若為 right_child 則返回 num_keys
+ */
+uint32_t internal_node_child_index(void *node, uint32_t child_page_num) {
+  uint32_t num_keys = *internal_node_num_keys(node);
+  for (uint32_t i = 0; i < num_keys; i++) {
+    if (*internal_node_child(node, i) == child_page_num) {
+      return i;
+    }
+  }
+  return num_keys;
+}
 
-    // 找到當前節點在父節點中的位置
-    uint32_t child_index = 0;
-    uint32_t num_keys = *internal_node_num_keys(parent);
+/**
+ * 從內部節點移除一個子節點的引用
+ *
+ * 呼叫端負責處理被移除的子節點本身（例如將空葉節點從 next_leaf 鏈中移除並釋放）。
+ * 若父節點因此沒有任何子節點，則遞迴地從祖父節點移除並釋放該內部節點；
+ * 若變空的是根節點，則將根節點重設為空的葉節點。
+ *
+ * @param table Table 指標
+ * @param parent_page_num 內部節點頁面編號
+ * @param child_page_num 要移除的子節點頁面編號
+ */
+void internal_node_remove_child(Table *table, uint32_t parent_page_num,
+                                uint32_t child_page_num) {
+  PageHandle parent = table_pin_page_for_write(table, parent_page_num);
+  uint32_t num_keys = *internal_node_num_keys(parent.data);
 
-    for (uint32_t i = 0; i < num_keys; i++) {
-      if (*internal_node_child(parent, i) == cursor->page_num) {
-        child_index = i;
-        break;
-      }
+  if (*internal_node_right_child(parent.data) == child_page_num) {
+    if (num_keys > 0) {
+      // 最後一個 cell 的子節點成為新的 right_child
+      *internal_node_right_child(parent.data) =
+          *internal_node_child(parent.data, num_keys - 1);
+      *internal_node_num_keys(parent.data) = num_keys - 1;
+    } else if (is_node_root(parent.data)) {
+      // 父節點已沒有其他子節點
+      initialize_leaf_node(parent.data);
+      set_node_root(parent.data, true);
+    } else {
+      internal_node_remove_child(table, *node_parent(parent.data), parent_page_num);
+      table_free_page(table, parent_page_num);
     }
+    table_unpin_page(table, &parent);
+    return;
+  }
 
-    // 只嘗試與左兄弟節點合併，避免複雜的邏輯
-    if (child_index > 0) {
-      uint32_t left_sibling_page =
-          *internal_node_child(parent, child_index - 1);
-      void *left_sibling = get_page(cursor->table->pager, left_sibling_page);
-      uint32_t left_cells = *leaf_node_num_cells(left_sibling);
+  uint32_t child_index = internal_node_child_index(parent.data, child_page_num);
+  if (child_index < num_keys) {
+    internal_node_remove_cell(parent.data, child_index);
+  }
+  table_unpin_page(table, &parent);
+}
 
-      // 如果左兄弟節點有空間，就合併
-      if (left_cells < LEAF_NODE_MAX_CELLS) {
-        leaf_node_merge(cursor->table, left_sibling_page, cursor->page_num);
-        return;
-      }
-    }
+/**
+ * 移除內部節點中的一個 cell（子節點與其鍵值），後面的 cell 向前移動
+ *
+ * @param node 內部節點指標
+ * @param cell_num 要移除的 cell 索引（必須小於 num_keys）
+ */
+void internal_node_remove_cell(void *node, uint32_t cell_num) {
+  uint32_t num_keys = *internal_node_num_keys(node);
+  for (uint32_t i = cell_num; i < num_keys - 1; i++) {
+    memcpy(internal_node_cell(node, i), internal_node_cell(node, i + 1),
+           INTERNAL_NODE_CELL_SIZE);
   }
+  *internal_node_num_keys(node) = num_keys - 1;
 }
 
 /**
@@ -1227,8 +6698,11 @@ void leaf_node_delete(Cursor *cursor) {
  * @return 是否應該合併
  */
 bool should_merge_leaf_nodes(Table *table, uint32_t page_num) {
-  void *node = get_page(table->pager, page_num);
-  uint32_t num_cells = *leaf_node_num_cells(node);
+  PageHandle node = table_pin_page(table, page_num);
+  uint32_t num_cells = *leaf_node_num_cells(node.data);
+  bool is_root = is_node_root(node.data);
+  uint32_t parent_page_num = *node_parent(node.data);
+  table_unpin_page(table, &node);
 
   // 如果節點為空，應該合併
   if (num_cells == 0) {
@@ -1236,16 +6710,16 @@ bool should_merge_leaf_nodes(Table *table, uint32_t page_num) {
   }
 
   // 如果節點不是根節點且 cell 數量少於閾值，考慮合併
-  if (!is_node_root(node)) {
-    uint32_t parent_page_num = *node_parent(node);
-    void *parent = get_page(table->pager, parent_page_num);
+  bool should_merge = false;
+  if (!is_root) {
+    PageHandle parent = table_pin_page(table, parent_page_num);
 
     // 找到當前節點在父節點中的位置
     uint32_t child_index = 0;
-    uint32_t num_keys = *internal_node_num_keys(parent);
+    uint32_t num_keys = *internal_node_num_keys(parent.data);
 
     for (uint32_t i = 0; i < num_keys; i++) {
-      if (*internal_node_child(parent, i) == page_num) {
+      if (*internal_node_child(parent.data, i) == page_num) {
         child_index = i;
         break;
       }
@@ -1254,31 +6728,35 @@ bool should_merge_leaf_nodes(Table *table, uint32_t page_num) {
     // 檢查左兄弟節點
     if (child_index > 0) {
       uint32_t left_sibling_page =
-          *internal_node_child(parent, child_index - 1);
-      void *left_sibling = get_page(table->pager, left_sibling_page);
-      uint32_t left_cells = *leaf_node_num_cells(left_sibling);
+          *internal_node_child(parent.data, child_index - 1);
+      PageHandle left_sibling = table_pin_page(table, left_sibling_page);
+      uint32_t left_cells = *leaf_node_num_cells(left_sibling.data);
+      table_unpin_page(table, &left_sibling);
 
       // 如果兩個節點的 cell 總數不超過最大容量，可以合併
       if (num_cells + left_cells <= LEAF_NODE_MAX_CELLS) {
-        return true;
+        should_merge = true;
       }
     }
 
     // 檢查右兄弟節點
-    if (child_index < num_keys) {
+    if (!should_merge && child_index < num_keys) {
       uint32_t right_sibling_page =
-          *internal_node_child(parent, child_index + 1);
-      void *right_sibling = get_page(table->pager, right_sibling_page);
-      uint32_t right_cells = *leaf_node_num_cells(right_sibling);
+          *internal_node_child(parent.data, child_index + 1);
+      PageHandle right_sibling = table_pin_page(table, right_sibling_page);
+      uint32_t right_cells = *leaf_node_num_cells(right_sibling.data);
+      table_unpin_page(table, &right_sibling);
 
       // 如果兩個節點的 cell 總數不超過最大容量，可以合併
       if (num_cells + right_cells <= LEAF_NODE_MAX_CELLS) {
-        return true;
+        should_merge = true;
       }
     }
+
+    table_unpin_page(table, &parent);
   }
 
-  return false;
+  return should_merge;
 }
 
 /**
@@ -1290,52 +6768,38 @@ bool should_merge_leaf_nodes(Table *table, uint32_t page_num) {
  */
 void leaf_node_merge(Table *table, uint32_t left_page_num,
                      uint32_t right_page_num) {
-  void *left_node = get_page(table->pager, left_page_num);
-  void *right_node = get_page(table->pager, right_page_num);
+  PageHandle left_node = table_pin_page_for_write(table, left_page_num);
+  PageHandle right_node = table_pin_page(table, right_page_num);
 
-  uint32_t left_cells = *leaf_node_num_cells(left_node);
-  uint32_t right_cells = *leaf_node_num_cells(right_node);
+  uint32_t left_cells = *leaf_node_num_cells(left_node.data);
+  uint32_t right_cells = *leaf_node_num_cells(right_node.data);
 
   // 將右節點的所有 cell 移到左節點
-  for (uint32_t i = 0; i < right_cells; i++) {
-    void *source_cell = leaf_node_cell(right_node, i);
-    void *dest_cell = leaf_node_cell(left_node, left_cells + i);
-    memcpy(dest_cell, source_cell, LEAF_NODE_CELL_SIZE);
-  }
+  leaf_node_move_cells(left_node.data, left_cells, right_node.data, 0, right_cells);
 
   // 更新左節點的 cell 數量
-  *(leaf_node_num_cells(left_node)) = left_cells + right_cells;
+  *(leaf_node_num_cells(left_node.data)) = left_cells + right_cells;
 
   // 更新左節點的 next_leaf 指標
-  uint32_t right_next_leaf = *leaf_node_next_leaf(right_node);
-  *(leaf_node_next_leaf(left_node)) = right_next_leaf;
-
-  // 從父節點中移除右節點的引用
-  uint32_t parent_page_num = *node_parent(right_node);
-  void *parent = get_page(table->pager, parent_page_num);
-
-  // 找到右節點在父節點中的位置
-  uint32_t child_index = 0;
-  uint32_t num_keys = *internal_node_num_keys(parent);
+  uint32_t right_next_leaf = *leaf_node_next_leaf(right_node.data);
+  *(leaf_node_next_leaf(left_node.data)) = right_next_leaf;
 
-  for (uint32_t i = 0; i < num_keys; i++) {
-    if (*internal_node_child(parent, i) == right_page_num) {
-      child_index = i;
-      break;
-    }
-  }
+  // 右節點即將被釋放（釋放時以寫入方式釘選），先讀出其父節點後放開
+  uint32_t parent_page_num = *node_parent(right_node.data);
+  table_unpin_page(table, &right_node);
+  table_unpin_page(table, &left_node);
 
-  // 移除右節點的引用
-  for (uint32_t i = child_index; i < num_keys - 1; i++) {
-    *internal_node_child(parent, i) = *internal_node_child(parent, i + 1);
-    *internal_node_key(parent, i) = *internal_node_key(parent, i + 1);
-  }
+  // 從父節點中移除右節點的引用
+  PageHandle parent = table_pin_page_for_write(table, parent_page_num);
 
-  // 減少父節點的鍵數量
-  *(internal_node_num_keys(parent)) = num_keys - 1;
+  // 左節點接手右節點的位置（包含其鍵值或 right_child 身分），再移除左節點原本的 cell
+  uint32_t right_index = internal_node_child_index(parent.data, right_page_num);
+  *internal_node_child(parent.data, right_index) = left_page_num;
+  internal_node_remove_cell(parent.data, right_index - 1);
+  table_unpin_page(table, &parent);
 
-  // 釋放右節點的頁面
-  table->pager->pages[right_page_num] = NULL;
+  // 釋放右節點的頁面到空閒頁串列
+  table_free_page(table, right_page_num);
 }
 
 /**
@@ -1346,8 +6810,11 @@ void leaf_node_merge(Table *table, uint32_t left_page_num,
  * @return 是否應該合併
  */
 bool should_merge_internal_nodes(Table *table, uint32_t page_num) {
-  void *node = get_page(table->pager, page_num);
-  uint32_t num_keys = *internal_node_num_keys(node);
+  PageHandle node = table_pin_page(table, page_num);
+  uint32_t num_keys = *internal_node_num_keys(node.data);
+  bool is_root = is_node_root(node.data);
+  uint32_t parent_page_num = *node_parent(node.data);
+  table_unpin_page(table, &node);
 
   // 如果節點為空，應該合併
   if (num_keys == 0) {
@@ -1355,16 +6822,16 @@ bool should_merge_internal_nodes(Table *table, uint32_t page_num) {
   }
 
   // 如果節點不是根節點且鍵數量少於閾值，考慮合併
-  if (!is_node_root(node)) {
-    uint32_t parent_page_num = *node_parent(node);
-    void *parent = get_page(table->pager, parent_page_num);
+  bool should_merge = false;
+  if (!is_root) {
+    PageHandle parent = table_pin_page(table, parent_page_num);
 
     // 找到當前節點在父節點中的位置
     uint32_t child_index = 0;
-    uint32_t parent_num_keys = *internal_node_num_keys(parent);
+    uint32_t parent_num_keys = *internal_node_num_keys(parent.data);
 
     for (uint32_t i = 0; i < parent_num_keys; i++) {
-      if (*internal_node_child(parent, i) == page_num) {
+      if (*internal_node_child(parent.data, i) == page_num) {
         child_index = i;
         break;
       }
@@ -1373,31 +6840,35 @@ bool should_merge_internal_nodes(Table *table, uint32_t page_num) {
     // 檢查左兄弟節點
     if (child_index > 0) {
       uint32_t left_sibling_page =
-          *internal_node_child(parent, child_index - 1);
-      void *left_sibling = get_page(table->pager, left_sibling_page);
-      uint32_t left_keys = *internal_node_num_keys(left_sibling);
+          *internal_node_child(parent.data, child_index - 1);
+      PageHandle left_sibling = table_pin_page(table, left_sibling_page);
+      uint32_t left_keys = *internal_node_num_keys(left_sibling.data);
+      table_unpin_page(table, &left_sibling);
 
       // 如果兩個節點的鍵總數不超過最大容量，可以合併
       if (num_keys + left_keys + 1 <= INTERNAL_NODE_MAX_CELLS) {
-        return true;
+        should_merge = true;
       }
     }
 
     // 檢查右兄弟節點
-    if (child_index < parent_num_keys) {
+    if (!should_merge && child_index < parent_num_keys) {
       uint32_t right_sibling_page =
-          *internal_node_child(parent, child_index + 1);
-      void *right_sibling = get_page(table->pager, right_sibling_page);
-      uint32_t right_keys = *internal_node_num_keys(right_sibling);
+          *internal_node_child(parent.data, child_index + 1);
+      PageHandle right_sibling = table_pin_page(table, right_sibling_page);
+      uint32_t right_keys = *internal_node_num_keys(right_sibling.data);
+      table_unpin_page(table, &right_sibling);
 
       // 如果兩個節點的鍵總數不超過最大容量，可以合併
       if (num_keys + right_keys + 1 <= INTERNAL_NODE_MAX_CELLS) {
-        return true;
+        should_merge = true;
       }
     }
+
+    table_unpin_page(table, &parent);
   }
 
-  return false;
+  return should_merge;
 }
 
 /**
@@ -1410,60 +6881,51 @@ bool should_merge_internal_nodes(Table *table, uint32_t page_num) {
  */
 void internal_node_merge(Table *table, uint32_t parent_page_num,
                          uint32_t left_page_num, uint32_t right_page_num) {
-  void *left_node = get_page(table->pager, left_page_num);
-  void *right_node = get_page(table->pager, right_page_num);
-  void *parent = get_page(table->pager, parent_page_num);
+  PageHandle left_node = table_pin_page_for_write(table, left_page_num);
+  PageHandle right_node = table_pin_page(table, right_page_num);
+  PageHandle parent = table_pin_page_for_write(table, parent_page_num);
 
-  uint32_t left_keys = *internal_node_num_keys(left_node);
-  uint32_t right_keys = *internal_node_num_keys(right_node);
+  uint32_t left_keys = *internal_node_num_keys(left_node.data);
+  uint32_t right_keys = *internal_node_num_keys(right_node.data);
 
   // 從父節點中獲取分隔鍵
   uint32_t separator_key = 0;
-  uint32_t num_keys = *internal_node_num_keys(parent);
+  uint32_t num_keys = *internal_node_num_keys(parent.data);
 
   for (uint32_t i = 0; i < num_keys; i++) {
-    if (*internal_node_child(parent, i) == left_page_num) {
-      separator_key = *internal_node_key(parent, i);
+    if (*internal_node_child(parent.data, i) == left_page_num) {
+      separator_key = *internal_node_key(parent.data, i);
       break;
     }
   }
 
   // 將分隔鍵添加到左節點
-  *internal_node_key(left_node, left_keys) = separator_key;
-  *internal_node_child(left_node, left_keys + 1) =
-      *internal_node_child(right_node, 0);
+  *internal_node_key(left_node.data, left_keys) = separator_key;
+  *internal_node_child(left_node.data, left_keys + 1) =
+      *internal_node_child(right_node.data, 0);
 
   // 將右節點的所有鍵和子節點移到左節點
   for (uint32_t i = 0; i < right_keys; i++) {
-    *internal_node_key(left_node, left_keys + 1 + i) =
-        *internal_node_key(right_node, i);
-    *internal_node_child(left_node, left_keys + 2 + i) =
-        *internal_node_child(right_node, i + 1);
+    *internal_node_key(left_node.data, left_keys + 1 + i) =
+        *internal_node_key(right_node.data, i);
+    *internal_node_child(left_node.data, left_keys + 2 + i) =
+        *internal_node_child(right_node.data, i + 1);
   }
 
   // 更新左節點的鍵數量
-  *(internal_node_num_keys(left_node)) = left_keys + right_keys + 1;
-
-  // 從父節點中移除右節點的引用
-  uint32_t child_index = 0;
-  for (uint32_t i = 0; i < num_keys; i++) {
-    if (*internal_node_child(parent, i) == right_page_num) {
-      child_index = i;
-      break;
-    }
-  }
+  *(internal_node_num_keys(left_node.data)) = left_keys + right_keys + 1;
 
-  // 移除右節點的引用
-  for (uint32_t i = child_index; i < num_keys - 1; i++) {
-    *internal_node_child(parent, i) = *internal_node_child(parent, i + 1);
-    *internal_node_key(parent, i) = *internal_node_key(parent, i + 1);
-  }
+  // 從父節點中移除右節點的引用（左節點接手右節點的位置）
+  uint32_t right_index = internal_node_child_index(parent.data, right_page_num);
+  *internal_node_child(parent.data, right_index) = left_page_num;
+  internal_node_remove_cell(parent.data, right_index - 1);
 
-  // 減少父節點的鍵數量
-  *(internal_node_num_keys(parent)) = num_keys - 1;
+  table_unpin_page(table, &parent);
+  table_unpin_page(table, &right_node);
+  table_unpin_page(table, &left_node);
 
-  // 釋放右節點的頁面
-  table->pager->pages[right_page_num] = NULL;
+  // 釋放右節點的頁面到空閒頁串列
+  table_free_page(table, right_page_num);
 }
 
 /**
@@ -1477,14 +6939,15 @@ void internal_node_merge(Table *table, uint32_t parent_page_num,
  * @param value Row 資料指標
  */
 void leaf_node_split_and_insert(Cursor *cursor, uint32_t key, Row *value) {
-  void *old_node = get_page(cursor->table->pager, cursor->page_num);
-  uint32_t old_max = get_node_max_key(cursor->table->pager, old_node);
-  uint32_t new_page_num = get_unused_page_num(cursor->table->pager);
-  void *new_node = get_page(cursor->table->pager, new_page_num);
-  initialize_leaf_node(new_node);
-  *node_parent(new_node) = *node_parent(old_node);
-  *leaf_node_next_leaf(new_node) = *leaf_node_next_leaf(old_node);
-  *leaf_node_next_leaf(old_node) = new_page_num;
+  Table *table = cursor->table;
+  PageHandle old_node = table_pin_page_for_write(table, cursor->page_num);
+  uint32_t old_max = get_node_max_key(table, cursor->page_num);
+  uint32_t new_page_num = get_unused_page_num(table);
+  PageHandle new_node = table_pin_page_for_write(table, new_page_num);
+  initialize_leaf_node(new_node.data);
+  *node_parent(new_node.data) = *node_parent(old_node.data);
+  *leaf_node_next_leaf(new_node.data) = *leaf_node_next_leaf(old_node.data);
+  *leaf_node_next_leaf(old_node.data) = new_page_num;
 
   /*
    * 將所有現有的 cell 加上新 cell 平均分配到左右兩個節點。
@@ -1495,38 +6958,41 @@ void leaf_node_split_and_insert(Cursor *cursor, uint32_t key, Row *value) {
   for (int32_t i = LEAF_NODE_MAX_CELLS; i >= 0; i--) {
     void *destination_node;
     if (i >= left_split) {
-      destination_node = new_node;
+      destination_node = new_node.data;
     } else {
-      destination_node = old_node;
+      destination_node = old_node.data;
     }
     uint32_t index_within_node = (uint32_t)(i % left_split);
-    void *destination = leaf_node_cell(destination_node, index_within_node);
 
     if (i == insert_at) {
       serialize_row(value,
                     leaf_node_value(destination_node, index_within_node));
       *leaf_node_key(destination_node, index_within_node) = key;
     } else if (i > insert_at) {
-      memcpy(destination, leaf_node_cell(old_node, i - 1), LEAF_NODE_CELL_SIZE);
+      leaf_node_move_cells(destination_node, index_within_node, old_node.data, i - 1, 1);
     } else {
-      memcpy(destination, leaf_node_cell(old_node, i), LEAF_NODE_CELL_SIZE);
+      leaf_node_move_cells(destination_node, index_within_node, old_node.data, i, 1);
     }
   }
 
   // 更新葉節點的 cell 數量
-  *(leaf_node_num_cells(old_node)) = LEAF_NODE_LEFT_SPLIT_COUNT;
-  *(leaf_node_num_cells(new_node)) = LEAF_NODE_RIGHT_SPLIT_COUNT;
+  *(leaf_node_num_cells(old_node.data)) = LEAF_NODE_LEFT_SPLIT_COUNT;
+  *(leaf_node_num_cells(new_node.data)) = LEAF_NODE_RIGHT_SPLIT_COUNT;
 
-  if (is_node_root(old_node)) {
-    return create_new_root(cursor->table, new_page_num);
+  bool splitting_root = is_node_root(old_node.data);
+  uint32_t parent_page_num = *node_parent(old_node.data);
+  table_unpin_page(table, &new_node);
+  table_unpin_page(table, &old_node);
+
+  if (splitting_root) {
+    create_new_root(table, new_page_num);
   } else {
-    uint32_t parent_page_num = *node_parent(old_node);
-    uint32_t new_max = get_node_max_key(cursor->table->pager, old_node);
-    void *parent = get_page(cursor->table->pager, parent_page_num);
+    uint32_t new_max = get_node_max_key(table, cursor->page_num);
+    PageHandle parent = table_pin_page_for_write(table, parent_page_num);
+    update_internal_node_key(parent.data, old_max, new_max);
+    table_unpin_page(table, &parent);
 
-    update_internal_node_key(parent, old_max, new_max);
-    internal_node_insert(cursor->table, parent_page_num, new_page_num);
-    return;
+    internal_node_insert(table, parent_page_num, new_page_num);
   }
 }
 
@@ -1618,6 +7084,10 @@ void initialize_internal_node(void *node) {
 /**
  * 在內部節點中使用二分搜尋找到應包含 key 的子節點索引
  *
+ * 內部節點填滿整個頁面（4 KB 頁面約 500 個鍵）：先以二分搜尋縮小到
+ * NODE_SEARCH_WINDOW 個鍵以內，再以向量比較計算其中小於 key 的鍵數，
+ * 鍵已排序，因此計數就是第一個不小於 key 的鍵的位置。
+ *
  * @param node 內部節點指標
  * @param key 要搜尋的鍵
  * @return 子節點索引
@@ -1627,7 +7097,7 @@ uint32_t internal_node_find_child(void *node, uint32_t key) {
   uint32_t min_index = 0;
   uint32_t max_index = num_keys; // 子節點數量比 key 數量多 1
 
-  while (max_index != min_index) {
+  while (max_index - min_index > NODE_SEARCH_WINDOW) {
     uint32_t index = (min_index + max_index) / 2;
     uint32_t key_to_right = *internal_node_key(node, index);
     if (key_to_right >= key) {
@@ -1637,7 +7107,7 @@ uint32_t internal_node_find_child(void *node, uint32_t key) {
     }
   }
 
-  return min_index;
+  return min_index + internal_node_count_below(node, min_index, max_index - min_index, key);
 }
 
 /**
@@ -1649,12 +7119,16 @@ uint32_t internal_node_find_child(void *node, uint32_t key) {
  * @return Cursor 指標
  */
 Cursor *internal_node_find(Table *table, uint32_t page_num, uint32_t key) {
-  void *node = get_page(table->pager, page_num);
-  uint32_t child_index = internal_node_find_child(node, key);
-  uint32_t child_num = *internal_node_child(node, child_index);
-  void *child = get_page(table->pager, child_num);
+  PageHandle node = table_pin_page(table, page_num);
+  uint32_t child_index = internal_node_find_child(node.data, key);
+  uint32_t child_num = *internal_node_child(node.data, child_index);
+  table_unpin_page(table, &node);
+
+  PageHandle child = table_pin_page(table, child_num);
+  NodeType child_type = get_node_type(child.data);
+  table_unpin_page(table, &child);
 
-  switch (get_node_type(child)) {
+  switch (child_type) {
   case NODE_LEAF:
     return leaf_node_find(table, child_num, key);
   case NODE_INTERNAL:
@@ -1687,50 +7161,51 @@ void update_internal_node_key(void *node, uint32_t old_key, uint32_t new_key) {
  */
 void internal_node_insert(Table *table, uint32_t parent_page_num,
                           uint32_t child_page_num) {
-  void *parent = get_page(table->pager, parent_page_num);
-  void *child = get_page(table->pager, child_page_num);
-  uint32_t child_max_key = get_node_max_key(table->pager, child);
-  uint32_t index = internal_node_find_child(parent, child_max_key);
+  PageHandle parent = table_pin_page_for_write(table, parent_page_num);
+  uint32_t child_max_key = get_node_max_key(table, child_page_num);
+  uint32_t index = internal_node_find_child(parent.data, child_max_key);
 
-  uint32_t original_num_keys = *internal_node_num_keys(parent);
+  uint32_t original_num_keys = *internal_node_num_keys(parent.data);
 
   if (original_num_keys >= INTERNAL_NODE_MAX_CELLS) {
+    table_unpin_page(table, &parent);
     internal_node_split_and_insert(table, parent_page_num, child_page_num);
     return;
   }
 
-  uint32_t right_child_page_num = *internal_node_right_child(parent);
+  uint32_t right_child_page_num = *internal_node_right_child(parent.data);
 
   // 若 right_child 為 INVALID_PAGE_NUM，表示此內部節點為空
   if (right_child_page_num == INVALID_PAGE_NUM) {
-    *internal_node_right_child(parent) = child_page_num;
+    *internal_node_right_child(parent.data) = child_page_num;
+    table_unpin_page(table, &parent);
     return;
   }
 
-  void *right_child = get_page(table->pager, right_child_page_num);
+  uint32_t right_child_max_key = get_node_max_key(table, right_child_page_num);
 
   /*
    * 若已達到節點的最大 cell 數量，不能在分裂前就增加計數。
    * 否則會創建一個未初始化的 key/child pair。
    */
-  *internal_node_num_keys(parent) = original_num_keys + 1;
+  *internal_node_num_keys(parent.data) = original_num_keys + 1;
 
-  if (child_max_key > get_node_max_key(table->pager, right_child)) {
+  if (child_max_key > right_child_max_key) {
     // 取代 right_child
-    *internal_node_child(parent, original_num_keys) = right_child_page_num;
-    *internal_node_key(parent, original_num_keys) =
-        get_node_max_key(table->pager, right_child);
-    *internal_node_right_child(parent) = child_page_num;
+    *internal_node_child(parent.data, original_num_keys) = right_child_page_num;
+    *internal_node_key(parent.data, original_num_keys) = right_child_max_key;
+    *internal_node_right_child(parent.data) = child_page_num;
   } else {
     // 為新 cell 騰出空間
     for (uint32_t i = original_num_keys; i > index; i--) {
-      void *destination = internal_node_cell(parent, i);
-      void *source = internal_node_cell(parent, i - 1);
+      void *destination = internal_node_cell(parent.data, i);
+      void *source = internal_node_cell(parent.data, i - 1);
       memcpy(destination, source, INTERNAL_NODE_CELL_SIZE);
     }
-    *internal_node_child(parent, index) = child_page_num;
-    *internal_node_key(parent, index) = child_max_key;
+    *internal_node_child(parent.data, index) = child_page_num;
+    *internal_node_key(parent.data, index) = child_max_key;
   }
+  table_unpin_page(table, &parent);
 }
 
 /**
@@ -1746,68 +7221,72 @@ void internal_node_insert(Table *table, uint32_t parent_page_num,
 void internal_node_split_and_insert(Table *table, uint32_t parent_page_num,
                                     uint32_t child_page_num) {
   uint32_t old_page_num = parent_page_num;
-  void *old_node = get_page(table->pager, parent_page_num);
-  uint32_t old_max = get_node_max_key(table->pager, old_node);
+  uint32_t old_max = get_node_max_key(table, old_page_num);
+  uint32_t child_max = get_node_max_key(table, child_page_num);
 
-  void *child = get_page(table->pager, child_page_num);
-  uint32_t child_max = get_node_max_key(table->pager, child);
+  PageHandle old_node = table_pin_page_for_write(table, old_page_num);
+  uint32_t new_page_num = get_unused_page_num(table);
+  bool splitting_root = is_node_root(old_node.data);
 
-  uint32_t new_page_num = get_unused_page_num(table->pager);
-  uint32_t splitting_root = is_node_root(old_node);
-
-  void *parent;
-  void *new_node;
+  // 分裂後 old_node 與 new_node 共同的父節點
+  uint32_t upper_page_num;
   if (splitting_root) {
+    table_unpin_page(table, &old_node);
     create_new_root(table, new_page_num);
-    parent = get_page(table->pager, table->root_page_num);
-    old_page_num = *internal_node_child(parent, 0);
-    old_node = get_page(table->pager, old_page_num);
+    upper_page_num = table->root_page_num;
+    PageHandle root = table_pin_page(table, upper_page_num);
+    old_page_num = *internal_node_child(root.data, 0);
+    table_unpin_page(table, &root);
+    old_node = table_pin_page_for_write(table, old_page_num);
   } else {
-    parent = get_page(table->pager, *node_parent(old_node));
-    new_node = get_page(table->pager, new_page_num);
-    initialize_internal_node(new_node);
+    upper_page_num = *node_parent(old_node.data);
+    PageHandle new_node = table_pin_page_for_write(table, new_page_num);
+    initialize_internal_node(new_node.data);
+    table_unpin_page(table, &new_node);
   }
 
-  uint32_t *old_num_keys = internal_node_num_keys(old_node);
+  uint32_t *old_num_keys = internal_node_num_keys(old_node.data);
 
   // 將 old_node 的 right_child 移到 new_node
-  uint32_t cur_page_num = *internal_node_right_child(old_node);
-  void *cur = get_page(table->pager, cur_page_num);
+  uint32_t cur_page_num = *internal_node_right_child(old_node.data);
   internal_node_insert(table, new_page_num, cur_page_num);
-  *node_parent(cur) = new_page_num;
-  *internal_node_right_child(old_node) = INVALID_PAGE_NUM;
+  update_node_parent(table, cur_page_num, new_page_num);
+  *internal_node_right_child(old_node.data) = INVALID_PAGE_NUM;
 
   // 將右半部的 cell 移到 new_node
   for (int i = (int)INTERNAL_NODE_MAX_CELLS - 1; i > (int)(INTERNAL_NODE_MAX_CELLS / 2);
        i--) {
-    cur_page_num = *internal_node_child(old_node, i);
-    cur = get_page(table->pager, cur_page_num);
+    cur_page_num = *internal_node_child(old_node.data, i);
     internal_node_insert(table, new_page_num, cur_page_num);
-    *node_parent(cur) = new_page_num;
+    update_node_parent(table, cur_page_num, new_page_num);
 
     // 修正：正確地遞減 key 數量
     (*old_num_keys) = (*old_num_keys) - 1;
   }
 
   // 將最後一個 child 設為 old_node 的 right_child
-  *internal_node_right_child(old_node) =
-      *internal_node_child(old_node, (*old_num_keys) - 1);
+  *internal_node_right_child(old_node.data) =
+      *internal_node_child(old_node.data, (*old_num_keys) - 1);
   (*old_num_keys) = (*old_num_keys) - 1;
+  table_unpin_page(table, &old_node);
 
-  uint32_t max_after_split = get_node_max_key(table->pager, old_node);
+  uint32_t max_after_split = get_node_max_key(table, old_page_num);
 
   // 決定新 child 應插入到哪個節點
   uint32_t destination_page_num =
       child_max < max_after_split ? old_page_num : new_page_num;
   internal_node_insert(table, destination_page_num, child_page_num);
-  *node_parent(child) = destination_page_num;
+  update_node_parent(table, child_page_num, destination_page_num);
 
-  update_internal_node_key(parent, old_max,
-                           get_node_max_key(table->pager, old_node));
+  uint32_t new_old_max = get_node_max_key(table, old_page_num);
+  PageHandle upper = table_pin_page_for_write(table, upper_page_num);
+  update_internal_node_key(upper.data, old_max, new_old_max);
+  table_unpin_page(table, &upper);
 
   if (!splitting_root) {
-    internal_node_insert(table, *node_parent(old_node), new_page_num);
-    *node_parent(new_node) = *node_parent(old_node);
+    // 必須先設定 parent：插入可能讓父節點分裂，並把 new_node 移到新的父節點
+    update_node_parent(table, new_page_num, upper_page_num);
+    internal_node_insert(table, upper_page_num, new_page_num);
   }
 }
 
@@ -1826,41 +7305,43 @@ void internal_node_split_and_insert(Table *table, uint32_t parent_page_num,
  * @param right_child_page_num 右子節點的頁面編號
  */
 void create_new_root(Table *table, uint32_t right_child_page_num) {
-  void *root = get_page(table->pager, table->root_page_num);
-  void *right_child = get_page(table->pager, right_child_page_num);
-  uint32_t left_child_page_num = get_unused_page_num(table->pager);
-  void *left_child = get_page(table->pager, left_child_page_num);
+  PageHandle root = table_pin_page_for_write(table, table->root_page_num);
+  PageHandle right_child = table_pin_page_for_write(table, right_child_page_num);
+  uint32_t left_child_page_num = get_unused_page_num(table);
+  PageHandle left_child = table_pin_page_for_write(table, left_child_page_num);
 
-  if (get_node_type(root) == NODE_INTERNAL) {
-    initialize_internal_node(right_child);
-    initialize_internal_node(left_child);
+  if (get_node_type(root.data) == NODE_INTERNAL) {
+    initialize_internal_node(right_child.data);
+    initialize_internal_node(left_child.data);
   }
 
   // 左子節點包含舊根節點的資料
-  memcpy(left_child, root, PAGE_SIZE);
-  set_node_root(left_child, false);
+  memcpy(left_child.data, root.data, PAGE_SIZE);
+  set_node_root(left_child.data, false);
 
   // 若左子節點是內部節點，更新其所有子節點的 parent 指標
-  if (get_node_type(left_child) == NODE_INTERNAL) {
-    void *child;
-    for (uint32_t i = 0; i < *internal_node_num_keys(left_child); i++) {
-      child = get_page(table->pager, *internal_node_child(left_child, i));
-      *node_parent(child) = left_child_page_num;
+  if (get_node_type(left_child.data) == NODE_INTERNAL) {
+    for (uint32_t i = 0; i < *internal_node_num_keys(left_child.data); i++) {
+      update_node_parent(table, *internal_node_child(left_child.data, i),
+                         left_child_page_num);
     }
-    child = get_page(table->pager, *internal_node_right_child(left_child));
-    *node_parent(child) = left_child_page_num;
+    update_node_parent(table, *internal_node_right_child(left_child.data),
+                       left_child_page_num);
   }
 
   // 根節點現在是一個內部節點，包含一個 key 和兩個子節點
-  initialize_internal_node(root);
-  set_node_root(root, true);
-  *internal_node_num_keys(root) = 1;
-  *internal_node_child(root, 0) = left_child_page_num;
-  uint32_t left_child_max_key = get_node_max_key(table->pager, left_child);
-  *internal_node_key(root, 0) = left_child_max_key;
-  *internal_node_right_child(root) = right_child_page_num;
-  *node_parent(left_child) = table->root_page_num;
-  *node_parent(right_child) = table->root_page_num;
+  initialize_internal_node(root.data);
+  set_node_root(root.data, true);
+  *internal_node_num_keys(root.data) = 1;
+  *internal_node_child(root.data, 0) = left_child_page_num;
+  uint32_t left_child_max_key = get_node_max_key(table, left_child_page_num);
+  *internal_node_key(root.data, 0) = left_child_max_key;
+  *internal_node_right_child(root.data) = right_child_page_num;
+  *node_parent(left_child.data) = table->root_page_num;
+  *node_parent(right_child.data) = table->root_page_num;
+  table_unpin_page(table, &left_child);
+  table_unpin_page(table, &right_child);
+  table_unpin_page(table, &root);
 }
 
 /* ============================================================================
@@ -1877,15 +7358,111 @@ void create_new_root(Table *table, uint32_t right_child_page_num) {
  */
 Cursor *table_find(Table *table, uint32_t key) {
   uint32_t root_page_num = table->root_page_num;
-  void *root_node = get_page(table->pager, root_page_num);
+  PageHandle root_node = table_pin_page(table, root_page_num);
+  NodeType root_type = get_node_type(root_node.data);
+  table_unpin_page(table, &root_node);
 
-  if (get_node_type(root_node) == NODE_LEAF) {
+  if (root_type == NODE_LEAF) {
     return leaf_node_find(table, root_page_num, key);
   } else {
     return internal_node_find(table, root_page_num, key);
   }
 }
 
+/**
+ * 若 cursor 已超出目前葉節點，沿著 next_leaf 前進到下一個非空的葉節點
+ *
+ * 空的葉節點（例如空表的根節點）沒有任何 cell，掃描必須跳過它們，
+ * 否則會讀到殘留在頁面中的舊資料。
+ *
+ * @param cursor Cursor 指標
+ */
+static void cursor_skip_empty_leaves(Cursor *cursor) {
+  while (cursor->cell_num >= (*leaf_node_num_cells(cursor->leaf.data))) {
+    uint32_t next_page_num = *leaf_node_next_leaf(cursor->leaf.data);
+    if (next_page_num == 0) {
+      // 這是最右側的葉節點
+      cursor->end_of_table = true;
+      return;
+    }
+    table_unpin_page(cursor->table, &cursor->leaf);
+    cursor->page_num = next_page_num;
+    cursor->cell_num = 0;
+    cursor->leaf = table_pin_page(cursor->table, next_page_num);
+  }
+  cursor->end_of_table = false;
+}
+
+/**
+ * 取得已在記憶體中的頁面（交易中優先返回影子頁面），不會觸發讀取也不計入快取統計
+ *
+ * @param table Table 指標
+ * @param page_num 頁面編號
+ * @return 頁面指標，頁面不在記憶體中時返回 NULL
+ */
+static void *table_resident_page(Table *table, uint32_t page_num) {
+  if (is_in_transaction(table)) {
+    Transaction *txn = table->transaction;
+    uint32_t index = transaction_find_page(txn, page_num);
+    if (index != INVALID_SHADOW_INDEX && transaction_has_shadow(&txn->shadows[index])) {
+      // 已溢出的影子頁面不在記憶體中（緩衝池中的頁框是交易前的內容）
+      return txn->shadows[index].data;
+    }
+  }
+  return pager_resident_page(table->pager, page_num);
+}
+
+/**
+ * 掃描進入新的葉節點時，預讀葉節點鏈中接下來的頁面
+ *
+ * 葉節點鏈一次只能得知下一頁，因此預讀視窗取自父節點：父節點中位於目前葉節點
+ * 之後的子節點，依序就是葉節點鏈接下來的頁面。視窗在同一個父節點內只向前延伸，
+ * 已提示過的頁面不會重複提示。目前葉節點是父節點的最後一個子節點，或父節點
+ * 已被置換出緩衝池時（預讀不應為了找出預讀目標而讀取頁面），只預讀 next_leaf
+ * 指向的頁面。
+ *
+ * @param table Table 指標
+ * @param leaf_page_num 剛進入的葉節點頁面編號
+ */
+static void table_read_ahead(Table *table, uint32_t leaf_page_num) {
+  Pager *pager = table->pager;
+  void *leaf = table_resident_page(table, leaf_page_num);
+  if (pager->readahead == 0 || leaf == NULL || is_node_root(leaf)) {
+    return;
+  }
+
+  uint32_t parent_page_num = *node_parent(leaf);
+  void *parent = table_resident_page(table, parent_page_num);
+  uint32_t num_keys = parent ? *internal_node_num_keys(parent) : 0;
+  uint32_t index = parent ? internal_node_child_index(parent, leaf_page_num) : 0;
+
+  uint32_t page_nums[PAGER_MAX_READAHEAD];
+  uint32_t count = 0;
+  if (index == num_keys) {
+    uint32_t next_page_num = *leaf_node_next_leaf(leaf);
+    if (next_page_num != 0) {
+      page_nums[count++] = next_page_num;
+    }
+    pager->readahead_parent = INVALID_PAGE_NUM;
+  } else {
+    if (pager->readahead_parent != parent_page_num || pager->readahead_end < index) {
+      pager->readahead_parent = parent_page_num;
+      pager->readahead_end = index;
+    }
+    uint32_t last = index + pager->readahead;
+    if (last > num_keys) {
+      last = num_keys;
+    }
+    for (uint32_t i = pager->readahead_end + 1; i <= last; i++) {
+      page_nums[count++] = *internal_node_child(parent, i);
+    }
+    if (last > pager->readahead_end) {
+      pager->readahead_end = last;
+    }
+  }
+  pager_prefetch(pager, page_nums, count);
+}
+
 /**
  * 創建指向 B-tree 開頭的 cursor
  *
@@ -1894,9 +7471,12 @@ Cursor *table_find(Table *table, uint32_t key) {
  */
 Cursor *table_start(Table *table) {
   Cursor *cursor = table_find(table, 0);
-  void *node = get_page_for_read(table, cursor->page_num);
-  uint32_t num_cells = *leaf_node_num_cells(node);
-  cursor->end_of_table = (num_cells == 0);
+  cursor_skip_empty_leaves(cursor);
+  // 新的掃描從頭建立預讀視窗
+  table->pager->readahead_parent = INVALID_PAGE_NUM;
+  if (!cursor->end_of_table) {
+    table_read_ahead(table, cursor->page_num);
+  }
   return cursor;
 }
 
@@ -1907,18 +7487,8 @@ Cursor *table_start(Table *table) {
  * @return Row 資料位址
  */
 void *cursor_value(Cursor *cursor) {
-  uint32_t page_num = cursor->page_num;
-  void *page;
-  
-  // 如果在交易中且有影子頁面，從影子頁面讀取
-  if (is_in_transaction(cursor->table) &&
-      cursor->table->transaction->shadow_pages[page_num]) {
-    page = cursor->table->transaction->shadow_pages[page_num];
-  } else {
-    page = get_page(cursor->table->pager, page_num);
-  }
-  
-  return leaf_node_value(page, cursor->cell_num);
+  // 交易中的影子頁面在建立 cursor 時已由 table_pin_page 選定
+  return leaf_node_value(cursor->leaf.data, cursor->cell_num);
 }
 
 /**
@@ -1928,22 +7498,29 @@ void *cursor_value(Cursor *cursor) {
  */
 void cursor_advance(Cursor *cursor) {
   uint32_t page_num = cursor->page_num;
-  void *node = get_page_for_read(cursor->table, page_num);
 
   cursor->cell_num += 1;
-  if (cursor->cell_num >= (*leaf_node_num_cells(node))) {
-    // 移動到下一個葉節點
-    uint32_t next_page_num = *leaf_node_next_leaf(node);
-    if (next_page_num == 0) {
-      // 這是最右側的葉節點
-      cursor->end_of_table = true;
-    } else {
-      cursor->page_num = next_page_num;
-      cursor->cell_num = 0;
+  // 移動到下一個（非空的）葉節點
+  cursor_skip_empty_leaves(cursor);
+  if (cursor->page_num != page_num) {
+    // 跨越葉節點時收回超出預算的頁框：目前的葉節點已被釘選，不會被置換
+    pager_evict_to_budget(cursor->table->pager);
+    if (!cursor->end_of_table) {
+      table_read_ahead(cursor->table, cursor->page_num);
     }
   }
 }
 
+/**
+ * 關閉 cursor，釋放其葉節點的釘選
+ *
+ * @param cursor Cursor 指標
+ */
+void cursor_close(Cursor *cursor) {
+  table_unpin_page(cursor->table, &cursor->leaf);
+  free(cursor);
+}
+
 /* ============================================================================
  * Row 序列化與反序列化
  * ============================================================================
@@ -1993,9 +7570,38 @@ InputBuffer *new_input_buffer(void) {
   input_buffer->buffer = NULL;
   input_buffer->buffer_length = 0;
   input_buffer->input_length = 0;
+  input_buffer->read_buffer = malloc(INPUT_READ_BUFFER_SIZE);
+  if (input_buffer->read_buffer == NULL) {
+    printf("Error: Memory allocation failed for input buffer\n");
+    exit(EXIT_FAILURE);
+  }
+  input_buffer->read_start = 0;
+  input_buffer->read_end = 0;
   return input_buffer;
 }
 
+/**
+ * 在指定時間內是否有下一個命令可讀
+ *
+ * 先檢查輸入緩衝區中已讀入但尚未處理的資料，再以 poll 等待標準輸入。
+ * 輸入結束（EOF）也視為可讀，由 read_input 處理。
+ *
+ * @param input_buffer InputBuffer 指標
+ * @param timeout_ms 最長等待時間（毫秒）
+ * @return 是否有輸入可讀
+ */
+bool input_available(InputBuffer *input_buffer, uint32_t timeout_ms) {
+  if (input_buffer->read_start < input_buffer->read_end) {
+    return true;
+  }
+  struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+  int result;
+  do {
+    result = poll(&pfd, 1, (int)timeout_ms);
+  } while (result == -1 && errno == EINTR);
+  return result > 0;
+}
+
 /**
  * 釋放輸入緩衝區
  *
@@ -2003,35 +7609,80 @@ InputBuffer *new_input_buffer(void) {
  */
 void close_input_buffer(InputBuffer *input_buffer) {
   free(input_buffer->buffer);
+  free(input_buffer->read_buffer);
   free(input_buffer);
 }
 
 /**
  * 印出命令提示符號
+ *
+ * 立即送出輸出：經由管線操作 REPL 的程式（例如同時開啟同一資料庫的測試）
+ * 可以依提示符號判斷上一個命令已經執行完畢。
  */
-void print_prompt(void) { printf("db > "); }
+void print_prompt(void) {
+  printf("db > ");
+  fflush(stdout);
+}
 
 /**
- * 讀取使用者輸入
+ * 讀取使用者輸入的一行
+ *
+ * 直接以 read 讀取標準輸入並保留在自己的緩衝區中，input_available 才能知道
+ * 是否還有已讀入但尚未處理的命令。
  *
  * @param input_buffer InputBuffer 指標
+ * @return 是否讀到一行；輸入結束（EOF）時返回 false，由呼叫端關閉資料庫
  */
-void read_input(InputBuffer *input_buffer) {
-  ssize_t bytes_read =
-      getline(&(input_buffer->buffer), &(input_buffer->buffer_length), stdin);
+bool read_input(InputBuffer *input_buffer) {
+  size_t line_length = 0;
+  while (true) {
+    char *start = input_buffer->read_buffer + input_buffer->read_start;
+    size_t available = input_buffer->read_end - input_buffer->read_start;
+    char *newline = memchr(start, '\n', available);
+    size_t take = newline ? (size_t)(newline - start) + 1 : available;
+
+    if (line_length + take + 1 > input_buffer->buffer_length) {
+      size_t new_length = input_buffer->buffer_length ? input_buffer->buffer_length * 2 : 128;
+      while (new_length < line_length + take + 1) {
+        new_length *= 2;
+      }
+      char *buffer = realloc(input_buffer->buffer, new_length);
+      if (buffer == NULL) {
+        printf("Error: Memory allocation failed for input buffer\n");
+        exit(EXIT_FAILURE);
+      }
+      input_buffer->buffer = buffer;
+      input_buffer->buffer_length = new_length;
+    }
+    memcpy(input_buffer->buffer + line_length, start, take);
+    line_length += take;
+    input_buffer->read_start += take;
+    if (newline) {
+      break;
+    }
 
-  if (bytes_read <= 0) {
-    if (feof(stdin)) {
-      printf("\nExiting...\n");
-      exit(EXIT_SUCCESS);
+    ssize_t bytes_read = read(STDIN_FILENO, input_buffer->read_buffer, INPUT_READ_BUFFER_SIZE);
+    if (bytes_read == -1 && errno == EINTR) {
+      continue;
+    }
+    if (bytes_read == -1) {
+      printf("Error: Failed to read input: %s\n", strerror(errno));
+      exit(EXIT_FAILURE);
+    }
+    input_buffer->read_start = 0;
+    input_buffer->read_end = (size_t)bytes_read;
+    if (bytes_read == 0) {
+      if (line_length == 0) {
+        return false;
+      }
+      break; // 最後一行沒有換行符號
     }
-    printf("Error: Failed to read input: %s\n", strerror(errno));
-    exit(EXIT_FAILURE);
   }
 
   // 移除尾端的換行符號
-  input_buffer->input_length = bytes_read - 1;
-  input_buffer->buffer[bytes_read - 1] = 0;
+  input_buffer->input_length = (ssize_t)line_length - 1;
+  input_buffer->buffer[line_length - 1] = 0;
+  return true;
 }
 
 /* ============================================================================
@@ -2053,7 +7704,7 @@ MetaCommandResult do_meta_command(InputBuffer *input_buffer, Table *table) {
     exit(EXIT_SUCCESS);
   } else if (strcmp(input_buffer->buffer, ".btree") == 0) {
     printf("Tree:\n");
-    print_tree(table->pager, 0, 0);
+    print_tree(table, table->root_page_num, 0);
     return META_COMMAND_SUCCESS;
   } else if (strcmp(input_buffer->buffer, ".constants") == 0) {
     printf("Constants:\n");
@@ -2070,7 +7721,7 @@ MetaCommandResult do_meta_command(InputBuffer *input_buffer, Table *table) {
   } else if (strcmp(input_buffer->buffer, "commit") == 0 ||
              strcmp(input_buffer->buffer, "COMMIT") == 0) {
     if (transaction_commit(table) == EXECUTE_SUCCESS) {
-      printf("Transaction committed.\n");
+      wal_confirm_commit(table->pager, "Transaction committed.\n");
     }
     return META_COMMAND_SUCCESS;
   } else if (strcmp(input_buffer->buffer, "rollback") == 0 ||
@@ -2088,7 +7739,10 @@ MetaCommandResult do_meta_command(InputBuffer *input_buffer, Table *table) {
     if (new_stats != NULL) {
       memcpy(table->statistics, new_stats, sizeof(TableStatistics));
       free(new_stats);
-      statistics_save(table);
+      // 其他行程正在修改寫入時複製資料庫時，統計資訊只更新本行程的記憶體
+      if (table_begin_write(table) == EXECUTE_SUCCESS) {
+        statistics_save(table);
+      }
       printf("Statistics updated successfully.\n");
       printf("  Total rows: %u\n", table->statistics->total_rows);
       printf("  ID range: %u - %u\n", table->statistics->id_min, table->statistics->id_max);
@@ -2099,6 +7753,155 @@ MetaCommandResult do_meta_command(InputBuffer *input_buffer, Table *table) {
       printf("Error: Failed to collect statistics.\n");
     }
     return META_COMMAND_SUCCESS;
+  } else if (strncmp(input_buffer->buffer, ".cache", 6) == 0 &&
+             (input_buffer->buffer[6] == '\0' || input_buffer->buffer[6] == ' ')) {
+    // 顯示或設定緩衝池頁框預算
+    char *size_string = input_buffer->buffer + 6;
+    while (*size_string == ' ')
+      size_string++;
+    if (*size_string != '\0') {
+      int cache_pages = atoi(size_string);
+      if (cache_pages <= 0) {
+        printf("Error: Cache size must be a positive integer (got '%s')\n", size_string);
+        return META_COMMAND_SUCCESS;
+      }
+      pager_set_cache_size(table->pager, (uint32_t)cache_pages);
+      pager_evict_to_budget(table->pager);
+    }
+    Pager *pager = table->pager;
+    printf("Buffer pool:\n");
+    printf("  Frames: %u / %u\n", pager->num_resident, pager->max_frames);
+    printf("  Pinned frames: %u\n", pager->num_pinned);
+    printf("  Arena pages: %u / %u\n", pager->arena.num_in_use, pager->arena.num_pages);
+    if (pager->mmap_base != NULL) {
+      printf("  Mapped pages: %u\n", pager->mmap_pages);
+    }
+    if (pager->direct_io) {
+      printf("  Direct I/O: on\n");
+    }
+    printf("  Database pages: %u\n", pager->num_pages);
+    PageHandle header = table_pin_page(table, HEADER_PAGE_NUM);
+    printf("  Free pages: %u\n", *header_free_page_count(header.data));
+    table_unpin_page(table, &header);
+    printf("  Hits: %llu\n", (unsigned long long)pager->cache_hits);
+    printf("  Misses: %llu\n", (unsigned long long)pager->cache_misses);
+    printf("  Evictions: %llu\n", (unsigned long long)pager->evictions);
+    printf("  Read-ahead pages: %llu\n", (unsigned long long)pager->readahead_pages);
+    printf("  Dirty frames: %u\n", pager->num_dirty);
+    printf("  Page writes: %llu\n", (unsigned long long)pager->page_writes);
+    printf("  Write calls: %llu\n", (unsigned long long)pager->write_calls);
+    if (is_in_transaction(table)) {
+      Transaction *txn = table->transaction;
+      printf("  Shadow pages: %u / %u\n", txn->num_resident_shadows, txn->max_shadow_pages);
+      printf("  Spilled shadow pages: %u\n", txn->num_spilled);
+      printf("  Spill writes: %llu\n", (unsigned long long)txn->spill_writes);
+      printf("  Spill reads: %llu\n", (unsigned long long)txn->spill_reads);
+    }
+    if (table->checkpointer != NULL) {
+      printf("  Background checkpoints: %llu\n",
+             (unsigned long long)table->checkpointer->checkpoints);
+      printf("  Background page writes: %llu\n",
+             (unsigned long long)table->checkpointer->pages_written);
+    }
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".wal") == 0) {
+    Wal *wal = &table->pager->wal;
+    if (table->pager->page_map.enabled) {
+      printf("Write-ahead log: not used (copy-on-write database)\n");
+      return META_COMMAND_SUCCESS;
+    }
+    printf("Write-ahead log:\n");
+    printf("  Frames: %u\n", wal->num_frames);
+    printf("  Pending commits: %u\n", wal->pending_commits);
+    printf("  Commits: %llu\n", (unsigned long long)wal->commits);
+    printf("  Frames written: %llu\n", (unsigned long long)wal->frames_written);
+    printf("  Syncs: %llu\n", (unsigned long long)wal->syncs);
+    printf("  Checkpoints: %llu\n", (unsigned long long)wal->checkpoints);
+    printf("  Row records written: %llu\n", (unsigned long long)wal->row_records_written);
+    printf("  Bytes written: %llu\n", (unsigned long long)wal->bytes_written);
+    printf("  Row-logged pages: %u\n", wal->row_pages.count);
+    return META_COMMAND_SUCCESS;
+  } else if (strncmp(input_buffer->buffer, ".sync", 5) == 0 &&
+             (input_buffer->buffer[5] == '\0' || input_buffer->buffer[5] == ' ')) {
+    // 顯示或設定持久性等級
+    char *level_string = input_buffer->buffer + 5;
+    while (*level_string == ' ')
+      level_string++;
+    Pager *pager = table->pager;
+    if (*level_string != '\0') {
+      SyncLevel level;
+      if (!parse_sync_level(level_string, &level)) {
+        printf("Error: Sync level must be off, normal or full (got '%s')\n", level_string);
+        return META_COMMAND_SUCCESS;
+      }
+      // 切換前先同步尚未 fsync 的群組
+      wal_sync(&pager->wal);
+      pager->sync_level = level;
+    }
+    printf("Sync level: %s\n", sync_level_name(pager->sync_level));
+    return META_COMMAND_SUCCESS;
+  } else if (strncmp(input_buffer->buffer, ".txnlog", 7) == 0 &&
+             (input_buffer->buffer[7] == '\0' || input_buffer->buffer[7] == ' ')) {
+    // 顯示或設定交易記錄修改的方式
+    char *mode_string = input_buffer->buffer + 7;
+    while (*mode_string == ' ')
+      mode_string++;
+    Transaction *txn = table->transaction;
+    if (*mode_string != '\0') {
+      TransactionLogMode mode;
+      if (!parse_txn_log_mode(mode_string, &mode)) {
+        printf("Error: Transaction log mode must be page or row (got '%s')\n", mode_string);
+        return META_COMMAND_SUCCESS;
+      }
+      if (is_in_transaction(table)) {
+        printf("Error: Cannot change transaction log mode inside a transaction.\n");
+        return META_COMMAND_SUCCESS;
+      }
+      txn->log_mode = mode;
+    }
+    printf("Transaction log: %s\n", txn_log_mode_name(txn->log_mode));
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".cow") == 0) {
+    PageMap *map = &table->pager->page_map;
+    if (!map->enabled) {
+      printf("Not a copy-on-write database.\n");
+      return META_COMMAND_SUCCESS;
+    }
+    uint32_t oldest = map->generation;
+    uint32_t num_readers = page_map_scan_readers(map, &oldest);
+    printf("Copy-on-write:\n");
+    printf("  Generation: %u\n", map->generation);
+    printf("  Logical pages: %u\n", table->pager->num_pages);
+    // 空閒頁面只有寫入者知道（第一次取得寫入鎖時建立）
+    if (map->free_space_valid) {
+      uint32_t num_free = 0;
+      for (uint32_t slot = COW_META_SLOTS; slot < map->num_physical; slot++) {
+        num_free += !bitmap_test(map->used, slot);
+      }
+      printf("  Physical pages: %u (free %u, retained %u)\n", map->num_physical, num_free,
+             map->retired.count);
+    } else {
+      printf("  Physical pages: %u\n", map->num_physical);
+    }
+    printf("  Other readers: %u", num_readers);
+    if (num_readers > 0) {
+      printf(" (oldest generation %u)", oldest);
+    }
+    printf("\n");
+    printf("  Commits: %llu\n", (unsigned long long)map->commits);
+    printf("  Map pages written: %llu\n", (unsigned long long)map->map_pages_written);
+    printf("  Snapshots loaded: %llu\n", (unsigned long long)map->snapshots_loaded);
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".checkpoint") == 0) {
+    if (is_in_transaction(table)) {
+      // 交易以列變更記錄直接修改的頁面尚未提交，不能寫回
+      printf("Error: Cannot checkpoint inside a transaction.\n");
+      return META_COMMAND_SUCCESS;
+    }
+    uint32_t num_frames = table->pager->wal.num_frames;
+    pager_checkpoint(table->pager);
+    printf("Checkpoint complete (%u log frame(s)).\n", num_frames);
+    return META_COMMAND_SUCCESS;
   } else if (strcmp(input_buffer->buffer, ".stats") == 0) {
     // 顯示當前統計資訊
     if (table->statistics && table->statistics->is_valid) {
@@ -3049,23 +8852,24 @@ PrepareResult prepare_statement(InputBuffer *input_buffer,
  * @return 執行結果
  */
 ExecuteResult execute_insert(Statement *statement, Table *table) {
-  void *node = get_page_for_read(table, table->root_page_num);
-  uint32_t num_cells = (*leaf_node_num_cells(node));
-
   Row *row_to_insert = &(statement->row_to_insert);
   uint32_t key_to_insert = row_to_insert->id;
   Cursor *cursor = table_find(table, key_to_insert);
 
+  // 重複鍵檢查必須看 cursor 所在的葉節點，而不是根節點
+  void *node = cursor->leaf.data;
+  uint32_t num_cells = (*leaf_node_num_cells(node));
+
   if (cursor->cell_num < num_cells) {
     uint32_t key_at_index = *leaf_node_key(node, cursor->cell_num);
     if (key_at_index == key_to_insert) {
-      free(cursor);
+      cursor_close(cursor);
       return EXECUTE_DUPLICATE_KEY;
     }
   }
 
   leaf_node_insert(cursor, row_to_insert->id, row_to_insert);
-  free(cursor);
+  cursor_close(cursor);
   
   // 更新統計資訊
   statistics_update_on_insert(table->statistics, row_to_insert);
@@ -3275,7 +9079,7 @@ TableStatistics *collect_table_statistics(Table *table) {
     cursor_advance(cursor);
   }
   
-  free(cursor);
+  cursor_close(cursor);
   free(username_seen);
   free(email_seen);
   free(id_seen);
@@ -3351,41 +9155,88 @@ void statistics_update_on_delete(TableStatistics *stats, Row *row) {
 }
 
 /**
- * 從檔案載入統計資訊
+ * 從統計資訊頁載入統計資訊
  *
  * @param table Table 指標
- * @return 是否成功載入
+ * @return 是否成功載入（沒有統計資訊頁或保存時統計資訊無效都返回 false）
  */
 bool statistics_load(Table *table) {
-  if (!table || !table->pager) return false;
-  
-  // 統計資訊檔案名稱：資料庫檔案名稱 + ".stats"
-  char stats_filename[512];
-  snprintf(stats_filename, sizeof(stats_filename), "%s.stats", 
-           table->pager->file_descriptor == -1 ? "database" : "database");
-  
-  // 由於我們沒有檔案名稱，我們將統計資訊存儲在資料庫檔案的第一頁的特殊位置
-  // 或者使用一個簡單的方法：檢查檔案是否存在
-  // 為了簡化，我們暫時跳過持久化，每次啟動時重新收集
-  
-  return false; // 暫時返回 false，表示需要重新收集
+  if (!table || !table->pager || !table->statistics) return false;
+
+  Pager *pager = table->pager;
+  uint32_t stats_page_num = *header_stats_page(get_page(pager, HEADER_PAGE_NUM));
+  if (stats_page_num == 0) {
+    return false;
+  }
+
+  void *page = get_page(pager, stats_page_num);
+  if (*(uint32_t *)(page + STATS_PAGE_IS_VALID_OFFSET) == 0) {
+    return false;
+  }
+
+  uint32_t *fields = page + STATS_PAGE_FIELDS_OFFSET;
+  TableStatistics *stats = table->statistics;
+  stats->total_rows = fields[0];
+  stats->id_min = fields[1];
+  stats->id_max = fields[2];
+  stats->id_cardinality = fields[3];
+  stats->username_cardinality = fields[4];
+  stats->email_cardinality = fields[5];
+  stats->is_valid = true;
+  return true;
 }
 
 /**
- * 保存統計資訊到檔案
+ * 保存統計資訊到統計資訊頁
+ *
+ * 統計資訊頁在第一次保存有效的統計資訊時才配置，其編號記錄在標頭頁中。
+ * 之後即使統計資訊失效也會寫入（標記為無效），避免下次開啟時載入過期的值。
  *
  * @param table Table 指標
  * @return 是否成功保存
  */
 bool statistics_save(Table *table) {
-  if (!table || !table->statistics || !table->statistics->is_valid) {
+  if (!table || !table->pager || !table->statistics) {
     return false;
   }
-  
-  // 由於我們沒有檔案名稱，我們暫時跳過持久化
-  // 在實際應用中，應該將統計資訊保存到單獨的檔案或資料庫的特殊頁面
-  
-  return true; // 暫時返回 true
+
+  Pager *pager = table->pager;
+  TableStatistics *stats = table->statistics;
+  // 新配置統計資訊頁時最後需寫出標頭頁，全程釘選
+  PageHandle header = pager_pin(pager, HEADER_PAGE_NUM);
+  uint32_t stats_page_num = *header_stats_page(header.data);
+  bool allocated = false;
+  if (stats_page_num == 0) {
+    // 統計資訊不屬於交易，交易中不配置統計資訊頁（關閉資料庫時會再保存一次）
+    if (!stats->is_valid || is_in_transaction(table)) {
+      pager_unpin(pager, &header);
+      return false;
+    }
+    stats_page_num = get_unused_page_num(table);
+    allocated = true;
+    *header_stats_page(header.data) = stats_page_num;
+    pager_mark_dirty(pager, HEADER_PAGE_NUM);
+  }
+
+  PageHandle page = pager_pin(pager, stats_page_num);
+  *(uint32_t *)(page.data + STATS_PAGE_IS_VALID_OFFSET) = stats->is_valid ? 1 : 0;
+  uint32_t *fields = page.data + STATS_PAGE_FIELDS_OFFSET;
+  fields[0] = stats->total_rows;
+  fields[1] = stats->id_min;
+  fields[2] = stats->id_max;
+  fields[3] = stats->id_cardinality;
+  fields[4] = stats->username_cardinality;
+  fields[5] = stats->email_cardinality;
+  pager_mark_dirty(pager, stats_page_num);
+
+  // 新配置的統計資訊頁先於標頭頁寫出，標頭頁不會指向尚未初始化的頁面
+  if (allocated) {
+    pager_flush(pager, stats_page_num);
+    pager_flush(pager, HEADER_PAGE_NUM);
+  }
+  pager_unpin(pager, &page);
+  pager_unpin(pager, &header);
+  return stats->is_valid;
 }
 
 /* ============================================================================
@@ -3643,7 +9494,7 @@ ExecuteResult execute_select(Statement *statement, Table *table) {
   case QUERY_PLAN_INDEX_LOOKUP:
     // 索引查找：直接查找指定的 key
     cursor = table_find(table, plan.start_key);
-    void *node = get_page_for_read(table, cursor->page_num);
+    void *node = cursor->leaf.data;
     uint32_t num_cells = *leaf_node_num_cells(node);
 
     // 檢查是否找到該 key
@@ -3657,7 +9508,7 @@ ExecuteResult execute_select(Statement *statement, Table *table) {
         }
       }
     }
-    free(cursor);
+    cursor_close(cursor);
     return EXECUTE_SUCCESS;
 
   case QUERY_PLAN_RANGE_SCAN:
@@ -3688,7 +9539,7 @@ ExecuteResult execute_select(Statement *statement, Table *table) {
     cursor_advance(cursor);
   }
 
-  free(cursor);
+  cursor_close(cursor);
   return EXECUTE_SUCCESS;
 }
 
@@ -3712,16 +9563,17 @@ ExecuteResult execute_update(Statement *statement, Table *table) {
 
     // 使用 table_find 找到要更新的 key
     Cursor *cursor = table_find(table, key_to_update);
-    void *node = get_page_for_write(table, cursor->page_num);
-    uint32_t num_cells = *leaf_node_num_cells(node);
+    PageHandle node = table_pin_page(table, cursor->page_num);
+    uint32_t num_cells = *leaf_node_num_cells(node.data);
 
     // 檢查是否找到該 key
     if (cursor->cell_num < num_cells) {
-      uint32_t key_at_index = *leaf_node_key(node, cursor->cell_num);
+      uint32_t key_at_index = *leaf_node_key(node.data, cursor->cell_num);
       if (key_at_index == key_to_update) {
         // 找到該 key，讀取現有資料
         Row existing_row;
-        deserialize_row(leaf_node_value(node, cursor->cell_num), &existing_row);
+        deserialize_row(leaf_node_value(node.data, cursor->cell_num), &existing_row);
+        table_unpin_page(table, &node);
 
         // 只更新指定的欄位
         if (statement->update_username) {
@@ -3732,14 +9584,15 @@ ExecuteResult execute_update(Statement *statement, Table *table) {
         }
 
         // 將更新後的資料寫回
-        serialize_row(&existing_row, leaf_node_value(node, cursor->cell_num));
-        free(cursor);
+        table_row_update(table, cursor->page_num, cursor->cell_num, &existing_row);
+        cursor_close(cursor);
         return EXECUTE_SUCCESS;
       }
     }
 
     // 沒有找到該 key
-    free(cursor);
+    table_unpin_page(table, &node);
+    cursor_close(cursor);
     return EXECUTE_KEY_NOT_FOUND;
   }
 
@@ -3749,8 +9602,10 @@ ExecuteResult execute_update(Statement *statement, Table *table) {
   bool found = false;
 
   while (!(cursor->end_of_table)) {
-    void *node = get_page_for_write(table, cursor->page_num);
-    deserialize_row(cursor_value(cursor), &row);
+    // 交易中寫入的是影子頁面，每個 cell 都重新釘選，讀到的是最新的內容
+    PageHandle node = table_pin_page(table, cursor->page_num);
+    deserialize_row(leaf_node_value(node.data, cursor->cell_num), &row);
+    table_unpin_page(table, &node);
 
     // 評估 WHERE 條件
     if (evaluate_where_condition(&row, &statement->where)) {
@@ -3765,13 +9620,13 @@ ExecuteResult execute_update(Statement *statement, Table *table) {
       }
 
       // 將更新後的資料寫回
-      serialize_row(&row, leaf_node_value(node, cursor->cell_num));
+      table_row_update(table, cursor->page_num, cursor->cell_num, &row);
     }
 
     cursor_advance(cursor);
   }
 
-  free(cursor);
+  cursor_close(cursor);
   return found ? EXECUTE_SUCCESS : EXECUTE_KEY_NOT_FOUND;
 }
 
@@ -3792,7 +9647,7 @@ ExecuteResult execute_delete(Statement *statement, Table *table) {
 
     // 使用 table_find 找到要刪除的 key
     Cursor *cursor = table_find(table, key_to_delete);
-    void *node = get_page(table->pager, cursor->page_num);
+    void *node = cursor->leaf.data;
     uint32_t num_cells = *leaf_node_num_cells(node);
 
     // 檢查是否找到該 key
@@ -3809,13 +9664,13 @@ ExecuteResult execute_delete(Statement *statement, Table *table) {
         // 更新統計資訊
         statistics_update_on_delete(table->statistics, &row_to_delete);
         
-        free(cursor);
+        cursor_close(cursor);
         return EXECUTE_SUCCESS;
       }
     }
 
     // 沒有找到該 key
-    free(cursor);
+    cursor_close(cursor);
     return EXECUTE_KEY_NOT_FOUND;
   }
 
@@ -3837,7 +9692,7 @@ ExecuteResult execute_delete(Statement *statement, Table *table) {
 
     cursor_advance(cursor);
   }
-  free(cursor);
+  cursor_close(cursor);
 
   // 如果沒有找到任何符合條件的資料
   if (delete_count == 0) {
@@ -3847,7 +9702,7 @@ ExecuteResult execute_delete(Statement *statement, Table *table) {
   // 從後往前刪除，避免索引變化的問題
   for (int i = delete_count - 1; i >= 0; i--) {
     Cursor *delete_cursor = table_find(table, to_delete[i]);
-    void *node = get_page(table->pager, delete_cursor->page_num);
+    void *node = delete_cursor->leaf.data;
     uint32_t num_cells = *leaf_node_num_cells(node);
 
     if (delete_cursor->cell_num < num_cells) {
@@ -3865,7 +9720,8 @@ ExecuteResult execute_delete(Statement *statement, Table *table) {
       }
     }
 
-    free(delete_cursor);
+    cursor_close(delete_cursor);
+    pager_evict_to_budget(table->pager);
   }
 
   return EXECUTE_SUCCESS;
@@ -3879,17 +9735,41 @@ ExecuteResult execute_delete(Statement *statement, Table *table) {
  * @return 執行結果
  */
 ExecuteResult execute_statement(Statement *statement, Table *table) {
+  if (statement->type != STATEMENT_SELECT) {
+    ExecuteResult lock_result = table_begin_write(table);
+    if (lock_result != EXECUTE_SUCCESS) {
+      return lock_result;
+    }
+  }
+
+  // SYNC_FULL：交易外的修改語句以隱含交易執行，和明確的交易一樣經過日誌提交
+  bool implicit_transaction = statement->type != STATEMENT_SELECT &&
+                              table->pager->sync_level == SYNC_FULL &&
+                              !is_in_transaction(table);
+  if (implicit_transaction) {
+    transaction_begin(table);
+  }
+
+  ExecuteResult result = EXECUTE_SUCCESS;
   switch (statement->type) {
   case STATEMENT_INSERT:
-    return execute_insert(statement, table);
+    result = execute_insert(statement, table);
+    break;
   case STATEMENT_SELECT:
-    return execute_select(statement, table);
+    result = execute_select(statement, table);
+    break;
   case STATEMENT_UPDATE:
-    return execute_update(statement, table);
+    result = execute_update(statement, table);
+    break;
   case STATEMENT_DELETE:
-    return execute_delete(statement, table);
+    result = execute_delete(statement, table);
+    break;
   }
-  return EXECUTE_SUCCESS;
+
+  if (implicit_transaction) {
+    transaction_commit(table);
+  }
+  return result;
 }
 
 /* ============================================================================
@@ -3905,18 +9785,165 @@ ExecuteResult execute_statement(Statement *statement, Table *table) {
  * @return 程式結束碼
  */
 int main(int argc, char *argv[]) {
-  if (argc < 2) {
+  OpenOptions options;
+  options.cache_pages = PAGER_DEFAULT_CACHE_PAGES;
+  options.page_size = 0;
+  options.use_mmap = false;
+  options.use_direct = false;
+  options.readahead = PAGER_DEFAULT_READAHEAD;
+  options.group_commits = WAL_DEFAULT_GROUP_COMMITS;
+  options.group_delay_ms = WAL_DEFAULT_GROUP_DELAY_MS;
+  options.sync_level = SYNC_NORMAL;
+  options.sync_level_given = false;
+  options.use_cow = false;
+  options.txn_log = TXN_LOG_PAGE;
+  options.txn_shadow_pages = TXN_DEFAULT_SHADOW_PAGES;
+  options.checkpoint_interval_ms = 0;
+  options.checkpoint_pages = 0;
+  char *filename = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--cache-pages=", 14) == 0) {
+      int cache_pages = atoi(argv[i] + 14);
+      if (cache_pages <= 0) {
+        printf("Error: --cache-pages must be a positive integer (got '%s')\n", argv[i] + 14);
+        exit(EXIT_FAILURE);
+      }
+      options.cache_pages = (uint32_t)cache_pages;
+    } else if (strncmp(argv[i], "--page-size=", 12) == 0) {
+      int page_size = atoi(argv[i] + 12);
+      if (page_size <= 0 || !page_size_is_valid((uint32_t)page_size)) {
+        printf("Error: --page-size must be a power of two between %u and %u (got '%s')\n",
+               MIN_PAGE_SIZE, MAX_PAGE_SIZE, argv[i] + 12);
+        exit(EXIT_FAILURE);
+      }
+      options.page_size = (uint32_t)page_size;
+    } else if (strcmp(argv[i], "--mmap") == 0) {
+      options.use_mmap = true;
+    } else if (strcmp(argv[i], "--direct") == 0) {
+      options.use_direct = true;
+    } else if (strcmp(argv[i], "--cow") == 0) {
+      options.use_cow = true;
+    } else if (strncmp(argv[i], "--readahead=", 12) == 0) {
+      char *end = NULL;
+      long readahead = strtol(argv[i] + 12, &end, 10);
+      if (end == argv[i] + 12 || *end != '\0' || readahead < 0 ||
+          readahead > PAGER_MAX_READAHEAD) {
+        printf("Error: --readahead must be between 0 and %d (got '%s')\n",
+               PAGER_MAX_READAHEAD, argv[i] + 12);
+        exit(EXIT_FAILURE);
+      }
+      options.readahead = (uint32_t)readahead;
+    } else if (strncmp(argv[i], "--group-commit=", 15) == 0) {
+      char *end = NULL;
+      long group_commits = strtol(argv[i] + 15, &end, 10);
+      if (end == argv[i] + 15 || *end != '\0' || group_commits < 1 ||
+          group_commits > WAL_MAX_GROUP_COMMITS) {
+        printf("Error: --group-commit must be between 1 and %d (got '%s')\n",
+               WAL_MAX_GROUP_COMMITS, argv[i] + 15);
+        exit(EXIT_FAILURE);
+      }
+      options.group_commits = (uint32_t)group_commits;
+    } else if (strncmp(argv[i], "--group-commit-delay=", 21) == 0) {
+      char *end = NULL;
+      long group_delay_ms = strtol(argv[i] + 21, &end, 10);
+      if (end == argv[i] + 21 || *end != '\0' || group_delay_ms < 0 ||
+          group_delay_ms > WAL_MAX_GROUP_DELAY_MS) {
+        printf("Error: --group-commit-delay must be between 0 and %d ms (got '%s')\n",
+               WAL_MAX_GROUP_DELAY_MS, argv[i] + 21);
+        exit(EXIT_FAILURE);
+      }
+      options.group_delay_ms = (uint32_t)group_delay_ms;
+    } else if (strncmp(argv[i], "--sync=", 7) == 0) {
+      if (!parse_sync_level(argv[i] + 7, &options.sync_level)) {
+        printf("Error: --sync must be off, normal or full (got '%s')\n", argv[i] + 7);
+        exit(EXIT_FAILURE);
+      }
+      options.sync_level_given = true;
+    } else if (strncmp(argv[i], "--txn-pages=", 12) == 0) {
+      int txn_pages = atoi(argv[i] + 12);
+      if (txn_pages <= 0) {
+        printf("Error: --txn-pages must be a positive integer (got '%s')\n", argv[i] + 12);
+        exit(EXIT_FAILURE);
+      }
+      options.txn_shadow_pages = (uint32_t)txn_pages;
+    } else if (strncmp(argv[i], "--checkpoint-interval=", 22) == 0) {
+      char *end = NULL;
+      long interval_ms = strtol(argv[i] + 22, &end, 10);
+      if (end == argv[i] + 22 || *end != '\0' || interval_ms < 0 ||
+          interval_ms > CHECKPOINTER_MAX_INTERVAL_MS) {
+        printf("Error: --checkpoint-interval must be between 0 and %d ms (got '%s')\n",
+               CHECKPOINTER_MAX_INTERVAL_MS, argv[i] + 22);
+        exit(EXIT_FAILURE);
+      }
+      options.checkpoint_interval_ms = (uint32_t)interval_ms;
+    } else if (strncmp(argv[i], "--checkpoint-pages=", 19) == 0) {
+      char *end = NULL;
+      long checkpoint_pages = strtol(argv[i] + 19, &end, 10);
+      if (end == argv[i] + 19 || *end != '\0' || checkpoint_pages < 0 ||
+          checkpoint_pages > UINT32_MAX) {
+        printf("Error: --checkpoint-pages must be a non-negative integer (got '%s')\n",
+               argv[i] + 19);
+        exit(EXIT_FAILURE);
+      }
+      options.checkpoint_pages = (uint32_t)checkpoint_pages;
+    } else if (strncmp(argv[i], "--txn-log=", 10) == 0) {
+      if (!parse_txn_log_mode(argv[i] + 10, &options.txn_log)) {
+        printf("Error: --txn-log must be page or row (got '%s')\n", argv[i] + 10);
+        exit(EXIT_FAILURE);
+      }
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      printf("Error: Unknown option '%s'\n", argv[i]);
+      exit(EXIT_FAILURE);
+    } else if (filename == NULL) {
+      filename = argv[i];
+    }
+  }
+
+  if (filename == NULL) {
     printf("Must supply a database filename.\n");
+    printf("Usage: %s [--cache-pages=N] [--page-size=N] [--readahead=N] [--mmap | --direct] "
+           "[--group-commit=N] [--group-commit-delay=MS] [--sync=off|normal|full] [--cow] "
+           "[--txn-log=page|row] [--txn-pages=N] [--checkpoint-interval=MS] "
+           "[--checkpoint-pages=N] <database_file>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  if (options.use_mmap && options.use_direct) {
+    // 映射的頁面本身就位於作業系統的頁面快取中
+    printf("Error: --mmap and --direct cannot be used together\n");
     exit(EXIT_FAILURE);
   }
 
-  char *filename = argv[1];
-  Table *table = db_open(filename);
+  Table *table = db_open(filename, &options);
 
   InputBuffer *input_buffer = new_input_buffer();
   while (true) {
+    // 語句之間是緩衝池的安全點，也是寫入時複製資料庫解除釘選與釋放寫入鎖的時機
+    table_end_statement(table);
+    pager_evict_to_budget(table->pager);
+    // 群組提交：在群組的期限內等待下一個命令加入群組；期限已過或期限內
+    // 沒有命令可執行時立即 fsync，已提交的交易不會一直停留在未同步的狀態
+    Wal *wal = &table->pager->wal;
+    if (wal->pending_commits > 0 && table->pager->sync_level == SYNC_FULL) {
+      uint32_t time_left = wal_group_time_left_ms(wal);
+      if (time_left == 0 || !input_available(input_buffer, time_left)) {
+        wal_sync(wal);
+      }
+    }
     print_prompt();
-    read_input(input_buffer);
+    // 等待輸入時背景檢查點可以寫回修改
+    table_unlock(table);
+    bool has_input = read_input(input_buffer);
+    table_lock(table);
+    if (!has_input) {
+      // 輸入結束：與 .exit 相同，在持有鎖時停止背景檢查點並關閉資料庫
+      printf("\nExiting...\n");
+      close_input_buffer(input_buffer);
+      db_close(table);
+      exit(EXIT_SUCCESS);
+    }
+    table_begin_read(table);
 
     if (input_buffer->buffer[0] == '.') {
       switch (do_meta_command(input_buffer, table)) {
@@ -3942,7 +9969,7 @@ int main(int argc, char *argv[]) {
       continue;
     } else if (strcmp(cmd_lower, "commit") == 0) {
       if (transaction_commit(table) == EXECUTE_SUCCESS) {
-        printf("Transaction committed.\n");
+        wal_confirm_commit(table->pager, "Transaction committed.\n");
       }
       free(cmd_lower);
       continue;
@@ -3952,6 +9979,24 @@ int main(int argc, char *argv[]) {
       }
       free(cmd_lower);
       continue;
+    } else if (strncmp(cmd_lower, "savepoint ", 10) == 0) {
+      if (transaction_savepoint(table, savepoint_name(cmd_lower + 10)) == EXECUTE_SUCCESS) {
+        printf("Savepoint created.\n");
+      }
+      free(cmd_lower);
+      continue;
+    } else if (strncmp(cmd_lower, "rollback to ", 12) == 0) {
+      if (transaction_rollback_to(table, savepoint_name(cmd_lower + 12)) == EXECUTE_SUCCESS) {
+        printf("Rolled back to savepoint.\n");
+      }
+      free(cmd_lower);
+      continue;
+    } else if (strncmp(cmd_lower, "release ", 8) == 0) {
+      if (transaction_release(table, savepoint_name(cmd_lower + 8)) == EXECUTE_SUCCESS) {
+        printf("Savepoint released.\n");
+      }
+      free(cmd_lower);
+      continue;
     } else if (strcmp(cmd_lower, "analyze") == 0) {
       // 處理 ANALYZE 命令（不區分大小寫）
       printf("Analyzing table statistics...\n");
@@ -3959,7 +10004,9 @@ int main(int argc, char *argv[]) {
       if (new_stats != NULL) {
         memcpy(table->statistics, new_stats, sizeof(TableStatistics));
         free(new_stats);
-        statistics_save(table);
+        if (table_begin_write(table) == EXECUTE_SUCCESS) {
+          statistics_save(table);
+        }
         printf("Statistics updated successfully.\n");
         printf("  Total rows: %u\n", table->statistics->total_rows);
         printf("  ID range: %u - %u\n", table->statistics->id_min, table->statistics->id_max);
@@ -3994,7 +10041,12 @@ int main(int argc, char *argv[]) {
 
     switch (execute_statement(&statement, table)) {
     case EXECUTE_SUCCESS:
-      printf("Executed.\n");
+      if (statement.type == STATEMENT_SELECT || is_in_transaction(table)) {
+        printf("Executed.\n");
+      } else {
+        // 交易外的修改以隱含交易提交，與 COMMIT 一樣等群組同步後才確認
+        wal_confirm_commit(table->pager, "Executed.\n");
+      }
       break;
     case EXECUTE_DUPLICATE_KEY:
       printf("Error: Duplicate key.\n");
@@ -4005,6 +10057,12 @@ int main(int argc, char *argv[]) {
     case EXECUTE_KEY_NOT_FOUND:
       printf("Error: Key not found.\n");
       break;
+    case EXECUTE_DATABASE_LOCKED:
+      printf("Error: Database is locked by another writer.\n");
+      break;
+    case EXECUTE_SNAPSHOT_STALE:
+      printf("Error: Database changed since this transaction began; roll back and retry.\n");
+      break;
     }
   }
 }
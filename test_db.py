@@ -1,12 +1,23 @@
 import subprocess
 from pathlib import Path
 import atexit
+import sys
+import time
 
 
 # 用於追蹤測試過程中創建的所有資料庫檔案
 created_db_files = set()
 
-def run_test(commands, db_filename="mydb.db", reset_db=True):
+# 未通過的檢查；全部測試結束後有任何一項未通過時以非零結束碼結束
+failed_checks = []
+
+def db_sidecar_paths(db_path):
+    """資料庫檔案與它的預寫日誌、讀取者表"""
+    return (db_path, db_path.with_name(db_path.name + "-wal"),
+            db_path.with_name(db_path.name + "-readers"))
+
+
+def run_test(commands, db_filename="mydb.db", reset_db=True, extra_args=None, crash=False):
     binary_path = Path(__file__).resolve().with_name("main")
     if not binary_path.exists():
         raise FileNotFoundError(f"未找到執行檔: {binary_path}")
@@ -16,12 +27,38 @@ def run_test(commands, db_filename="mydb.db", reset_db=True):
     # 記錄創建的資料庫檔案
     created_db_files.add(db_path)
     
-    if reset_db and db_path.exists():
-        db_path.unlink()
+    if reset_db:
+        for path in db_sidecar_paths(db_path):
+            if path.exists():
+                path.unlink()
 
     joined = "\n".join(commands) + "\n"
+    if crash:
+        # 模擬當機：不關閉標準輸入（輸入結束會正常關閉資料庫），所有命令執行
+        # 完畢、送出最後一個提示符號後強制結束行程
+        process = subprocess.Popen(
+            [str(binary_path), *(extra_args or []), str(db_path)],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            stderr=subprocess.PIPE,
+            bufsize=0,
+        )
+        process.stdin.write(joined.encode())
+        data = b""
+        while data.count(b"db > ") <= len(commands):
+            chunk = process.stdout.read(4096)
+            if not chunk:
+                break
+            data += chunk
+        process.kill()
+        process.wait()
+        process.stdin.close()
+        process.stdout.close()
+        process.stderr.close()
+        return data.decode(), "", process.returncode
+
     result = subprocess.run(
-        [str(binary_path), str(db_path)],
+        [str(binary_path), *(extra_args or []), str(db_path)],
         input=joined,
         text=True,
         capture_output=True,
@@ -30,6 +67,46 @@ def run_test(commands, db_filename="mydb.db", reset_db=True):
     return result.stdout, result.stderr, result.returncode
 
 
+class Session:
+    """保持開啟的 REPL，用於測試多個行程同時開啟同一個資料庫"""
+
+    def __init__(self, db_filename, extra_args=None):
+        binary_path = Path(__file__).resolve().with_name("main")
+        db_path = binary_path.with_name(db_filename)
+        created_db_files.add(db_path)
+        self.process = subprocess.Popen(
+            [str(binary_path), *(extra_args or []), str(db_path)],
+            stdin=subprocess.PIPE,
+            stdout=subprocess.PIPE,
+            bufsize=0,
+        )
+        self.output = self._read_prompt()
+
+    def _read_prompt(self):
+        # 每個命令執行完畢後 REPL 會立即送出提示符號
+        data = b""
+        while not data.endswith(b"db > "):
+            chunk = self.process.stdout.read(4096)
+            if not chunk:
+                break
+            data += chunk
+        return data.decode()
+
+    def run(self, command):
+        self.process.stdin.write((command + "\n").encode())
+        output = self._read_prompt()
+        self.output += command + "\n" + output
+        return output
+
+    def close(self):
+        self.process.stdin.write(b".exit\n")
+        self.process.stdin.close()
+        self.output += self.process.stdout.read().decode()
+        code = self.process.wait()
+        self.process.stdout.close()
+        return self.output, "", code
+
+
 def print_result(title, stdout, stderr, code):
     print(f"=== {title}標準輸出 ===")
     print(stdout, end="")
@@ -41,6 +118,45 @@ def print_result(title, stdout, stderr, code):
     print(f"=== {title}程式結束碼: {code} ===")
 
 
+def command_outputs(stdout):
+    """依提示符號把輸出切成每個命令各自的輸出"""
+    return stdout.split("db > ")[1:]
+
+
+def rows_in(stdout):
+    """輸出中 select 印出的列 (id, username, email)"""
+    rows = []
+    for line in stdout.splitlines():
+        line = line.replace("db > ", "")
+        if line.startswith("(") and line.endswith(")"):
+            row_id, username, email = line[1:-1].split(", ")
+            rows.append((int(row_id), username, email))
+    return rows
+
+
+def row_ids(stdout):
+    return [row[0] for row in rows_in(stdout)]
+
+
+def counter(stdout, name):
+    """.cache、.wal、.cow 等命令輸出中最後一次出現的計數器（例如 "Syncs: 2"）"""
+    values = []
+    for line in stdout.splitlines():
+        line = line.replace("db > ", "").strip()
+        if line.startswith(name + ":"):
+            values.append(line[len(name) + 1:].strip())
+    return values[-1] if values else None
+
+
+def check(title, actual, expected):
+    """比對實際值與預期值，未通過時記錄下來"""
+    if actual == expected:
+        print(f"檢查通過: {title}")
+    else:
+        print(f"檢查失敗: {title}（預期 {expected!r}，實際 {actual!r}）")
+        failed_checks.append(title)
+
+
 def cleanup_db_files():
     """清理測試過程中創建的所有資料庫檔案"""
     print("\n" + "="*50)
@@ -48,12 +164,14 @@ def cleanup_db_files():
     print("="*50)
     
     for db_path in created_db_files:
-        if db_path.exists():
-            try:
-                db_path.unlink()
-                print(f"已刪除: {db_path.name}")
-            except Exception as e:
-                print(f"無法刪除 {db_path.name}: {e}")
+        # 異常結束的測試會留下預寫日誌，寫入時複製資料庫會留下讀取者表，一併刪除
+        for path in db_sidecar_paths(db_path):
+            if path.exists():
+                try:
+                    path.unlink()
+                    print(f"已刪除: {path.name}")
+                except Exception as e:
+                    print(f"無法刪除 {path.name}: {e}")
     
     print(f"共清理 {len(created_db_files)} 個資料庫檔案")
     print("="*50)
@@ -1043,6 +1161,772 @@ def test_statistics_edge_cases():
     print_result("統計資訊邊界情況", stdout, stderr, code)
 
 
+def test_buffer_pool():
+    """測試緩衝池頁框預算與置換"""
+    print("\n" + "="*50)
+    print("測試 22: 緩衝池置換")
+    print("="*50)
+    
+    # 插入超過頁框預算的資料，迫使緩衝池置換頁面
+    commands = []
+    for i in range(1, 501):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands.extend([
+        ".cache",
+        "select where id >= 495",
+        ".exit"
+    ])
+    
+    stdout, stderr, code = run_test(commands, db_filename="buffer_pool_test.db",
+                                    extra_args=["--cache-pages=16"])
+    print_result("緩衝池置換（寫入）", stdout, stderr, code)
+    
+    # 重新開啟並以更小的預算掃描整個表（唯讀操作不應寫回任何頁面）
+    commands = [
+        "select where id <= 5",
+        ".cache 8",
+        "select where id > 1 AND id < 3",
+        ".exit"
+    ]
+    
+    stdout, stderr, code = run_test(commands, db_filename="buffer_pool_test.db",
+                                    reset_db=False, extra_args=["--cache-pages=16"])
+    print_result("緩衝池置換（重新開啟）", stdout, stderr, code)
+    
+    # 交易提交時，相鄰的髒頁會合併為單次寫入（Write calls < Page writes）
+    commands = [
+        "BEGIN",
+        "update - batch@example.com where id > 0",
+        "COMMIT",
+        ".cache",
+        "select where id = 250",
+        ".exit"
+    ]
+    
+    stdout, stderr, code = run_test(commands, db_filename="buffer_pool_test.db",
+                                    reset_db=False)
+    print_result("緩衝池合併寫入", stdout, stderr, code)
+
+
+def test_mmap_mode():
+    """測試 mmap 讀取模式"""
+    print("\n" + "="*50)
+    print("測試 23: mmap 讀取模式")
+    print("="*50)
+    
+    commands = []
+    for i in range(1, 201):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands.append(".exit")
+    run_test(commands, db_filename="mmap_test.db")
+    
+    # 以 mmap 開啟：既有頁面直接從映射讀取，修改後經由 pwrite 寫回
+    commands = [
+        "select where id >= 198",
+        "update - mapped@example.com where id = 100",
+        "insert 201 user201 user201@example.com",
+        "delete 50",
+        ".cache",
+        ".exit"
+    ]
+    
+    stdout, stderr, code = run_test(commands, db_filename="mmap_test.db",
+                                    reset_db=False, extra_args=["--mmap"])
+    print_result("mmap 讀取模式", stdout, stderr, code)
+    
+    # 以一般模式重新開啟，確認修改已寫入檔案
+    commands = [
+        "select where id = 100",
+        "select where id = 50",
+        "select where id >= 200",
+        ".exit"
+    ]
+    
+    stdout, stderr, code = run_test(commands, db_filename="mmap_test.db", reset_db=False)
+    print_result("mmap 修改持久化", stdout, stderr, code)
+
+
+def test_freelist_reuse():
+    """測試空閒頁串列的頁面重用"""
+    print("\n" + "="*50)
+    print("測試 24: 空閒頁重用")
+    print("="*50)
+    
+    # 插入後全部刪除：合併釋放的頁面進入空閒頁串列
+    commands = []
+    for i in range(1, 301):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    for i in range(1, 301):
+        commands.append(f"delete {i}")
+    commands.extend([".cache", ".exit"])
+    
+    stdout, stderr, code = run_test(commands, db_filename="freelist_test.db")
+    print_result("空閒頁重用（釋放）", stdout, stderr, code)
+    
+    # 重新開啟後再次插入：頁面從空閒頁串列取得，資料庫頁數不應增加
+    commands = []
+    for i in range(1, 301):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands.extend([
+        ".cache",
+        "select where id > 297",
+        ".exit"
+    ])
+    
+    stdout, stderr, code = run_test(commands, db_filename="freelist_test.db", reset_db=False)
+    print_result("空閒頁重用（重新配置）", stdout, stderr, code)
+
+
+def test_header_page():
+    """測試標頭頁的版本檢查與統計資訊持久化"""
+    print("\n" + "="*50)
+    print("測試 25: 標頭頁與統計資訊持久化")
+    print("="*50)
+    
+    commands = []
+    for i in range(1, 51):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands.extend([".stats", ".exit"])
+    
+    stdout, stderr, code = run_test(commands, db_filename="header_test.db")
+    print_result("標頭頁（建立）", stdout, stderr, code)
+    
+    # 重新開啟後統計資訊直接從統計資訊頁載入，不需要重新掃描整個表
+    commands = [".stats", ".cache", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="header_test.db", reset_db=False)
+    print_result("標頭頁（統計資訊載入）", stdout, stderr, code)
+    
+    # 修改格式版本後應拒絕開啟
+    db_path = Path(__file__).resolve().with_name("header_test.db")
+    with open(db_path, "r+b") as f:
+        f.seek(8)
+        f.write((99).to_bytes(4, "little"))
+    stdout, stderr, code = run_test([".exit"], db_filename="header_test.db", reset_db=False)
+    print_result("標頭頁（不支援的格式版本）", stdout, stderr, code)
+
+
+def test_page_size():
+    """測試建立資料庫時指定頁面大小"""
+    print("\n" + "="*50)
+    print("測試 26: 可設定的頁面大小")
+    print("="*50)
+    
+    commands = []
+    for i in range(1, 101):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands.extend([".constants", ".exit"])
+    
+    stdout, stderr, code = run_test(commands, db_filename="page_size_test.db",
+                                    extra_args=["--page-size=16384"])
+    print_result("頁面大小（建立）", stdout, stderr, code)
+    
+    # 重新開啟時不指定頁面大小，應自動使用標頭頁記錄的大小
+    commands = [
+        ".constants",
+        "select where id > 97",
+        ".cache",
+        ".exit"
+    ]
+    stdout, stderr, code = run_test(commands, db_filename="page_size_test.db", reset_db=False)
+    print_result("頁面大小（重新開啟）", stdout, stderr, code)
+    
+    # 不合法的頁面大小
+    stdout, stderr, code = run_test([".exit"], db_filename="page_size_invalid_test.db",
+                                    extra_args=["--page-size=5000"])
+    print_result("頁面大小（不合法）", stdout, stderr, code)
+
+
+def test_direct_io():
+    """測試直接 I/O 模式"""
+    print("\n" + "="*50)
+    print("測試 27: 直接 I/O 模式")
+    print("="*50)
+    
+    # 小頁框預算迫使置換，置換與關閉時的寫回都經過直接 I/O
+    commands = []
+    for i in range(1, 201):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands.extend([".exit"])
+    
+    stdout, stderr, code = run_test(commands, db_filename="direct_test.db",
+                                    extra_args=["--direct", "--cache-pages=8"])
+    print_result("直接 I/O（寫入）", stdout, stderr, code)
+    
+    commands = [
+        "select where id > 197",
+        "select where id = 100",
+        ".exit"
+    ]
+    stdout, stderr, code = run_test(commands, db_filename="direct_test.db", reset_db=False,
+                                    extra_args=["--direct"])
+    print_result("直接 I/O（讀取）", stdout, stderr, code)
+    
+    # 與 --mmap 互斥
+    stdout, stderr, code = run_test([".exit"], db_filename="direct_test.db", reset_db=False,
+                                    extra_args=["--direct", "--mmap"])
+    print_result("直接 I/O（與 mmap 互斥）", stdout, stderr, code)
+
+
+def test_readahead():
+    """測試掃描時的循序預讀"""
+    print("\n" + "="*50)
+    print("測試 28: 循序預讀")
+    print("="*50)
+    
+    commands = []
+    for i in range(1, 301):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands.append(".exit")
+    run_test(commands, db_filename="readahead_test.db")
+    
+    # 全表掃描：每進入一個葉節點就預讀後續的葉節點
+    commands = [
+        "select where username = user300",
+        ".cache",
+        ".exit"
+    ]
+    stdout, stderr, code = run_test(commands, db_filename="readahead_test.db", reset_db=False,
+                                    extra_args=["--cache-pages=8"])
+    print_result("循序預讀（預設）", stdout, stderr, code)
+    
+    # 停用預讀：查詢結果相同，Read-ahead pages 為 0
+    stdout, stderr, code = run_test(commands, db_filename="readahead_test.db", reset_db=False,
+                                    extra_args=["--cache-pages=8", "--readahead=0"])
+    print_result("循序預讀（停用）", stdout, stderr, code)
+
+
+def test_pinned_pages():
+    """測試頁面釘選與交易中的結構變更"""
+    print("\n" + "="*50)
+    print("測試 29: 頁面釘選")
+    print("="*50)
+    
+    commands = []
+    for i in range(1, 101):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands.append(".exit")
+    run_test(commands, db_filename="pin_test.db")
+    
+    # 交易中的分裂與合併由影子頁面涵蓋，回滾後樹狀結構與資料恢復原狀；
+    # 語句結束後不應留下任何被釘選的頁框
+    commands = ["begin"]
+    for i in range(101, 301):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands += [
+        "delete where id > 10 AND id < 60",
+        "rollback",
+        "select where id > 95 AND id < 105",
+        ".cache",
+        ".exit"
+    ]
+    stdout, stderr, code = run_test(commands, db_filename="pin_test.db", reset_db=False,
+                                    extra_args=["--cache-pages=8"])
+    print_result("交易回滾分裂與合併", stdout, stderr, code)
+    
+    # 重新開啟後資料完整，回滾時新增的頁面已放回空閒頁串列
+    commands = [
+        "select where id > 98",
+        ".cache",
+        ".exit"
+    ]
+    stdout, stderr, code = run_test(commands, db_filename="pin_test.db", reset_db=False)
+    print_result("重新開啟", stdout, stderr, code)
+
+
+def crc32c(data, crc=0xFFFFFFFF):
+    """CRC32C（Castagnoli），與 main.c 的頁面校驗碼相同"""
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ (0x82F63B78 if crc & 1 else 0)
+    return crc
+
+
+def write_interleaved_leaves(db_path, version):
+    """將葉節點改寫為第 2 版以前 key 與 value 交錯的佈局，並設定格式版本
+
+    第 2 版的頁面帶有校驗碼，因此改寫後重新計算所有頁面的校驗碼。
+    """
+    data = bytearray(db_path.read_bytes())
+    page_size = int.from_bytes(data[12:16], "little")
+    header_size, key_size, row_size = 14, 4, 293
+    keys_offset = 16
+    max_cells = (page_size - 4 - keys_offset) // (key_size + row_size)
+    values_offset = keys_offset + max_cells * key_size
+
+    def u32(offset):
+        return int.from_bytes(data[offset:offset + 4], "little")
+
+    # 由根節點沿最左邊的子節點走到第一個葉節點，再沿葉節點串列改寫
+    page = u32(16)
+    while data[page * page_size] == 0:
+        page = u32(page * page_size + header_size)
+    while page != 0:
+        base = page * page_size
+        num_cells = u32(base + 6)
+        cells = bytearray(page_size - 4 - header_size)
+        for i in range(num_cells):
+            key = data[base + keys_offset + i * key_size:][:key_size]
+            value = data[base + values_offset + i * row_size:][:row_size]
+            cells[i * (key_size + row_size):(i + 1) * (key_size + row_size)] = key + value
+        data[base + header_size:base + page_size - 4] = cells
+        page = u32(base + 10)
+
+    data[8:12] = version.to_bytes(4, "little")
+    if version >= 2:
+        for page in range(len(data) // page_size):
+            base = page * page_size
+            crc = crc32c(page.to_bytes(4, "little"))
+            crc = crc32c(data[base:base + page_size - 4], crc) ^ 0xFFFFFFFF
+            data[base + page_size - 4:base + page_size] = crc.to_bytes(4, "little")
+    db_path.write_bytes(bytes(data))
+
+
+def test_page_checksums():
+    """測試頁面校驗碼的驗證與舊版格式升級"""
+    print("\n" + "="*50)
+    print("測試 30: 頁面校驗碼")
+    print("="*50)
+    
+    commands = []
+    for i in range(1, 31):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands.append(".exit")
+    run_test(commands, db_filename="checksum_test.db")
+    
+    # 將檔案改回第 1 版（沒有校驗碼、葉節點交錯存放），開啟時重新寫出所有頁面的
+    # 校驗碼，再改寫葉節點佈局
+    db_path = Path(__file__).resolve().with_name("checksum_test.db")
+    write_interleaved_leaves(db_path, 1)
+    stdout, stderr, code = run_test(["select where id = 30", ".exit"],
+                                    db_filename="checksum_test.db", reset_db=False)
+    print_result("校驗碼（第 1 版升級）", stdout, stderr, code)
+    
+    # 修改第 2 頁中的一個位元組後，載入該頁時應回報頁面損毀
+    with open(db_path, "r+b") as f:
+        f.seek(2 * 4096 + 100)
+        byte = f.read(1)
+        f.seek(2 * 4096 + 100)
+        f.write(bytes([byte[0] ^ 0xFF]))
+    stdout, stderr, code = run_test(["select", ".exit"],
+                                    db_filename="checksum_test.db", reset_db=False)
+    print_result("校驗碼（頁面損毀）", stdout, stderr, code)
+    check("回報損毀的頁面", ("Page 2 is corrupted" in stdout, code), (True, 1))
+    
+    # 樹中的頁面整頁被清為 0 也是損毀（只有標頭頁記錄的頁面數之後才可能是未寫入的頁面）
+    commands = [f"insert {i} user{i} user{i}@example.com" for i in range(1, 31)]
+    commands.append(".exit")
+    run_test(commands, db_filename="checksum_test.db")
+    with open(db_path, "r+b") as f:
+        f.seek(3 * 4096)
+        f.write(bytes(4096))
+    stdout, stderr, code = run_test(["select", ".exit"],
+                                    db_filename="checksum_test.db", reset_db=False)
+    print_result("校驗碼（頁面被清為 0）", stdout, stderr, code)
+    check("回報被清為 0 的頁面", ("Page 3 is corrupted" in stdout, code), (True, 1))
+
+
+def test_write_ahead_log():
+    """測試預寫日誌的提交、檢查點與當機復原"""
+    print("\n" + "="*50)
+    print("測試 31: 預寫日誌")
+    print("="*50)
+    
+    # 提交的交易寫入日誌；檢查點後日誌清空
+    commands = ["begin"]
+    for i in range(1, 21):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands += ["commit", ".wal", ".checkpoint", ".wal", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="wal_test.db")
+    print_result("預寫日誌（提交與檢查點）", stdout, stderr, code)
+    
+    # 沒有 .exit 就結束（模擬當機）：已提交的交易留在日誌中，未提交的交易不會保留
+    commands = ["begin"]
+    for i in range(21, 41):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands += ["commit", "begin", "delete where id <= 10", ".wal"]
+    stdout, stderr, code = run_test(commands, db_filename="wal_test.db", reset_db=False,
+                                    crash=True)
+    print_result("預寫日誌（異常結束）", stdout, stderr, code)
+    
+    # 重新開啟時重做日誌中已提交的交易
+    commands = ["select where id > 15 AND id < 25", "select where id = 40",
+                "select where id < 3", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="wal_test.db", reset_db=False)
+    print_result("預寫日誌（復原）", stdout, stderr, code)
+    outputs = command_outputs(stdout)
+    check("復原已提交的交易", row_ids(outputs[0] + outputs[1]), list(range(16, 25)) + [40])
+    check("未提交的刪除不會保留", row_ids(outputs[2]), [1, 2])
+
+
+def test_group_commit():
+    """測試群組提交：連續的交易共用一次日誌 fsync"""
+    print("\n" + "="*50)
+    print("測試 32: 群組提交")
+    print("="*50)
+    
+    # 每 4 個交易 fsync 一次，整組同步後才輸出提交確認；最後 2 個交易在 .wal 時
+    # 仍待同步，.exit 時隨檢查點同步後才確認
+    commands = []
+    for i in range(1, 11):
+        commands += ["begin", f"insert {i} user{i} user{i}@example.com", "commit"]
+    commands += [".wal", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="group_commit_test.db",
+                                    extra_args=["--sync=full", "--group-commit=4",
+                                                "--group-commit-delay=1000"])
+    print_result("群組提交", stdout, stderr, code)
+    outputs = command_outputs(stdout)
+    confirmed = [outputs[i].count("Transaction committed.")
+                 for i, command in enumerate(commands) if command in ("commit", ".exit")]
+    check("每組同步後才輸出提交確認", confirmed, [0, 0, 0, 4, 0, 0, 0, 4, 0, 0, 2])
+    check("群組提交的同步次數", counter(stdout, "Syncs"), "2")
+    check("待同步的提交", counter(stdout, "Pending commits"), "2")
+    
+    commands = ["select where id > 7", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="group_commit_test.db",
+                                    reset_db=False)
+    print_result("群組提交（重新開啟）", stdout, stderr, code)
+    check("群組提交（重新開啟）的資料", row_ids(stdout), [8, 9, 10])
+    
+    stdout, stderr, code = run_test([".exit"], db_filename="group_commit_test.db",
+                                    reset_db=False, extra_args=["--group-commit=0"])
+    print_result("群組提交（無效的參數）", stdout, stderr, code)
+
+
+def test_sync_levels():
+    """測試持久性等級：off／normal／full 決定何時 fsync"""
+    print("\n" + "="*50)
+    print("測試 33: 持久性等級")
+    print("="*50)
+    
+    # 預設為 normal；full：每次提交都同步日誌，自動提交的語句也經過日誌
+    commands = [".sync", ".sync full", "insert 1 user1 user1@example.com",
+                "insert 2 user2 user2@example.com", ".wal", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="sync_level_test.db")
+    print_result("持久性等級 full", stdout, stderr, code)
+    
+    # normal：提交只寫入日誌，等到檢查點才同步
+    commands = [".sync normal"]
+    for i in range(3, 6):
+        commands += ["begin", f"insert {i} user{i} user{i}@example.com", "commit"]
+    commands += [".wal", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="sync_level_test.db",
+                                    reset_db=False)
+    print_result("持久性等級 normal", stdout, stderr, code)
+    
+    # off：完全不呼叫 fsync
+    commands = ["begin", "insert 6 user6 user6@example.com", "commit",
+                ".wal", "select", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="sync_level_test.db",
+                                    reset_db=False, extra_args=["--sync=off"])
+    print_result("持久性等級 off", stdout, stderr, code)
+    check("各持久性等級提交的資料", row_ids(stdout), [1, 2, 3, 4, 5, 6])
+    check("off 等級不呼叫 fsync", counter(stdout, "Syncs"), "0")
+    
+    commands = [".sync fast", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="sync_level_test.db",
+                                    reset_db=False)
+    print_result("持久性等級（無效的等級）", stdout, stderr, code)
+
+
+def test_copy_on_write():
+    """測試寫入時複製模式：提交以交替的中繼頁面原子地切換版本"""
+    print("\n" + "="*50)
+    print("測試 34: 寫入時複製")
+    print("="*50)
+    
+    # 以 --cow 建立資料庫；每次提交寫入新的頁面與中繼頁面
+    commands = ["insert 1 user1 user1@example.com",
+                "insert 2 user2 user2@example.com",
+                "begin", "insert 3 user3 user3@example.com", "commit",
+                ".cow", ".wal", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="cow_test.db",
+                                    extra_args=["--cow"])
+    print_result("寫入時複製（建立與提交）", stdout, stderr, code)
+    generation = counter(stdout, "Generation")
+    
+    # 未提交的交易在程式中斷時不會寫入新的中繼頁面
+    commands = ["begin", "insert 4 user4 user4@example.com",
+                "update - changed@example.com where id = 1"]
+    stdout, stderr, code = run_test(commands, db_filename="cow_test.db",
+                                    reset_db=False, crash=True)
+    print_result("寫入時複製（未提交即中斷）", stdout, stderr, code)
+    
+    # 重新開啟時自動辨識格式，只看到最後一次提交的版本
+    commands = ["select", ".cow", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="cow_test.db",
+                                    reset_db=False)
+    print_result("寫入時複製（重新開啟）", stdout, stderr, code)
+    check("只看到最後一次提交的版本", rows_in(stdout),
+          [(i, f"user{i}", f"user{i}@example.com") for i in range(1, 4)])
+    check("中斷的交易不會切換版本", counter(stdout, "Generation"), generation)
+    
+    # 既有的一般資料庫不會轉換格式
+    commands = ["insert 1 user1 user1@example.com", ".exit"]
+    run_test(commands, db_filename="cow_plain_test.db")
+    commands = [".cow", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="cow_plain_test.db",
+                                    reset_db=False, extra_args=["--cow"])
+    print_result("寫入時複製（一般資料庫忽略 --cow）", stdout, stderr, code)
+
+
+def test_snapshot_reads():
+    """測試快照讀取：讀取者釘選開始時的版本，不阻擋其他行程寫入"""
+    print("\n" + "="*50)
+    print("測試 35: 快照讀取")
+    print("="*50)
+    
+    commands = ["insert 1 user1 user1@example.com",
+                "insert 2 user2 user2@example.com",
+                "insert 3 user3 user3@example.com", ".exit"]
+    run_test(commands, db_filename="snapshot_test.db", extra_args=["--cow"])
+    
+    # 讀取者在交易中釘選目前的版本
+    reader = Session("snapshot_test.db", extra_args=["--cache-pages=8"])
+    reader.run("begin")
+    snapshot = rows_in(reader.run("select"))
+    
+    # 另一個行程照常寫入並提交
+    commands = ["insert 4 user4 user4@example.com",
+                "update - changed@example.com where id = 1",
+                "delete 2", ".cow", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="snapshot_test.db",
+                                    reset_db=False)
+    print_result("快照讀取（寫入者）", stdout, stderr, code)
+    
+    # 交易中仍讀到開始時的版本；在過期的版本上修改會被拒絕
+    check("交易中讀到開始時的版本", rows_in(reader.run("select")), snapshot)
+    check("在過期的版本上修改被拒絕",
+          "Database changed" in reader.run("insert 5 user5 user5@example.com"), True)
+    reader.run("rollback")
+    # 交易結束後的語句讀取最新的版本
+    check("交易結束後讀取最新的版本", rows_in(reader.run("select")),
+          [(1, "user1", "changed@example.com"), (3, "user3", "user3@example.com"),
+           (4, "user4", "user4@example.com")])
+    
+    # 持有未提交修改的寫入者（normal 等級直到檢查點才提交）阻擋其他寫入者，
+    # 但不阻擋讀取者
+    writer = Session("snapshot_test.db", extra_args=["--sync=normal"])
+    writer.run("insert 6 user6 user6@example.com")
+    check("未提交的寫入者阻擋其他寫入者",
+          "locked" in reader.run("insert 7 user7 user7@example.com"), True)
+    check("讀取者看不到未提交的修改", row_ids(reader.run("select where id > 3")), [4])
+    writer.run(".checkpoint")
+    check("檢查點提交後讀取者看到修改", row_ids(reader.run("select where id > 3")), [4, 6])
+    
+    print_result("快照讀取（寫入者 normal）", *writer.close())
+    print_result("快照讀取（讀取者）", *reader.close())
+
+
+def test_row_log():
+    """測試列變更記錄：交易只記錄列的前後影像，回滾與當機復原都正確"""
+    print("\n" + "="*50)
+    print("測試 36: 列變更記錄")
+    print("="*50)
+    
+    commands = []
+    for i in range(1, 11):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands.append(".exit")
+    run_test(commands, db_filename="row_log_test.db")
+    
+    # 回滾以前影像復原直接修改的頁面
+    commands = [".txnlog", "begin",
+                "update - changed@example.com where id = 2",
+                "insert 11 user11 user11@example.com",
+                "delete 3", "rollback", "select where id < 5",
+                # 提交的交易只寫入列變更記錄，日誌比整頁小得多
+                "begin",
+                "update - changed@example.com where id = 2",
+                "insert 11 user11 user11@example.com",
+                "delete 3", "commit", ".wal",
+                # 交易中不能執行檢查點，也不能切換記錄方式
+                "begin", ".checkpoint", ".txnlog page", "rollback"]
+    stdout, stderr, code = run_test(commands, db_filename="row_log_test.db",
+                                    reset_db=False, extra_args=["--txn-log=row"], crash=True)
+    print_result("列變更記錄（回滾與提交，異常結束）", stdout, stderr, code)
+    check("回滾以前影像復原", rows_in(command_outputs(stdout)[6]),
+          [(i, f"user{i}", f"user{i}@example.com") for i in range(1, 5)])
+    
+    # 重新開啟時重做日誌中的列變更記錄
+    commands = ["select", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="row_log_test.db",
+                                    reset_db=False)
+    print_result("列變更記錄（復原）", stdout, stderr, code)
+    expected = [(i, f"user{i}", f"user{i}@example.com") for i in range(1, 12) if i != 3]
+    expected[1] = (2, "user2", "changed@example.com")
+    check("重做日誌中的列變更記錄", rows_in(stdout), expected)
+
+
+def test_savepoints():
+    """測試保存點：只回滾保存點之後的修改，巢狀保存點與釋放"""
+    print("\n" + "="*50)
+    print("測試 37: 保存點")
+    print("="*50)
+    
+    commands = ["begin"]
+    for i in range(1, 11):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    # 保存點之後的插入造成分裂，回滾到保存點後恢復原本的樹
+    commands.append("savepoint batch1")
+    for i in range(11, 31):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands += ["update - changed@example.com where id = 5",
+                 "rollback to batch1", "select where id > 8", ".btree",
+                 # 巢狀保存點：回滾內層，釋放外層後修改仍保留
+                 "savepoint outer", "delete 1",
+                 "savepoint inner", "delete 2", "update - inner@example.com where id = 3",
+                 "rollback to savepoint inner", "release outer",
+                 "rollback to inner", "commit", "select where id < 5",
+                 # 交易外不能建立保存點
+                 "savepoint outside", ".exit"]
+    for txn_log in ["page", "row"]:
+        stdout, stderr, code = run_test(commands, db_filename="savepoint_test.db",
+                                        extra_args=[f"--txn-log={txn_log}"])
+        print_result(f"保存點（{txn_log}）", stdout, stderr, code)
+
+
+def test_shadow_spill():
+    """測試大型交易：影子頁面超過上限時溢出到暫存檔，提交與回滾都正確"""
+    print("\n" + "="*50)
+    print("測試 38: 影子頁面溢出")
+    print("="*50)
+    
+    # 影子頁面上限只有 8 頁，交易修改的頁面大多溢出到暫存檔
+    commands = ["begin"]
+    for i in range(1, 301):
+        commands.append(f"insert {i} user{i} user{i}@example.com")
+    commands += ["update - changed@example.com where id > 0", ".cache", "commit",
+                 "begin", "delete where id > 100", "rollback",
+                 "select where id > 295", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="spill_test.db",
+                                    extra_args=["--txn-pages=8"])
+    print_result("影子頁面溢出", stdout, stderr, code)
+    check("影子頁面溢出到暫存檔", int(counter(stdout, "Spilled shadow pages")) > 0, True)
+    check("記憶體中的影子頁面不超過上限", counter(stdout, "Shadow pages"), "8 / 8")
+    check("回滾後的資料", row_ids(stdout), list(range(296, 301)))
+    
+    commands = ["select where id > 295", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="spill_test.db", reset_db=False)
+    print_result("影子頁面溢出（重新開啟）", stdout, stderr, code)
+    check("溢出的影子頁面提交後保留", rows_in(stdout),
+          [(i, f"user{i}", "changed@example.com") for i in range(296, 301)])
+    
+    # 列變更記錄釘選的頁面也計入上限，超過後改用可以溢出的影子頁面，釘選的頁框有上限
+    commands = ["begin", "update - row@example.com where id > 0", ".cache", "commit",
+                "select where id > 295", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="spill_test.db", reset_db=False,
+                                    extra_args=["--txn-log=row", "--txn-pages=8",
+                                                "--cache-pages=16"])
+    print_result("影子頁面溢出（列變更記錄）", stdout, stderr, code)
+    check("列變更記錄釘選的頁框", counter(stdout, "Pinned frames"), "4")
+    check("列變更記錄的交易提交", rows_in(stdout),
+          [(i, f"user{i}", "row@example.com") for i in range(296, 301)])
+
+
+def test_background_checkpoint():
+    """測試背景檢查點：交易外的修改在背景寫回，異常結束也不會遺失"""
+    print("\n" + "="*50)
+    print("測試 39: 背景檢查點")
+    print("="*50)
+    
+    # normal 等級的交易外修改只留在緩衝池中，背景檢查點在 50 毫秒後寫回
+    session = Session("bg_checkpoint_test.db",
+                      extra_args=["--sync=normal", "--checkpoint-interval=50"])
+    for i in range(1, 51):
+        session.run(f"insert {i} user{i} user{i}@example.com")
+    time.sleep(0.5)
+    session.run(".cache")
+    dirty = [line for line in session.output.splitlines() if "Dirty frames" in line]
+    print(f"背景檢查點後的髒頁: {dirty[-1].strip()}")
+    check("背景檢查點寫回所有髒頁", counter(session.output, "Dirty frames"), "0")
+    # 強制結束行程（不經過 .exit），重新開啟後修改仍然存在
+    session.process.kill()
+    session.process.wait()
+    session.process.stdin.close()
+    session.process.stdout.close()
+    
+    commands = ["select where id > 45", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="bg_checkpoint_test.db",
+                                    reset_db=False)
+    print_result("背景檢查點（強制結束後重新開啟）", stdout, stderr, code)
+    check("強制結束後修改仍然存在", row_ids(stdout), [46, 47, 48, 49, 50])
+    
+    # 寫入時複製資料庫：背景檢查點提交修改後釋放寫入鎖，其他行程可以寫入
+    run_test([".exit"], db_filename="bg_checkpoint_cow_test.db", extra_args=["--cow"])
+    writer = Session("bg_checkpoint_cow_test.db",
+                     extra_args=["--sync=normal", "--checkpoint-interval=50"])
+    writer.run("insert 1 user1 user1@example.com")
+    time.sleep(0.5)
+    commands = ["insert 2 user2 user2@example.com", "select", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="bg_checkpoint_cow_test.db",
+                                    reset_db=False)
+    print_result("背景檢查點（其他行程寫入）", stdout, stderr, code)
+    check("背景檢查點提交後其他行程可以寫入", row_ids(stdout), [1, 2])
+    writer.run("select")
+    print_result("背景檢查點（寫入時複製）", *writer.close())
+
+
+def test_internal_fanout():
+    """測試填滿頁面的內部節點：大量資料觸發內部節點分裂，樹高仍然很低"""
+    print("\n" + "="*50)
+    print("測試 40: 內部節點扇出")
+    print("="*50)
+    
+    # 以打散的順序插入 8000 筆，葉節點超過一個內部節點的容量，根節點的子節點分裂
+    count = 8000
+    commands = []
+    for i in range(count):
+        key = i * 7919 % count + 1
+        commands.append(f"insert {key} user{key} user{key}@example.com")
+    commands += [".btree", "select where id = 1", "select where id = 4321",
+                 "select where id > 7997", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="fanout_test.db")
+    
+    # 只印出樹高與查詢結果（完整的樹結構過長）
+    tree = stdout.split("Tree:\n")[1].split("db > ")[0]
+    depth = max((len(line) - len(line.lstrip())) // 2 for line in tree.splitlines()
+                if "leaf" in line)
+    print(f"樹高: {depth + 1}")
+    print_result("內部節點扇出", "db > " + stdout.split("Tree:\n")[1].split("db > ", 1)[1],
+                 stderr, code)
+
+
+def test_leaf_key_array():
+    """測試葉節點的 key 陣列：大頁面的葉節點搜尋與第 2 版檔案的佈局升級"""
+    print("\n" + "="*50)
+    print("測試 41: 葉節點 key 陣列")
+    print("="*50)
+    
+    # 64 KB 頁面的葉節點有 220 個 cell，搜尋先以無分支二分搜尋縮小範圍
+    count = 1000
+    commands = []
+    for i in range(count):
+        key = i * 389 % count + 1
+        commands.append(f"insert {key} user{key} user{key}@example.com")
+    commands += ["select where id = 1", "select where id = 500", "select where id = 1001",
+                 "insert 777 dup dup@example.com", "select where id > 997", ".exit"]
+    stdout, stderr, code = run_test(commands, db_filename="leaf_keys_test.db",
+                                    extra_args=["--page-size=65536"])
+    print_result("葉節點搜尋（64 KB 頁面）", "db > " + stdout.split("db > ", count)[count],
+                 stderr, code)
+    
+    # 將葉節點改回第 2 版的交錯佈局，開啟時在一個交易中改寫所有葉節點
+    commands = [f"insert {i} user{i} user{i}@example.com" for i in range(1, 101)]
+    commands.append(".exit")
+    run_test(commands, db_filename="leaf_keys_test.db")
+    db_path = Path(__file__).resolve().with_name("leaf_keys_test.db")
+    write_interleaved_leaves(db_path, 2)
+    stdout, stderr, code = run_test(["select where id = 77", "select where id > 97", ".exit"],
+                                    db_filename="leaf_keys_test.db", reset_db=False)
+    print_result("葉節點佈局（第 2 版升級）", stdout, stderr, code)
+    
+    # 升級後再次開啟不會重複升級
+    stdout, stderr, code = run_test(["select where id = 100", ".exit"],
+                                    db_filename="leaf_keys_test.db", reset_db=False)
+    print_result("葉節點佈局（重新開啟）", stdout, stderr, code)
+
+
 if __name__ == "__main__":
     # 註冊清理函數，確保程式結束時執行
     atexit.register(cleanup_db_files)
@@ -1072,8 +1956,34 @@ if __name__ == "__main__":
     test_statistics_cardinality()        # 新增：統計資訊基數計算測試
     test_statistics_id_range()           # 新增：統計資訊 ID 範圍測試
     test_statistics_edge_cases()        # 新增：統計資訊邊界情況測試
+    test_buffer_pool()                  # 新增：緩衝池置換測試
+    test_mmap_mode()                    # 新增：mmap 讀取模式測試
+    test_freelist_reuse()               # 新增：空閒頁重用測試
+    test_header_page()                  # 新增：標頭頁與統計資訊持久化測試
+    test_page_size()                    # 新增：可設定的頁面大小測試
+    test_direct_io()                    # 新增：直接 I/O 模式測試
+    test_readahead()                    # 新增：循序預讀測試
+    test_pinned_pages()                 # 新增：頁面釘選測試
+    test_page_checksums()               # 新增：頁面校驗碼測試
+    test_write_ahead_log()              # 新增：預寫日誌測試
+    test_group_commit()                 # 新增：群組提交測試
+    test_sync_levels()                  # 新增：持久性等級測試
+    test_copy_on_write()                # 新增：寫入時複製測試
+    test_snapshot_reads()               # 新增：快照讀取測試
+    test_row_log()                      # 新增：列變更記錄測試
+    test_savepoints()                   # 新增：保存點測試
+    test_shadow_spill()                 # 新增：影子頁面溢出測試
+    test_background_checkpoint()        # 新增：背景檢查點測試
+    test_internal_fanout()              # 新增：內部節點扇出測試
+    test_leaf_key_array()               # 新增：葉節點 key 陣列測試
     
     print("\n" + "="*50)
     print("所有測試完成！")
+    if failed_checks:
+        print(f"{len(failed_checks)} 項檢查未通過:")
+        for title in failed_checks:
+            print(f"  - {title}")
     print("="*50)
+    if failed_checks:
+        sys.exit(1)
 